@@ -0,0 +1,85 @@
+#ifndef ACPI_H
+#define ACPI_H
+
+#include "stdint.h"
+#include "percpu.h"
+
+#define ACPI_RSDP_SIGNATURE "RSD PTR " // Signature of the Root System Description Pointer (8 bytes, no terminator)
+#define ACPI_MADT_SIGNATURE "APIC"     // Signature of the Multiple APIC Description Table
+#define ACPI_RSDP_V1_SIZE   20         // Bytes covered by the ACPI 1.0 RSDP checksum
+
+#define BIOS_EBDA_SEGMENT 0x40E   // BIOS data area word holding the real-mode segment of the EBDA
+#define BIOS_EBDA_SCAN    1024    // Bytes of the EBDA searched for the RSDP
+#define BIOS_ROM_START    0xE0000 // BIOS read-only area searched for the RSDP when the EBDA has none
+#define BIOS_ROM_END      0x100000
+#define LAPIC_DEFAULT_ADDRESS 0xFEE00000 // Local APIC registers when the MADT says nothing else
+
+// MADT entry types
+#define MADT_LOCAL_APIC          0 // One processor and its local APIC
+#define MADT_IO_APIC             1 // One I/O APIC
+#define MADT_LAPIC_ADDR_OVERRIDE 5 // 64-bit address of the local APICs
+
+// Flags of a MADT_LOCAL_APIC entry
+#define MADT_LAPIC_ENABLED        0x1 // The processor is usable
+#define MADT_LAPIC_ONLINE_CAPABLE 0x2 // Hot-plug slot: no processor yet, one may be added later (not started)
+
+// Root System Description Pointer (ACPI 2.0 layout; revision 0 stops after rsdt_address)
+typedef struct {
+    char signature[8];
+    uint8_t checksum;         // The first 20 bytes sum to 0
+    char oem_id[6];
+    uint8_t revision;         // 0 for ACPI 1.0, 2 or more when the fields below exist
+    uint32_t rsdt_address;    // Physical address of the RSDT (32-bit table pointers)
+    uint32_t length;          // Size of the whole structure
+    uint64_t xsdt_address;    // Physical address of the XSDT (64-bit table pointers)
+    uint8_t extended_checksum; // The whole structure sums to 0
+    uint8_t reserved[3];
+} __attribute__((packed)) acpi_rsdp_t;
+
+// Header every ACPI table starts with
+typedef struct {
+    char signature[4];
+    uint32_t length;          // Size of the table, header included
+    uint8_t revision;
+    uint8_t checksum;         // The whole table sums to 0
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed)) acpi_sdt_header_t;
+
+// What init_smp() needs from the MADT
+typedef struct {
+    uint32_t lapic_address;       // Physical address of the local APIC registers
+    uint32_t cpu_count;           // Enabled processors found (at most MAX_CPUS are kept)
+    uint8_t apic_ids[MAX_CPUS];   // Local APIC id of each of them, in MADT order
+    uint32_t ioapic_count;        // I/O APICs found (interrupts are still routed through the PIC)
+    uint32_t ioapic_address;      // Registers of the first one
+} madt_info_t;
+
+/**
+ * @brief Records the RSDP GRUB copied into the Multiboot2 information (tags 14 and 15).
+ *
+ * Called by parse_memory_map(). An ACPI 2.0 copy replaces a 1.0 one, not
+ * the other way round. The structure must stay mapped (the multiboot
+ * information is kept reserved).
+ *
+ * @param rsdp Copy of the RSDP inside the tag.
+ */
+void acpi_set_rsdp(const void* rsdp);
+
+/**
+ * @brief Looks up the processors and APICs in the ACPI MADT.
+ *
+ * Uses the RSDP recorded by acpi_set_rsdp(), or searches the EBDA and
+ * the BIOS area for one. Tables are reached with map_physical(), so
+ * setup_paging() must have run, and they may be gone once
+ * reclaim_acpi_memory() has run.
+ *
+ * @param info Filled in with what the MADT lists.
+ * @return 1 if a valid MADT was found, 0 otherwise.
+ */
+int acpi_parse_madt(madt_info_t* info);
+
+#endif // ACPI_H
@@ -0,0 +1,61 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "stdint.h"
+
+#define BENCH_WARMUP  16  // Untimed runs before the samples are taken
+#define BENCH_REPEATS 256 // Timed runs per benchmark
+
+// A benchmark: run() is timed BENCH_REPEATS times, and each sample is divided by ops
+typedef struct {
+    const char* name;    // Name given to the "bench" command
+    void (*setup)();     // Called once before the warmup runs (may be NULL)
+    void (*run)();       // One timed run
+    void (*teardown)();  // Called once after the samples are taken (may be NULL)
+    uint32_t ops;        // Operations one run() performs
+} benchmark_t;
+
+// Results of one benchmark, in CPU cycles per operation
+typedef struct {
+    uint32_t min;
+    uint32_t median;
+    uint32_t p99;
+    uint32_t mean;
+} bench_result_t;
+
+/**
+ * @brief Registers a benchmark with the "bench" command.
+ *
+ * The entry is placed in the .bench section, which the linker script
+ * collects between bench_start and bench_end, so no central list needs
+ * editing. Use at file scope:
+ *
+ *     BENCHMARK(page_alloc_free, NULL, run_page_alloc_free, NULL, 64);
+ */
+#define BENCHMARK(name, setup, run, teardown, ops) \
+    static const benchmark_t bench_entry_##name __attribute__((section(".bench"), used, aligned(4))) = \
+        { #name, setup, run, teardown, ops }
+
+/**
+ * @brief Times one benchmark.
+ *
+ * Runs setup(), BENCH_WARMUP untimed runs, BENCH_REPEATS runs timed with
+ * rdtsc (minus the cost of the timing itself), then teardown().
+ *
+ * @param b      Benchmark to run.
+ * @param result Receives the cycles per operation.
+ */
+void bench_run(const benchmark_t* b, bench_result_t* result);
+
+/**
+ * @brief Runs the registered benchmarks whose name starts with `prefix` and prints their results.
+ *
+ * Each result is one console line (mirrored to serial when enabled):
+ * "bench <name>: min=<n> median=<n> p99=<n> mean=<n> cycles/op".
+ *
+ * @param prefix Name prefix to select benchmarks ("" or NULL for all).
+ * @return Number of benchmarks run.
+ */
+uint32_t bench_run_matching(const char* prefix);
+
+#endif // BENCH_H
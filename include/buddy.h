@@ -0,0 +1,70 @@
+#ifndef BUDDY_H
+#define BUDDY_H
+
+#include "stdint.h"
+
+#define BUDDY_MAX_ORDER 10 // Largest block is 2^10 pages (4 MB)
+
+/**
+ * @brief Returns the number of bytes of metadata the buddy allocator needs.
+ *
+ * The metadata is one "free at this order" bitmap per order, covering the
+ * frame span rounded out to a whole number of maximum-order blocks.
+ *
+ * @param first_frame Physical frame number of the lowest managed page.
+ * @param frame_count Number of frames in the managed span (holes included).
+ * @return Size of the metadata area in bytes.
+ */
+uint32_t buddy_metadata_size(uint32_t first_frame, uint32_t frame_count);
+
+/**
+ * @brief Initializes the buddy allocator with every frame marked as used.
+ *
+ * Free memory is handed to the allocator afterwards with buddy_free_range().
+ * Only frames in the direct map can be managed, since the free lists live
+ * in the free blocks: the span is clipped at DIRECT_MAP_SIZE.
+ *
+ * @param metadata    Zero-initialized storage of at least buddy_metadata_size() bytes.
+ * @param first_frame Physical frame number of the lowest managed page.
+ * @param frame_count Number of frames in the managed span (holes included).
+ */
+void buddy_init(void* metadata, uint32_t first_frame, uint32_t frame_count);
+
+/**
+ * @brief Allocates a block of 2^order physically contiguous pages.
+ *
+ * Takes the smallest free block of at least the requested order and
+ * splits it down, returning the unused halves to their free lists.
+ * The block is aligned to its own size.
+ *
+ * @param order Block order (0 = one 4KB page, BUDDY_MAX_ORDER = 4MB).
+ * @return Physical address of the block, or NULL if none is available.
+ */
+void* buddy_alloc(uint32_t order);
+
+/**
+ * @brief Frees a block of 2^order pages and coalesces it with its free buddies.
+ *
+ * @param addr  Physical address of the block (aligned to its size).
+ * @param order Order the block was allocated with.
+ */
+void buddy_free(void* addr, uint32_t order);
+
+/**
+ * @brief Frees an arbitrary page range by splitting it into aligned blocks.
+ *
+ * Each page is coalesced with its neighbours, so freeing a range page by
+ * page or in one call ends in the same state. Frames outside the managed
+ * span are ignored.
+ *
+ * @param addr  Physical address of the first page.
+ * @param count Number of pages to free.
+ */
+void buddy_free_range(void* addr, uint32_t count);
+
+/**
+ * @brief Returns the number of free pages held by the buddy allocator.
+ */
+uint32_t buddy_free_pages();
+
+#endif // BUDDY_H
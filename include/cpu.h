@@ -0,0 +1,153 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include "stdint.h"
+
+#define EFLAGS_IF 0x200 // EFLAGS interrupt enable flag
+#define CR0_PG    0x80000000 // CR0 paging enable bit
+#define CR0_WP    0x10000 // CR0 write protect: read-only pages are enforced in ring 0 too
+#define CR0_MP    0x2     // CR0 monitor coprocessor (WAIT honours TS)
+#define CR0_EM    0x4     // CR0 FPU emulation: must be clear for SSE
+#define CR4_PSE   0x10    // CR4 page size extensions (4MB pages)
+#define CR4_PGE   0x80    // CR4 page global enable: PAGE_GLOBAL entries survive CR3 reloads
+#define CR4_OSFXSR     0x200 // CR4: the OS supports FXSAVE/FXRSTOR, which enables SSE instructions
+#define CR4_OSXMMEXCPT 0x400 // CR4: unmasked SSE exceptions raise #XM
+#define CPUID_EDX_PSE  0x8       // CPUID leaf 1 EDX: page size extensions supported
+#define CPUID_EDX_PGE  0x2000    // CPUID leaf 1 EDX: global pages supported
+#define CPUID_EDX_FXSR 0x1000000 // CPUID leaf 1 EDX: FXSAVE/FXRSTOR supported
+#define CPUID_EDX_SSE2 0x4000000 // CPUID leaf 1 EDX: SSE2 supported
+
+/**
+ * @brief Disables interrupts and returns the previous EFLAGS value.
+ *
+ * Used to make short per-CPU critical sections safe against interrupt
+ * handlers running on the same CPU, without taking a lock.
+ *
+ * @return EFLAGS before interrupts were disabled; pass it to irq_restore().
+ */
+static inline uint32_t irq_save() {
+    uint32_t flags;
+    asm volatile("pushf\n\tpop %0\n\tcli" : "=r"(flags) :: "memory");
+    return flags;
+}
+
+/**
+ * @brief Re-enables interrupts if they were enabled when irq_save() was called.
+ *
+ * @param flags Value returned by the matching irq_save().
+ */
+static inline void irq_restore(uint32_t flags) {
+    if (flags & EFLAGS_IF) asm volatile("sti" ::: "memory");
+}
+
+/**
+ * @brief Enables interrupts.
+ */
+static inline void irq_enable() {
+    asm volatile("sti" ::: "memory");
+}
+
+/**
+ * @brief Reads the CPU timestamp counter.
+ *
+ * @return Number of cycles since reset.
+ */
+static inline uint64_t rdtsc() {
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/**
+ * @brief Executes CPUID for the given leaf.
+ *
+ * @param leaf Value loaded into EAX before CPUID.
+ * @param eax, ebx, ecx, edx Receive the registers returned by CPUID.
+ */
+static inline void cpuid(uint32_t leaf, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx) {
+    asm volatile("cpuid" : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx) : "a"(leaf), "c"(0));
+}
+
+/**
+ * @brief Reads control register CR0.
+ */
+static inline uint32_t read_cr0() {
+    uint32_t cr0;
+    asm volatile("mov %%cr0, %0" : "=r"(cr0));
+    return cr0;
+}
+
+/**
+ * @brief Writes control register CR0.
+ */
+static inline void write_cr0(uint32_t cr0) {
+    asm volatile("mov %0, %%cr0" :: "r"(cr0) : "memory");
+}
+
+/**
+ * @brief Reads control register CR4.
+ */
+static inline uint32_t read_cr4() {
+    uint32_t cr4;
+    asm volatile("mov %%cr4, %0" : "=r"(cr4));
+    return cr4;
+}
+
+/**
+ * @brief Writes control register CR4.
+ */
+static inline void write_cr4(uint32_t cr4) {
+    asm volatile("mov %0, %%cr4" :: "r"(cr4) : "memory");
+}
+
+/**
+ * @brief Reads control register CR2 (the address that caused the last page fault).
+ */
+static inline uint32_t read_cr2() {
+    uint32_t cr2;
+    asm volatile("mov %%cr2, %0" : "=r"(cr2));
+    return cr2;
+}
+
+/**
+ * @brief Reads control register CR3 (physical address of the active page directory).
+ */
+static inline uint32_t read_cr3() {
+    uint32_t cr3;
+    asm volatile("mov %%cr3, %0" : "=r"(cr3));
+    return cr3;
+}
+
+/**
+ * @brief Invalidates the TLB entry for one virtual address.
+ *
+ * @param vaddr Virtual address whose translation is dropped.
+ */
+static inline void invlpg(uint32_t vaddr) {
+    asm volatile("invlpg (%0)" :: "r"(vaddr) : "memory");
+}
+
+/**
+ * @brief Flushes all non-global TLB entries by reloading CR3.
+ */
+static inline void flush_tlb() {
+    uint32_t cr3;
+    asm volatile("mov %%cr3, %0\n\tmov %0, %%cr3" : "=r"(cr3) :: "memory");
+}
+
+/**
+ * @brief Flushes every TLB entry, global ones included, by toggling CR4.PGE.
+ *
+ * Falls back to flush_tlb() when global pages are not enabled.
+ */
+static inline void flush_tlb_global() {
+    uint32_t cr4 = read_cr4();
+    if (cr4 & CR4_PGE) {
+        write_cr4(cr4 & ~CR4_PGE);
+        write_cr4(cr4);
+    } else {
+        flush_tlb();
+    }
+}
+
+#endif // CPU_H
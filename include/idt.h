@@ -0,0 +1,81 @@
+#ifndef IDT_H
+#define IDT_H
+
+#include "stdint.h"
+
+#define IDT_ENTRIES 256          // Number of interrupt vectors on x86
+#define IDT_EXCEPTIONS 32        // Vectors 0-31 are CPU exceptions
+#define IDT_STUBS 64             // Vectors with a stub in isr.asm: the exceptions, the 16 PIC IRQs and the local APIC vectors
+#define IDT_INTERRUPT_GATE 0x8E  // Present, ring 0, 32-bit interrupt gate (interrupts disabled on entry)
+
+#define EXCEPTION_PAGE_FAULT 14  // #PF vector
+
+// Page fault error code bits
+#define PF_PRESENT 0x1 // The fault was a protection violation on a present page (0: page not present)
+#define PF_WRITE   0x2 // The access was a write
+#define PF_USER    0x4 // The access came from user mode
+
+// One entry of the Interrupt Descriptor Table
+typedef struct {
+    uint16_t offset_low;   // Handler address bits 0-15
+    uint16_t selector;     // Code segment selector
+    uint8_t zero;          // Always 0
+    uint8_t type_attr;     // Gate type, privilege level and present bit
+    uint16_t offset_high;  // Handler address bits 16-31
+} __attribute__((packed)) idt_entry_t;
+
+// Operand of the LIDT instruction
+typedef struct {
+    uint16_t limit;  // Size of the table in bytes minus 1
+    uint32_t base;   // Address of the table
+} __attribute__((packed)) idt_ptr_t;
+
+// Register state saved by the stubs in isr.asm, lowest address first
+typedef struct {
+    uint32_t edi, esi, ebp, esp, ebx, edx, ecx, eax; // Pushed by PUSHA
+    uint32_t int_no;     // Vector number pushed by the stub
+    uint32_t err_code;   // Error code pushed by the CPU, or 0 pushed by the stub
+    uint32_t eip, cs, eflags; // Pushed by the CPU
+} interrupt_frame_t;
+
+// Interrupt handler; the frame may be modified to change the state restored by IRET
+typedef void (*interrupt_handler_t)(interrupt_frame_t* frame);
+
+/**
+ * @brief Fills in the IDT with the stubs from isr.asm and loads it with LIDT.
+ *
+ * Covers the CPU exceptions, the PIC IRQs (see pic.h) and the local APIC
+ * vectors (see lapic.h).
+ *
+ * The gates use the code segment selector that is loaded at the time of the
+ * call (GDT_KERNEL_CODE once cpu_init() has run).
+ */
+void init_idt();
+
+/**
+ * @brief Loads the IDT filled in by init_idt() on the calling CPU (the APs share it).
+ */
+void idt_load();
+
+/**
+ * @brief Installs the C handler called for an interrupt vector.
+ *
+ * @param vector  Interrupt vector (0-255).
+ * @param handler Function to call, or NULL to remove the handler.
+ */
+void register_interrupt_handler(uint8_t vector, interrupt_handler_t handler);
+
+/**
+ * @brief Common entry point of all interrupt stubs.
+ *
+ * Calls the registered handler for the vector. A CPU exception without a
+ * handler is reported on screen and halts the system. PIC IRQs are
+ * acknowledged after their handler returns, and so are local APIC
+ * interrupts; spurious ones are dropped. On the way out of either the
+ * scheduler may switch to another task.
+ *
+ * @param frame Saved register state.
+ */
+void isr_dispatch(interrupt_frame_t* frame);
+
+#endif // IDT_H
@@ -7,12 +7,29 @@
 // Screen Output
 // =====================
 
+#define SCREEN_ROWS 25        // VGA text mode rows
+#define SCREEN_COLS 80        // VGA text mode columns
+#define SCROLLBACK_LINES 256  // Lines kept in the shadow buffer, screen included (power of two)
+
+// Console output devices, for console_set_outputs()
+#define CONSOLE_VGA    0x1    // VGA text screen (the default)
+#define CONSOLE_SERIAL 0x2    // COM1, see serial.h
+
+// Copy of the console text (scrollback included) and cursor, see console_save()
+typedef struct {
+    uint16_t lines[SCROLLBACK_LINES][SCREEN_COLS];
+    uint32_t screen_top;
+    uint32_t history;
+    uint32_t row, col;
+} console_snapshot_t;
+
 /**
  * @brief Outputs a single character to the screen at the current cursor position.
  *
  * Automatically handles newline characters and wraps text at the edge
  * of the screen. If the cursor moves beyond the last screen row,
- * the terminal is scrolled up by one line.
+ * the terminal is scrolled up by one line. Only the changed cells are
+ * written to VGA memory.
  *
  * @param c Character to display.
  */
@@ -21,46 +38,184 @@ void putc(char c);
 /**
  * @brief Print a null-terminated string to the screen.
  *
+ * VGA memory is updated once, after the whole string. With CONSOLE_SERIAL
+ * the string is also queued on COM1.
+ *
  * @param s Pointer to the string to print.
  */
 void print(const char* s);
 
+/**
+ * @brief Print an unsigned integer in decimal.
+ *
+ * @param value Number to print.
+ */
+void print_dec(uint32_t value);
+
+/**
+ * @brief Print an unsigned integer as 8 hexadecimal digits with a "0x" prefix.
+ *
+ * @param value Number to print.
+ */
+void print_hex(uint32_t value);
+
 /**
  * @brief Clears the entire VGA text screen and resets the cursor position.
+ *
+ * Lines that scrolled off earlier stay in the scrollback.
  */
 void clrscr();
 
+/**
+ * @brief Copies the parts of the screen that changed to VGA memory.
+ *
+ * Output is drawn into a RAM shadow buffer; print() and putc() flush it.
+ */
+void console_flush();
+
+/**
+ * @brief Selects the devices print() and putc() write to.
+ *
+ * @param outputs CONSOLE_VGA and/or CONSOLE_SERIAL.
+ * @return The outputs selected before, so they can be restored.
+ */
+uint32_t console_set_outputs(uint32_t outputs);
+
+/**
+ * @brief Copies the console text, scrollback and cursor, so console_restore() can put them back.
+ *
+ * @param snap Receives the copy (static storage: it holds the whole scrollback).
+ */
+void console_save(console_snapshot_t* snap);
+
+/**
+ * @brief Puts back the console as console_save() found it and redraws the screen.
+ *
+ * @param snap Copy made by console_save().
+ */
+void console_restore(const console_snapshot_t* snap);
+
+/**
+ * @brief Moves the view through the scrollback (Page Up / Page Down in read_line()).
+ *
+ * @param lines Lines to scroll back by (positive) or forward by (negative).
+ */
+void console_scroll_view(int32_t lines);
+
 // =====================
 // Keyboard Input
 // =====================
 
+#define INPUT_BUFFER_SIZE 1024 // Characters buffered between the input IRQs and read_char() (power of two, holds a paste)
+#define LINE_MAX          128  // Longest line read_line() edits, including the null terminator
+#define LINE_HISTORY      16   // Lines kept for Up / Down in read_line()
+
+// Codes read_char() returns for the navigation keys (the Emacs control keys for the same moves)
+#define KEY_HOME      0x01
+#define KEY_LEFT      0x02
+#define KEY_DELETE    0x04
+#define KEY_END       0x05
+#define KEY_RIGHT     0x06
+#define KEY_DOWN      0x0E
+#define KEY_UP        0x10
+#define KEY_PAGE_UP   0x1E
+#define KEY_PAGE_DOWN 0x1F
+
+#define MAX_IDLE_TASKS 4 // Functions register_idle_task() can hold
+
+typedef int (*idle_task_t)(); // Idle work: does a bounded amount, returns 1 if more is left
+
 /**
- * @brief Waits for and returns the next ASCII character input from the keyboard.
+ * @brief Adds work to run while the system is idle.
  *
- * Processes basic US QWERTY layout, including Shift and Caps Lock functionality for
- * letter case and symbol selection. Ignores key releases and unmapped keys.
+ * The idle thread runs the tasks whenever no other task is runnable, and
+ * only halts once none of them has work left. Before init_scheduler(),
+ * read_char() and read_line() run them each time they would halt.
  *
- * Special handling includes:
- * - Shift keys (left/right) for uppercase letters and symbols.
- * - Caps Lock toggle for letter case.
- * - Ignores non-character scancodes and key release events.
+ * @param task Function doing a bounded amount of work; returns 1 if it has more to do.
+ * @return 1 on success, 0 if MAX_IDLE_TASKS tasks are registered already.
+ */
+int register_idle_task(idle_task_t task);
+
+/**
+ * @brief Drains the log ring to the console and runs each idle task once.
+ *
+ * Only one CPU runs them at a time; on the others this returns 0 at once.
+ *
+ * @return 1 if an idle task has more work left, 0 otherwise.
+ */
+int run_idle_tasks();
+
+/**
+ * @brief Installs the IRQ 1 handler and unmasks the keyboard line.
+ *
+ * The handler decodes scancodes into the console input ring that
+ * read_char() takes characters from. pic_remap() and init_idt() must
+ * have run.
+ */
+void init_keyboard();
+
+/**
+ * @brief Queues a character of console input.
+ *
+ * Called by the keyboard and serial interrupt handlers. Interrupt handlers
+ * never nest, so there is a single producer at a time and the ring needs
+ * no lock. Characters arriving while the buffer is full are dropped. A task
+ * waiting in read_char() or read_line() is woken.
+ *
+ * @param c Character (or KEY_* code) to queue.
+ */
+void console_input(char c);
+
+/**
+ * @brief Returns the next input character if one is queued.
+ *
+ * @return The character (0-255), or -1 if the input ring is empty.
+ */
+int try_read_char();
+
+/**
+ * @brief Waits for and returns the next ASCII character input from the keyboard.
+ *
+ * Characters are decoded by the keyboard interrupt handler (US QWERTY
+ * layout, with Shift and Caps Lock) and queued in a ring buffer, which
+ * the serial port feeds too. While the buffer is empty the calling task
+ * sleeps until an input interrupt wakes it, so waiting for input costs no
+ * CPU time; before init_scheduler() the CPU is halted instead, after the
+ * log ring is drained and the idle tasks have run. Interrupts must be enabled.
  *
  * @return The ASCII character corresponding to the pressed key.
  */
 char read_char();
 
 /**
- * @brief Reads a line of input from the keyboard until ENTER is pressed
- *        or the buffer is full. Echoes typed characters to the screen.
+ * @brief Processes the queued input and returns a line once Enter has been received.
+ *
+ * Never blocks: the line being edited is kept between calls. Supports
+ * Backspace, Delete, Left/Right, Home/End, Up/Down through the last
+ * LINE_HISTORY lines and Page Up/Down through the scrollback, from the
+ * keyboard or as ANSI sequences from a serial terminal. Only the cells
+ * that change are redrawn, so typing or pasting at the end of the line
+ * costs one echo per character. Characters beyond the buffer are refused
+ * (not echoed) rather than cut off later.
+ *
+ * @param buf Pointer to the buffer where the input line will be stored.
+ * @param max_len Maximum size of the buffer including space for the null terminator.
+ * @return Length of the line, or -1 if no complete line is available yet.
+ */
+int try_read_line(char* buf, int max_len);
+
+/**
+ * @brief Reads a line of input, with line editing and history, until Enter is pressed.
  *
- * Input stops when a newline character ('\n') is received or when the buffer
- * reaches its maximum capacity (max_len - 1), leaving space for the null terminator.
- * In either case, a newline is printed to the screen.
+ * Waits (asleep, as read_char() does) for input and edits the line as try_read_line() does.
+ * Once the buffer is full, further characters are refused until Enter.
  *
  * @param buf Pointer to the buffer where the input line will be stored.
  * @param max_len Maximum size of the buffer including space for the null terminator.
+ * @return Length of the line.
  */
-void read_line(char* buf, int max_len);
+int read_line(char* buf, int max_len);
 
 // =====================
 // Port I/O
@@ -74,4 +229,19 @@ void read_line(char* buf, int max_len);
  */
 uint8_t inb(uint16_t port);
 
+/**
+ * @brief Write a byte to an I/O port.
+ *
+ * @param port The I/O port number.
+ * @param value The byte to write.
+ */
+void outb(uint16_t port, uint8_t value);
+
+/**
+ * @brief Wait roughly 1-4 microseconds by writing to an unused port (0x80).
+ *
+ * Gives slow devices such as the PIC time to take a command.
+ */
+void io_wait();
+
 #endif // IO_H
\ No newline at end of file
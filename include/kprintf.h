@@ -0,0 +1,112 @@
+#ifndef KPRINTF_H
+#define KPRINTF_H
+
+#include "stdint.h"
+#include "stdarg.h"
+
+#define KPRINTF_BUFFER_SIZE 256 // Longest kprintf() output, terminator included (longer output is cut)
+#define LOG_MESSAGE_MAX 120     // Longest log message kept in the ring, terminator included
+#define LOG_RING_ENTRIES 256    // Messages the log ring holds (power of two); the oldest are overwritten
+#define LOG_MAX_SINKS 4         // Outputs the log ring can be drained to
+
+// Log levels, most severe first
+#define LOG_ERROR 0
+#define LOG_WARN  1
+#define LOG_INFO  2
+#define LOG_DEBUG 3
+
+// Messages above this level are compiled out (build with -DLOG_COMPILE_LEVEL=LOG_DEBUG to keep them all)
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_INFO
+#endif
+
+// One message in the log ring
+typedef struct {
+    volatile uint32_t seq;      // Sequence number + 1 once the entry is complete (0 = never written)
+    uint8_t level;              // LOG_* level
+    uint64_t timestamp;         // rdtsc() when the message was logged
+    char text[LOG_MESSAGE_MAX]; // Formatted message (no trailing newline)
+} log_entry_t;
+
+// Output the log ring is drained to
+typedef void (*log_sink_t)(const char* s);
+
+// The log ring itself, readable from a debugger after a hang (entry i has seq i + 1)
+extern log_entry_t klog_ring[LOG_RING_ENTRIES];
+
+/**
+ * @brief Formats a string into a buffer.
+ *
+ * Supports %d, %i, %u, %x, %X, %p, %s, %c and %%, with an optional '0'
+ * flag and field width (e.g. %08x). An 'l' length modifier is accepted
+ * and ignored, since long is 32 bits.
+ *
+ * @param buf  Output buffer.
+ * @param size Size of the buffer; the output is cut to size - 1 characters and terminated.
+ * @param fmt  Format string.
+ * @param ap   Arguments.
+ * @return Number of characters the full output has (excluding the terminator).
+ */
+int kvsnprintf(char* buf, uint32_t size, const char* fmt, va_list ap);
+
+/**
+ * @brief Formats a string into a buffer; see kvsnprintf().
+ */
+int ksnprintf(char* buf, uint32_t size, const char* fmt, ...);
+
+/**
+ * @brief Formats a string and prints it on the console right away; see kvsnprintf().
+ *
+ * @return Number of characters printed.
+ */
+int kprintf(const char* fmt, ...);
+
+/**
+ * @brief Logs a formatted message; use the klog() macro instead.
+ */
+void klog_write(uint32_t level, const char* fmt, ...);
+
+/**
+ * @brief Logs a formatted message at a level.
+ *
+ * The message is formatted into the lock-free log ring and only reaches
+ * the console when the ring is drained (klog_drain(), called while the
+ * system is idle). LOG_ERROR messages are drained at once. Messages above
+ * LOG_COMPILE_LEVEL cost nothing, and ones above the runtime level set
+ * with klog_set_level() are dropped before formatting.
+ * Safe to call from interrupt handlers.
+ */
+#define klog(level, ...) \
+    do { if ((level) <= LOG_COMPILE_LEVEL) klog_write((level), __VA_ARGS__); } while (0)
+
+/**
+ * @brief Sets the most verbose level klog() keeps (LOG_INFO by default).
+ *
+ * @param level LOG_* level.
+ */
+void klog_set_level(uint32_t level);
+
+/**
+ * @brief Adds an output the log ring is drained to.
+ *
+ * The console is registered by default.
+ *
+ * @param sink Function printing a string.
+ * @return 1 on success, 0 if LOG_MAX_SINKS outputs are registered already.
+ */
+int klog_add_sink(log_sink_t sink);
+
+/**
+ * @brief Writes all messages logged since the last drain to the sinks.
+ *
+ * Messages older than the ring can hold are reported as a count of lost
+ * messages.
+ */
+void klog_drain();
+
+/**
+ * @brief Prints every message still held by the ring on the console (the "dmesg" command).
+ */
+void klog_dump();
+
+#endif // KPRINTF_H
@@ -0,0 +1,88 @@
+#ifndef LAPIC_H
+#define LAPIC_H
+
+#include "stdint.h"
+
+// Vectors of the local APIC interrupts (after the PIC IRQs; isr.asm has stubs up to IDT_STUBS)
+#define LAPIC_VECTOR_BASE     48 // First local APIC vector; isr_dispatch() acknowledges these with lapic_eoi()
+#define LAPIC_TIMER_VECTOR    48 // Local APIC timer: the scheduler tick of the APs
+#define IPI_RESCHEDULE_VECTOR 49 // Another CPU queued work this one should look at
+#define IPI_TLB_FLUSH_VECTOR  50 // Another CPU changed kernel mappings (tlb_shootdown())
+#define LAPIC_SPURIOUS_VECTOR 63 // Spurious interrupt (low four bits set, as older APICs require); never acknowledged
+
+// Register offsets from the local APIC base
+#define LAPIC_ID            0x020 // APIC id in bits 24-31
+#define LAPIC_TPR           0x080 // Task priority: 0 lets every interrupt through
+#define LAPIC_EOI           0x0B0 // Write 0 to acknowledge the interrupt being serviced
+#define LAPIC_SVR           0x0F0 // Spurious interrupt vector and the APIC software enable bit
+#define LAPIC_ICR_LOW       0x300 // Interrupt command: writing it sends the IPI
+#define LAPIC_ICR_HIGH      0x310 // Interrupt command destination (APIC id in bits 24-31)
+#define LAPIC_LVT_TIMER     0x320 // Timer vector and mode
+#define LAPIC_TIMER_INITIAL 0x380 // Timer start count
+#define LAPIC_TIMER_CURRENT 0x390 // Timer count left
+#define LAPIC_TIMER_DIVIDE  0x3E0 // Timer clock divider
+
+#define LAPIC_SVR_ENABLE       0x100   // Software enable
+#define LAPIC_ICR_INIT         0x500   // Delivery mode INIT
+#define LAPIC_ICR_STARTUP      0x600   // Delivery mode STARTUP (the vector is the start page number)
+#define LAPIC_ICR_PENDING      0x1000  // Delivery status: the previous IPI has not been accepted yet
+#define LAPIC_ICR_ASSERT       0x4000  // Level assert (required for every mode but INIT de-assert)
+#define LAPIC_LVT_MASKED       0x10000 // The timer counts but does not interrupt
+#define LAPIC_TIMER_PERIODIC   0x20000 // The timer reloads the start count when it reaches 0
+#define LAPIC_TIMER_DIV_16     0x3     // Timer runs at the bus clock / 16
+#define LAPIC_CALIBRATE_TICKS  5       // PIT ticks the timer is measured over
+
+/**
+ * @brief Maps the local APIC registers (the same physical page on every CPU, each seeing its own APIC).
+ *
+ * @param phys Physical address of the registers (from the MADT).
+ * @return 1 on success, 0 if the page could not be mapped.
+ */
+int init_lapic(uint32_t phys);
+
+/**
+ * @brief Returns whether init_lapic() has mapped the local APIC.
+ */
+int lapic_present();
+
+/**
+ * @brief Software-enables the calling CPU's local APIC and lets every interrupt priority through.
+ */
+void lapic_enable();
+
+/**
+ * @brief Returns the local APIC id of the calling CPU.
+ */
+uint32_t lapic_id();
+
+/**
+ * @brief Acknowledges the local APIC interrupt being serviced.
+ */
+void lapic_eoi();
+
+/**
+ * @brief Sends an inter-processor interrupt and waits until the target's APIC has accepted it.
+ *
+ * @param apic_id Local APIC id of the target CPU.
+ * @param command Low interrupt command word: a vector, or LAPIC_ICR_INIT / LAPIC_ICR_STARTUP with their flags.
+ */
+void lapic_send_ipi(uint32_t apic_id, uint32_t command);
+
+/**
+ * @brief Measures how many local APIC timer counts make up one PIT tick.
+ *
+ * Takes LAPIC_CALIBRATE_TICKS ticks; init_timer() must have run and
+ * interrupts must be enabled.
+ *
+ * @return Timer counts (at LAPIC_TIMER_DIV_16) per tick.
+ */
+uint32_t lapic_timer_calibrate();
+
+/**
+ * @brief Makes the calling CPU's local APIC timer interrupt periodically on LAPIC_TIMER_VECTOR.
+ *
+ * @param count Counts between interrupts, as returned by lapic_timer_calibrate().
+ */
+void lapic_timer_start(uint32_t count);
+
+#endif // LAPIC_H
@@ -9,37 +9,152 @@
 #include "multiboot.h"
 
 #define PAGE_SIZE 4096 // Size of a memory page in bytes (4 KB)
-#define MAX_MEMORY_REGIONS 32 // Maximum number of usable memory regions the system can track
+#define MAX_MEMORY_REGIONS 32 // Maximum number of memory regions (after merging) the system can track
 #define PAGE_PRESENT 0x1 // Page table entry flag: page is present in memory
 #define PAGE_WRITABLE 0x2 // Page table entry flag: page is writable
 #define PAGE_USER 0x4 // Page table entry flag: page is accessible from user mode
+#define PAGE_WRITE_THROUGH 0x8 // Page table entry flag: writes go straight to memory (PWT)
+#define PAGE_CACHE_DISABLE 0x10 // Page table entry flag: accesses bypass the caches (PCD), for device registers
+#define PAGE_LARGE 0x80 // Page directory entry flag: entry maps a 4MB page (requires CR4.PSE)
+#define PAGE_GLOBAL 0x100 // Page table entry flag: translation survives CR3 reloads (requires CR4.PGE); set on kernel mappings
+#define PAGE_COW 0x200 // Page table entry flag (available to software): read-only copy-on-write share
+#define LARGE_PAGE_SIZE 0x400000 // Size of a large page in bytes (4 MB)
+#define TLB_FLUSH_THRESHOLD 32 // Range operations touching more pages than this reload CR3 instead of using INVLPG
+#define UNMAP_FREE_FRAMES 0x1 // unmap_range() flag: also free the physical pages that were mapped
+#define UNMAP_FREE_BATCH 32 // Frames unmap_range() collects before one TLB shootdown frees them
+#define LOW_MEMORY_END 0x100000 // The first MiB (BIOS areas, real-mode structures) is never handed out
+#define KERNEL_SPACE_START 0xC0000000 // Start of the kernel half (page directory entry 768), shared by every directory
+#define KERNEL_VIRTUAL_BASE 0xC0000000 // Where the direct map puts physical address 0; the kernel runs at +1 MiB (same value in linker.ld and boot.asm)
+#define DIRECT_MAP_SIZE 0x30000000 // Physical memory mapped at KERNEL_VIRTUAL_BASE (768 MiB, up to the heap window); RAM above it is high memory, reached with kmap()
+#define BOOT_MAP_SIZE 0x1000000 // Physical memory boot.asm maps before the direct map exists (16 MiB: kernel, multiboot information, allocator metadata)
+#define ZEROED_POOL_SIZE 64 // Pre-zeroed frames kept for alloc_zeroed_page()
+#define ZEROED_POOL_BATCH 8 // Frames refill_zeroed_pages() clears per call
+#define MAX_DEMAND_REGIONS 32 // Demand-zero regions that can be reserved with reserve_region()
+#define PAGE_REF_PINNED 0xFFFF // Saturated copy-on-write reference count: the page stays allocated for good
 
-// Kernel heap configuration
-#define KERNEL_HEAP_START  ((uint32_t)&kernel_end)  // Heap starts after kernel
-#define KERNEL_HEAP_SIZE   0x100000                 // 1 MB heap
-#define KERNEL_HEAP_END    (KERNEL_HEAP_START + KERNEL_HEAP_SIZE)  // Heap limit
+// Page table self-mapping. The last page directory entry points at the directory
+// itself, so the active directory's page tables appear as one 4MB window of virtual
+// memory. Every other frame (other directories, tables being built, pages to clear
+// or copy) is reached through the direct map with phys_to_virt(), or with kmap() when it
+// is in high memory.
+#define RECURSIVE_PD_INDEX      1023        // Directory entry pointing at the directory itself
+#define PAGE_TABLES_VADDR       0xFFC00000  // Page tables of the active directory (table i at +i*4KB)
+#define PAGE_DIRECTORY_VADDR    0xFFFFF000  // The active page directory
 
-// Bitmap utility macros
-#define BITMAP_SET(bitmap, bit)    (bitmap[(bit)/8] |=  (1 << ((bit)%8)))
-#define BITMAP_CLEAR(bitmap, bit)  (bitmap[(bit)/8] &= ~(1 << ((bit)%8)))
-#define BITMAP_TEST(bitmap, bit)   (bitmap[(bit)/8] &   (1 << ((bit)%8)))
+// Kernel heap configuration. The heap lives in its own virtual window, away from the
+// kernel image and the allocator metadata after it, and ksbrk() maps pages into it on demand.
+#define KERNEL_HEAP_START     0xF0000000  // Heap virtual base (page directory entry 960)
+#define KERNEL_HEAP_MAX_SIZE  0x0F000000  // Heap window size (240 MB)
+#define KERNEL_HEAP_END       (KERNEL_HEAP_START + KERNEL_HEAP_MAX_SIZE)  // Heap limit
+#define HEAP_TRIM_THRESHOLD   0x10000     // Unused mapped bytes above the break before ksbrk() gives pages back (64 KB)
+
+// Window map_physical() maps device registers and firmware tables into when the
+// direct map does not cover them (or covers them with the wrong caching)
+#define KERNEL_MMIO_START     0xFF400000  // Page directory entry 1021 (1020 is left to the benchmarks)
+#define KERNEL_MMIO_END       KMAP_START
+
+// Per-CPU slots kmap() maps high memory frames at, one page each, just above the MMIO window
+#define KMAP_SLOTS            8           // At least MAX_CPUS
+#define KMAP_START            (PAGE_TABLES_VADDR - KMAP_SLOTS * PAGE_SIZE)
+
+// Bitmap utility macros (bitmap is an array of 32-bit words so it can be scanned a word at a time)
+#define BITMAP_BITS_PER_WORD 32
+#define BITMAP_WORD_FULL   0xFFFFFFFF // Every page tracked by this word is used
+#define BITMAP_SET(bitmap, bit)    (bitmap[(bit)/32] |=  (1u << ((bit)%32)))
+#define BITMAP_CLEAR(bitmap, bit)  (bitmap[(bit)/32] &= ~(1u << ((bit)%32)))
+#define BITMAP_TEST(bitmap, bit)   (bitmap[(bit)/32] &   (1u << ((bit)%32)))
 
 // Macro to align memory size to the nearest 8-byte boundary for alignment safety
 #define ALIGN8(x) (((x) + 7) & ~7)
 
-// Memory region structure used to represent a usable block of physical memory.
+#define HEAP_MIN_SPLIT 16 // Smallest payload worth splitting off a free heap block
+
+// Virtual range reserved without physical backing. Pages get a frame (or the
+// shared zero page, for reads) from the page fault handler when first touched.
+typedef struct {
+    uint32_t* pd;     // Page directory the range belongs to (page_directory for kernel ranges)
+    uint32_t start;   // First address (page aligned)
+    uint32_t end;     // End of the range (page aligned); start == end marks an unused slot
+    uint32_t flags;   // Flags the pages are mapped with (PAGE_WRITABLE, PAGE_USER)
+} demand_region_t;
+
+// Memory region structure used to represent a block of RAM from the memory map.
+// parse_memory_map() keeps them sorted by base, with touching regions of one type merged.
 typedef struct {
     uint64_t base;   // Start address of the memory region
     uint64_t length; // Length of the memory region in bytes
+    uint32_t type;   // MULTIBOOT_MEMORY_AVAILABLE or MULTIBOOT_MEMORY_ACPI_RECLAIMABLE
 } MemoryRegion;
 
-extern char kernel_end; // Symbol defined by linker indicating end of kernel binary
+// Activity counters kept by an allocator
+typedef struct {
+    uint32_t allocs;         // Successful allocations
+    uint32_t frees;          // Frees
+    uint32_t failed_allocs;  // Allocations that returned NULL
+    uint32_t in_use;         // Pages (page allocator) or bytes (kmalloc) currently allocated
+    uint32_t high_water;     // Highest value in_use has reached
+} alloc_counters_t;
+
+#define LATENCY_BUCKETS 16    // Number of buckets in a latency histogram
+#define LATENCY_MIN_SHIFT 5   // Bucket i counts calls taking [2^(i+5), 2^(i+6)) cycles; bucket 0 also takes shorter ones
+
+// Log2 histogram of call durations in CPU cycles (rdtsc)
+typedef struct {
+    uint32_t buckets[LATENCY_BUCKETS];
+} latency_histogram_t;
+
+// Snapshot of the allocator statistics, filled in by get_memory_stats()
+typedef struct {
+    alloc_counters_t pages;               // Page allocator counters (in pages)
+    latency_histogram_t page_latency;     // alloc_page() latency
+    uint32_t total_pages;                 // Pages tracked by the physical allocator
+    uint32_t free_pages;                  // Pages free in the global allocator
+    uint32_t high_pages;                  // Pages of total_pages above the direct map (alloc_highmem_page())
+    uint32_t free_high_pages;             // Pages of free_pages above the direct map
+    uint32_t cached_pages;                // Free pages held in per-CPU magazines
+    uint32_t zeroed_pages;                // Free pages held pre-zeroed for alloc_zeroed_page()
+    uint32_t check_failures;              // PMM_CHECK disagreements between buddy and bitmap
+
+    alloc_counters_t heap;                // kmalloc counters (in bytes)
+    latency_histogram_t kmalloc_latency;  // kmalloc() latency
+    uint32_t heap_break;                  // Current heap break (heap_current)
+    uint32_t heap_mapped_bytes;           // Bytes of the heap window reserved for the heap (backed when touched)
+    uint32_t free_blocks;                 // Length of the heap free list
+    uint32_t free_bytes;                  // Bytes held by the heap free list
+    uint32_t largest_free_block;          // Largest block on the heap free list
+} memory_stats_t;
+
+extern char kernel_start; // Symbol defined by linker indicating start of kernel binary (virtual address)
+extern char kernel_end; // Symbol defined by linker indicating end of kernel binary (virtual address)
+
+/**
+ * @brief Returns the direct map address of a physical address.
+ *
+ * Every frame alloc_page(), alloc_pages() and alloc_zeroed_page() hand
+ * out is below DIRECT_MAP_SIZE, so its contents are always reachable this
+ * way. Frames from alloc_highmem_page() may not be: use kmap().
+ *
+ * @param paddr Physical address below DIRECT_MAP_SIZE.
+ * @return Kernel virtual address of the same byte.
+ */
+static inline void* phys_to_virt(uint32_t paddr) {
+    return (void*)(paddr + KERNEL_VIRTUAL_BASE);
+}
 
-//extern MemoryRegion usable_memory_regions[MAX_MEMORY_REGIONS]; // Detected usable memory regions
-//extern uint32_t usable_region_count; // Count of usable memory regions
+/**
+ * @brief Returns the physical address of a direct map (or kernel image) address.
+ *
+ * @param vaddr Kernel virtual address between KERNEL_VIRTUAL_BASE and KERNEL_VIRTUAL_BASE + DIRECT_MAP_SIZE.
+ * @return Physical address of the same byte.
+ */
+static inline uint32_t virt_to_phys(const void* vaddr) {
+    return (uint32_t)vaddr - KERNEL_VIRTUAL_BASE;
+}
+
+//extern MemoryRegion memory_regions[MAX_MEMORY_REGIONS]; // Detected RAM regions, sorted and merged
+//extern uint32_t memory_region_count; // Count of memory regions
 //extern uint32_t bitmap_size_bytes; // Size of the bitmap in bytes
 //extern uint32_t total_pages; // Total number of physical pages
-//extern uint32_t memory_start; // Lowest physical address in usable memory
 //extern uint32_t* page_directory; // Page directory used in paging
 
 /**
@@ -47,51 +162,176 @@ extern char kernel_end; // Symbol defined by linker indicating end of kernel bin
  * 
  * Calculates usable memory from the multiboot memory map, sets up a bitmap
  * to track allocated/free pages, and marks pages as free or reserved.
- * Pages used by the bitmap itself are marked as used to prevent overwrite.
+ * The first MiB, the kernel image, the multiboot information and the
+ * allocator's own metadata stay reserved even inside usable regions.
+ * Memory above DIRECT_MAP_SIZE (up to 4 GiB) becomes the high memory
+ * zone, only handed out by alloc_highmem_page(). parse_memory_map() must
+ * have run.
+ *
+ * Page indices (and so the bitmap and the page reference counts) only
+ * cover the frames inside memory regions, not the holes between them.
+ * ACPI reclaimable regions stay used until reclaim_acpi_memory().
+ *
+ * Before any page is handed out, the direct map of physical memory at
+ * KERNEL_VIRTUAL_BASE is completed in the boot page directory (with 4MB
+ * pages when available, otherwise with page tables kept next to the other
+ * metadata), so phys_to_virt() works for every frame below the high
+ * memory zone from then on.
+ *
+ * When built with PMM_BUDDY (`make PMM=buddy`), the free pages are then
+ * handed to the buddy allocator, which serves all later allocations
+ * except those of high memory, which always uses the bitmap. With
+ * PMM_CHECK (`make PMM_CHECK=1`) the bitmap is kept in sync and every
+ * buddy operation is cross-checked against it.
  */
 void init_physical_allocator();
 
 /**
  * @brief Allocates a single 4KB physical page.
+ *
+ * Served from the calling CPU's page magazine, which is refilled from the
+ * global allocator in batches. The bitmap backend scans a 32-bit word at a
+ * time from a "first possibly free" hint, skipping fully used words.
  * 
  * @return Pointer to the start of the allocated physical page, or NULL if none available.
  */
 void* alloc_page();
 
+/**
+ * @brief Allocates a single 4KB physical page from the high memory zone.
+ *
+ * High memory frames are outside the direct map, so this is for pages
+ * only ever used through a mapping of their own (user pages, demand-zero
+ * pages) or through kmap(). Free them with free_page().
+ *
+ * @return Physical address of the page, or NULL if high memory is absent or full.
+ */
+void* alloc_highmem_page();
+
+/**
+ * @brief Maps a physical page into kernel space for a short access.
+ *
+ * Pages in the direct map are returned through it. Any other tracked page
+ * goes to the calling CPU's kmap slot, with interrupts disabled until the
+ * matching kunmap(), so each CPU holds at most one such mapping at a time.
+ *
+ * @param paddr Physical address of the page.
+ * @return Kernel virtual address of the page.
+ */
+void* kmap(uint32_t paddr);
+
+/**
+ * @brief Ends a mapping made by kmap().
+ *
+ * @param vaddr Address kmap() returned.
+ */
+void kunmap(void* vaddr);
+
+/**
+ * @brief Allocates a single 4KB physical page filled with zeros.
+ *
+ * Taken from the pool of frames refill_zeroed_pages() clears while the
+ * system is idle, so callers on the mapping and page fault paths do not
+ * pay for the clearing. When the pool is empty the page comes from
+ * alloc_page() and is cleared on the spot.
+ *
+ * @return Physical address of the page, or NULL if none available.
+ */
+void* alloc_zeroed_page();
+
+/**
+ * @brief Tops up the pre-zeroed page pool; meant to run while the system is idle.
+ *
+ * Clears at most ZEROED_POOL_BATCH frames per call so input is not held up.
+ *
+ * @return 1 if the pool is still not full (more work to do), 0 otherwise.
+ */
+int refill_zeroed_pages();
+
 /**
  * @brief Frees a previously allocated page.
+ *
+ * The frame is cached on the calling CPU's page magazine; a full magazine
+ * drains a batch back to the global allocator first; high memory frames
+ * go straight back to the high memory zone. NULL and untracked addresses
+ * are ignored.
  * 
  * @param addr Physical address of the page to free.
  */
 void free_page(void* addr);
 
+/**
+ * @brief Returns every frame cached in the calling CPU's page magazine to the global allocator.
+ */
+void drain_page_magazines();
+
+/**
+ * @brief Allocates `count` physically contiguous 4KB pages.
+ *
+ * Intended for buffers that must be contiguous in physical memory (DMA
+ * buffers, large page tables, 4MB page mappings). Runs bypass the per-CPU
+ * page magazines; if no run is found the magazines are drained and the
+ * search is retried.
+ *
+ * @param count     Number of pages to allocate.
+ * @param alignment Required alignment of the first page, in pages (a power of two; 0 or 1 for none).
+ * @return Physical address of the first page, or NULL if no suitable run is free.
+ */
+void* alloc_pages(uint32_t count, uint32_t alignment);
+
+/**
+ * @brief Frees `count` contiguous pages previously returned by alloc_pages().
+ *
+ * @param addr  Physical address of the first page.
+ * @param count Number of pages to free.
+ */
+void free_pages(void* addr, uint32_t count);
+
+/**
+ * @brief Hands the ACPI reclaimable regions of the memory map to the page allocator.
+ *
+ * Those regions hold the ACPI tables, so this may only run once nothing
+ * reads them any more: after init_smp() has parsed the MADT.
+ *
+ * @return Number of pages reclaimed.
+ */
+uint32_t reclaim_acpi_memory();
+
 /**
  * @brief Parses the Multiboot memory map from the provided Multiboot information structure.
  *
  * This function iterates through the Multiboot tags starting from the
  * given multiboot_info pointer, locates the memory map tag (type 6),
- * and extracts usable memory regions from the memory map entries.
+ * and extracts the usable and ACPI reclaimable regions from the memory
+ * map entries. A copy of the ACPI RSDP (tags 14 and 15) is handed to
+ * acpi_set_rsdp().
  *
  * @param multiboot_info Pointer to the start of the Multiboot information structure.
  *                       The first 8 bytes (total_size and reserved) are skipped,
  *                       and parsing starts from the first tag.
  *
- * This function populates the global usable_memory_regions array and increments
- * usable_region_count for each available memory region found.
+ * This function populates the global memory_regions array, sorted by base
+ * address, with overlapping or adjacent entries of the same type merged
+ * into one region, whatever order the firmware listed them in.
  */
 void parse_memory_map(uint8_t* multiboot_info);
 
 /**
- * @brief Sets up basic paging for the system by initializing the page directory,
- * identity mapping the first 4MB of physical memory with writable pages,
- * loading the page directory base register (CR3), and enabling paging by
- * setting the PG bit in the CR0 control register.
+ * @brief Takes over the boot page directory as the kernel page directory.
+ *
+ * boot.asm enabled paging with the first BOOT_MAP_SIZE of physical memory
+ * mapped twice: at 0 (for the trampoline) and at KERNEL_VIRTUAL_BASE,
+ * where the kernel is linked. init_physical_allocator() has since extended
+ * the higher mapping into the direct map. This drops the identity mapping,
+ * so user space (page directory entries 0-767) starts out empty, and
+ * points the last directory entry at the directory itself, so page tables
+ * stay reachable at PAGE_TABLES_VADDR.
  *
- * This function assumes that the page_directory pointer is already
- * allocated and points to a zeroed 4KB-aligned page directory.
- * The identity mapping maps virtual addresses 0x00000000 to 0x003FFFFF
- * directly to the same physical addresses, which is typically required
- * during early kernel initialization.
+ * Kernel mappings carry PAGE_GLOBAL when the CPU supports it, so they
+ * survive address space switches without being flushed from the TLB.
+ *
+ * CR0.WP is set so read-only (copy-on-write) pages also fault on kernel
+ * writes, and the page fault handler is installed; init_idt() must have run.
  */
 void setup_paging();
 
@@ -101,23 +341,189 @@ void setup_paging();
  * This function ensures that the specified virtual address is mapped to the
  * given physical address within the provided page directory. If the corresponding
  * page table does not exist, it will be dynamically allocated and initialized.
+ * Replacing a live mapping in the active page directory invalidates its TLB entry.
+ * Page tables are edited through the recursive mapping once paging is enabled.
  *
- * @param pd     Pointer to the page directory.
+ * @param pd     Physical address of the page directory.
  * @param vaddr  Virtual address to map.
  * @param paddr  Physical address to map to.
  * @param flags  Page flags (e.g., PAGE_WRITABLE, PAGE_USER).
+ * @return 1 on success, 0 if a new page table could not be allocated.
  */
-void map_page_with_directory(uint32_t* pd, uint32_t vaddr, uint32_t paddr, uint32_t flags);
+int map_page_with_directory(uint32_t* pd, uint32_t vaddr, uint32_t paddr, uint32_t flags);
+
+/**
+ * @brief Maps a single 4MB page in a given page directory.
+ *
+ * Requires 4MB page support, which init_physical_allocator() enables when the kernel
+ * is built with PAGING_PSE (the default, `make PSE=0` to disable) and the
+ * CPU reports PSE. A page table previously installed at this entry is freed.
+ *
+ * @param pd     Pointer to the page directory.
+ * @param vaddr  Virtual address to map (4MB aligned).
+ * @param paddr  Physical address to map to (4MB aligned).
+ * @param flags  Page flags (e.g., PAGE_WRITABLE, PAGE_USER).
+ * @return 1 on success, 0 if 4MB pages are unavailable, an address is misaligned,
+ *         or vaddr falls in the page table window.
+ */
+int map_large_page(uint32_t* pd, uint32_t vaddr, uint32_t paddr, uint32_t flags);
+
+/**
+ * @brief Maps a physically contiguous range, using 4MB pages where possible.
+ *
+ * Every part of the range where both addresses are 4MB aligned and at least
+ * 4MB remain is mapped with one large page; the unaligned edges (or the
+ * whole range if 4MB pages are unavailable) use 4KB pages.
+ *
+ * @param pd     Pointer to the page directory.
+ * @param vaddr  Virtual start address (4KB aligned).
+ * @param paddr  Physical start address (4KB aligned).
+ * @param len    Length of the range in bytes (rounded up to whole pages).
+ * @param flags  Page flags (e.g., PAGE_WRITABLE, PAGE_USER).
+ * @return 1 on success, 0 if a page table could not be allocated.
+ */
+int map_large_range(uint32_t* pd, uint32_t vaddr, uint32_t paddr, uint32_t len, uint32_t flags);
+
+/**
+ * @brief Removes the mapping of a virtual address from a given page directory.
+ *
+ * The TLB entry for the address is invalidated. The page table itself is
+ * left in place, and the physical page is not freed.
+ *
+ * @param pd    Pointer to the page directory.
+ * @param vaddr Virtual address to unmap.
+ * @return Physical address the page was mapped to, or 0 if it was not mapped.
+ */
+uint32_t unmap_page_with_directory(uint32_t* pd, uint32_t vaddr);
+
+/**
+ * @brief Maps a physically contiguous range of 4KB pages.
+ *
+ * Each page table is looked up (or created) once per 1024 entries. Live
+ * mappings replaced in the active page directory are invalidated with
+ * INVLPG for ranges of up to TLB_FLUSH_THRESHOLD pages, and with a single
+ * full flush otherwise (which for kernel addresses also drops global
+ * entries), then once on the other CPUs with tlb_shootdown(). Kernel
+ * mappings are made global when the CPU supports it.
+ *
+ * @param pd     Pointer to the page directory.
+ * @param vaddr  Virtual start address (4KB aligned).
+ * @param paddr  Physical start address (4KB aligned).
+ * @param len    Length in bytes (rounded up to whole pages).
+ * @param flags  Page flags (e.g., PAGE_WRITABLE, PAGE_USER).
+ * @return 1 on success, 0 if a page table could not be allocated (pages before it stay mapped).
+ */
+int map_range(uint32_t* pd, uint32_t vaddr, uint32_t paddr, uint32_t len, uint32_t flags);
+
+/**
+ * @brief Unmaps a range of 4KB pages.
+ *
+ * User page tables (below entry 768) left empty are returned to free_page();
+ * kernel page tables are kept because other page directories share them.
+ * TLB entries are invalidated as in map_range(), on every CPU before
+ * any frame is freed.
+ *
+ * @param pd     Pointer to the page directory.
+ * @param vaddr  Virtual start address (4KB aligned).
+ * @param len    Length in bytes (rounded up to whole pages).
+ * @param flags  UNMAP_FREE_FRAMES to also free the physical pages that were mapped
+ *               (a copy-on-write shared page is only freed with its last mapping).
+ */
+void unmap_range(uint32_t* pd, uint32_t vaddr, uint32_t len, uint32_t flags);
+
+/**
+ * @brief Makes physical memory the page allocator does not own reachable (device registers, firmware tables).
+ *
+ * A range inside the direct map asked for with the default caching is
+ * simply returned through it. Anything else is mapped into the MMIO
+ * window with the given flags, for good: the window space is never
+ * given back, so this is meant for mappings that last as long as the
+ * kernel (each call takes new space, even for the same range).
+ *
+ * @param paddr Physical address.
+ * @param len   Bytes needed from paddr.
+ * @param flags PAGE_WRITABLE, PAGE_CACHE_DISABLE and PAGE_WRITE_THROUGH as the range needs.
+ * @return Virtual address of paddr, or NULL if the MMIO window is full or a page table could not be allocated.
+ */
+void* map_physical(uint32_t paddr, uint32_t len, uint32_t flags);
+
+/**
+ * @brief Creates a copy-on-write clone of a user address space.
+ *
+ * User page tables are copied; the user pages behind them are shared, with
+ * writable ones turned read-only and marked PAGE_COW in both directories.
+ * handle_cow_fault() copies a page on the first write to it.
+ *
+ * @param pd Physical address of the page directory to clone.
+ * @return Physical address of the new page directory, or NULL if memory ran out.
+ */
+uint32_t* clone_address_space(uint32_t* pd);
+
+/**
+ * @brief Frees a user address space: its user pages (as their last mapping
+ * goes), its user page tables and the directory itself.
+ *
+ * @param pd Physical address of the page directory. Must not be loaded in CR3.
+ */
+void destroy_address_space(uint32_t* pd);
+
+/**
+ * @brief Reserves a demand-zero range of virtual memory.
+ *
+ * No memory is allocated up front. The first read of a page maps the shared
+ * zero page read-only; the first write maps a freshly zeroed page.
+ *
+ * @param pd     Physical address of the page directory (page_directory for kernel space).
+ * @param vaddr  Start of the range (rounded down to a page).
+ * @param len    Length in bytes (rounded up to whole pages).
+ * @param flags  Flags the pages are mapped with (PAGE_WRITABLE, PAGE_USER).
+ * @return 1 on success, 0 if the range overlaps another one or no slot is free.
+ */
+int reserve_region(uint32_t* pd, uint32_t vaddr, uint32_t len, uint32_t flags);
+
+/**
+ * @brief Releases a range reserved with reserve_region(), freeing the pages it got.
+ *
+ * @param pd    Page directory passed to reserve_region().
+ * @param vaddr Start of the range.
+ */
+void release_region(uint32_t* pd, uint32_t vaddr);
+
+/**
+ * @brief Resolves a write fault on a copy-on-write page of the active address space.
+ *
+ * @param vaddr Faulting virtual address (CR2).
+ * @return 1 if the fault was a copy-on-write fault and has been resolved, 0 otherwise.
+ */
+int handle_cow_fault(uint32_t vaddr);
+
+/**
+ * @brief Moves the kernel heap break by `increment` bytes.
+ *
+ * Growing the heap only extends the heap's demand-zero range; pages are
+ * backed by the page fault handler when first touched. Shrinking it unmaps
+ * and frees the pages above the new break once at least HEAP_TRIM_THRESHOLD
+ * bytes of them are unused. Paging must already be enabled.
+ *
+ * @param increment Number of bytes to grow (positive) or shrink (negative) the heap by.
+ * @return The previous break, or NULL if the heap window is exhausted.
+ */
+void* ksbrk(int32_t increment);
 
 /**
  * @brief Allocates a block of memory from the kernel heap.
  *
- * This function implements a simple heap allocator using a free list of previously
- * freed blocks. It first attempts to find a suitable free block from the free list.
- * If none are large enough, it allocates a new block from the heap.
+ * Requests of up to SLAB_MAX_SIZE bytes are served from the power-of-two
+ * slab caches (see slab.h) once init_slab_allocator() has run.
  *
- * The memory returned is aligned to 8 bytes. Metadata (BlockHeader) is stored just
- * before the returned memory pointer.
+ * Larger requests use a simple heap allocator with an address-ordered
+ * free list of previously freed blocks. It first attempts to find a suitable
+ * free block from the free list (first fit by default, best fit when built
+ * with `make HEAP_FIT=best`), splitting off any usable remainder. If none are
+ * large enough, it grows the heap with ksbrk().
+ *
+ * The memory returned is aligned to 8 bytes. Heap blocks carry their metadata
+ * (BlockHeader) just before the returned memory pointer; slab objects have none.
  *
  * @param size Number of bytes to allocate.
  * @return Pointer to allocated memory, or NULL if out of memory.
@@ -127,13 +533,32 @@ void* kmalloc(uint32_t size);
 /**
  * @brief Frees a previously allocated block of memory.
  * 
- * Adds the block pointed to by ptr back to the free list for reuse in future allocations.
+ * Slab objects are returned to their cache. Heap blocks are inserted into
+ * the address-ordered free list and coalesced with adjacent free blocks.
+ * A free block that ends at the top of the heap is returned to the
+ * unallocated area.
  * The pointer must have been returned by a prior call to kmalloc().
- * 
- * This function does not merge adjacent free blocks (no coalescing).
  *
  * @param ptr Pointer to the memory block to free. If NULL, the function does nothing.
  */
 void kfree(void* ptr);
 
+/**
+ * @brief Returns the number of bytes actually reserved for a kmalloc() allocation.
+ *
+ * @param ptr Pointer returned by kmalloc().
+ * @return Heap block payload size or slab object size.
+ */
+uint32_t kmalloc_usable_size(void* ptr);
+
+/**
+ * @brief Fills in a snapshot of the allocator statistics.
+ *
+ * Counters and latency histograms are always on. The free page count and the
+ * heap free-list figures are computed at the time of the call.
+ *
+ * @param stats Structure to fill in.
+ */
+void get_memory_stats(memory_stats_t* stats);
+
 #endif // MEMORY_H
\ No newline at end of file
@@ -1,6 +1,14 @@
 #ifndef MULTIBOOT_H
 #define MULTIBOOT_H
 
+#define MULTIBOOT_TAG_CMDLINE 1 // Tag holding the boot command line as a null-terminated string after the header
+#define MULTIBOOT_TAG_ACPI_OLD 14 // Tag holding a copy of the ACPI 1.0 RSDP after the header
+#define MULTIBOOT_TAG_ACPI_NEW 15 // Tag holding a copy of the ACPI 2.0+ RSDP after the header
+#define MULTIBOOT_TAG_MMAP 6 // Tag holding the memory map (memory_map_entry records after a 16-byte header)
+
+#define MULTIBOOT_MEMORY_AVAILABLE 1        // Memory map type: RAM free for the OS
+#define MULTIBOOT_MEMORY_ACPI_RECLAIMABLE 3 // Memory map type: RAM holding ACPI tables, free once they have been read
+
 // Represents a generic tag in the Multiboot2 info structure
 typedef struct {
     uint32_t type;  // identifies the kind of tag (e.g., memory map = 6).
@@ -11,7 +19,7 @@ typedef struct {
 typedef struct {
     uint64_t addr;      // Start of region
     uint64_t len;       // Length of region
-    uint32_t type;      // 1 = available RAM, other = reserved
+    uint32_t type;      // MULTIBOOT_MEMORY_* (any other value is reserved)
     uint32_t reserved;  // Unused
 } memory_map_entry;
 
@@ -0,0 +1,97 @@
+#ifndef PERCPU_H
+#define PERCPU_H
+
+#include "stdint.h"
+#include "sched.h"
+
+#define MAX_CPUS 8                // Maximum number of CPUs with a per-CPU area
+#define PAGE_MAGAZINE_SIZE 32     // Free frames each CPU can cache
+#define PAGE_MAGAZINE_BATCH 16    // Frames moved between a CPU cache and the global allocator at once
+#define SLAB_MAGAZINE_SIZE 16     // Free objects each CPU can cache per slab cache
+#define SLAB_MAGAZINE_BATCH 8     // Objects moved between a CPU cache and the slabs at once
+
+// Selectors of the per-CPU GDT (code and data keep the values boot.asm and ap_boot.asm use)
+#define GDT_KERNEL_CODE 0x08 // Ring 0 code, flat
+#define GDT_KERNEL_DATA 0x10 // Ring 0 data, flat
+#define GDT_PERCPU      0x18 // Ring 0 data based at the CPU's cpu_local_t; loaded in GS for this_cpu_id()
+#define GDT_TSS         0x20 // The CPU's task state segment
+#define GDT_ENTRIES     5
+
+// Per-CPU stack of free physical frames in front of the global page allocator
+typedef struct {
+    uint32_t count;                        // Number of cached frames
+    void* frames[PAGE_MAGAZINE_SIZE];      // Physical addresses of the cached frames
+} page_magazine_t;
+
+// Per-CPU stack of free objects in front of a slab cache
+typedef struct {
+    uint32_t count;                        // Number of cached objects
+    void* objects[SLAB_MAGAZINE_SIZE];     // Cached objects
+} slab_magazine_t;
+
+// 32-bit task state segment; only the ring 0 stack is used (for a future switch from user mode)
+typedef struct {
+    uint32_t prev_tss;
+    uint32_t esp0;          // Stack loaded on an interrupt from ring 3
+    uint32_t ss0;           // Its segment (GDT_KERNEL_DATA)
+    uint32_t unused[22];    // ESP1 to LDT selector, never loaded (no hardware task switching)
+    uint16_t trap;
+    uint16_t iomap_base;    // Past the limit: no I/O permission bitmap
+} __attribute__((packed)) tss_t;
+
+// Data owned by a single CPU. Only that CPU touches it, so most of it needs
+// no lock; the run queue has its own, since other CPUs steal from it.
+typedef struct {
+    uint32_t id;                  // CPU index into cpu_locals (first: this_cpu_id() reads it at GS:0)
+    uint32_t apic_id;             // Local APIC id, the target of IPIs to this CPU
+    volatile uint32_t online;     // Set once the CPU runs its idle thread and takes work
+    uint32_t stack_top;           // Top of the stack the CPU booted on (its idle thread's on an AP)
+    page_magazine_t page_cache;   // Frames served by alloc_page()/free_page() on this CPU
+    run_queue_t run_queue;        // Tasks waiting for this CPU (sched.c)
+    struct task* current;         // Task running on this CPU (sched.h)
+    struct task* idle;            // This CPU's idle thread, run when no other task is runnable
+    struct task* prev;            // Task switched away from, released by finish_switch() on the new stack
+    uint32_t preempt_count;       // Nesting depth of preempt_disable()
+    volatile uint32_t need_resched; // Set when the running task should give up the CPU at the next chance
+    volatile uint32_t tlb_flush_req;  // TLB flushes asked for by other CPUs (tlb_shootdown())
+    volatile uint32_t tlb_flush_done; // Value of tlb_flush_req at the last flush carried out
+    volatile int sse_busy;        // An SSE block of string.c is running on this CPU
+    uint32_t kmap_irq_flags;      // Interrupt state kmap() saved for its kunmap() (memory.c)
+    uint64_t gdt[GDT_ENTRIES];    // This CPU's GDT (see the GDT_* selectors)
+    tss_t tss;
+} cpu_local_t;
+
+extern cpu_local_t cpu_locals[MAX_CPUS];
+
+/**
+ * @brief Loads the GDT, TSS and GS segment of per-CPU area `id` on the calling CPU.
+ *
+ * Must run on each CPU before anything uses this_cpu(): first thing in
+ * kernel_main() on the bootstrap CPU, and in ap_main() on the others.
+ *
+ * @param id        Index into cpu_locals.
+ * @param stack_top Top of the stack the CPU is running on.
+ */
+void cpu_init(uint32_t id, uint32_t stack_top);
+
+/**
+ * @brief Returns the index of the CPU executing this code.
+ *
+ * Reads the id at the start of the CPU's cpu_local_t through its GS
+ * segment (cpu_init()). A task that is preempted may resume on another
+ * CPU, so the result is only stable with interrupts or preemption off.
+ */
+static inline uint32_t this_cpu_id() {
+    uint32_t id;
+    asm volatile("movl %%gs:0, %0" : "=r"(id));
+    return id;
+}
+
+/**
+ * @brief Returns the per-CPU area of the CPU executing this code.
+ */
+static inline cpu_local_t* this_cpu() {
+    return &cpu_locals[this_cpu_id()];
+}
+
+#endif // PERCPU_H
@@ -0,0 +1,63 @@
+#ifndef PIC_H
+#define PIC_H
+
+#include "stdint.h"
+
+#define PIC1_COMMAND 0x20 // Master PIC command port
+#define PIC1_DATA    0x21 // Master PIC data (mask) port
+#define PIC2_COMMAND 0xA0 // Slave PIC command port
+#define PIC2_DATA    0xA1 // Slave PIC data (mask) port
+
+#define PIC_EOI      0x20 // End-of-interrupt command
+#define PIC_READ_ISR 0x0B // OCW3: read the in-service register
+
+#define IRQ_BASE     32   // Vector of IRQ 0 after remapping (just past the CPU exceptions)
+#define IRQ_COUNT    16   // IRQ lines of the two cascaded PICs
+#define IRQ_CASCADE  2    // Master line the slave PIC is wired to
+
+#define IRQ_TIMER    0    // PIT
+#define IRQ_KEYBOARD 1    // PS/2 keyboard
+#define IRQ_COM1     4    // First serial port
+
+/**
+ * @brief Remaps the two 8259 PICs to vectors IRQ_BASE..IRQ_BASE+15 and masks every line.
+ *
+ * By default the master PIC raises vectors 8-15, which collide with CPU
+ * exceptions. Lines are unmasked one by one with pic_unmask() once their
+ * handler is installed.
+ */
+void pic_remap();
+
+/**
+ * @brief Enables delivery of an IRQ line.
+ *
+ * @param irq IRQ number (0-15).
+ */
+void pic_unmask(uint8_t irq);
+
+/**
+ * @brief Disables delivery of an IRQ line.
+ *
+ * @param irq IRQ number (0-15).
+ */
+void pic_mask(uint8_t irq);
+
+/**
+ * @brief Acknowledges an IRQ so the PIC can deliver the next one.
+ *
+ * @param irq IRQ number (0-15).
+ */
+void pic_send_eoi(uint8_t irq);
+
+/**
+ * @brief Returns whether an IRQ 7 or 15 is spurious (not actually in service).
+ *
+ * A spurious IRQ must not be acknowledged on its own PIC; a spurious IRQ 15
+ * still needs an EOI on the master, since the cascade line was raised.
+ *
+ * @param irq IRQ number (0-15).
+ * @return 1 if the interrupt is spurious, 0 otherwise.
+ */
+int pic_is_spurious(uint8_t irq);
+
+#endif // PIC_H
@@ -0,0 +1,117 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "stdint.h"
+#include "spinlock.h"
+
+#define POOL_DEFAULT_PAGES  1 // Pages per pool chunk when pool_init() is given 0
+#define ARENA_DEFAULT_PAGES 1 // Pages per arena block when the arena was zero-initialized or given 0
+
+typedef struct pool_chunk pool_chunk_t;
+typedef struct arena_block arena_block_t;
+
+// Pool of equally sized objects, carved out of chunks of contiguous pages from alloc_pages()
+typedef struct {
+    uint32_t object_size;   // Size of each object, rounded up to the alignment
+    uint32_t chunk_pages;   // Pages in each chunk
+    uint32_t first_offset;  // Offset of the first object from the start of a chunk
+    void* free_list;        // Freed objects, linked through their first word
+    uint8_t* fresh;         // Next never-used object in the newest chunk
+    uint8_t* fresh_end;     // End of the newest chunk's objects
+    pool_chunk_t* chunks;   // Every chunk, newest first
+    uint32_t in_use;        // Objects currently allocated
+    uint32_t capacity;      // Objects the chunks hold in total
+    spinlock_t lock;        // Pools may be shared between CPUs and with interrupt handlers
+} pool_t;
+
+// Bump allocator for short-lived memory that is all freed at once by arena_reset()
+typedef struct {
+    arena_block_t* blocks;  // Every block, newest (the one allocated from) first
+    uint8_t* next;          // Next free byte in the newest block
+    uint8_t* end;           // End of the newest block
+    uint32_t block_pages;   // Pages in each block (0 for ARENA_DEFAULT_PAGES)
+} arena_t;
+
+/**
+ * @brief Sets up an empty pool of fixed-size objects.
+ *
+ * No memory is taken until the first pool_alloc(). Objects carry no
+ * header; a free object holds the free-list link in its first word.
+ *
+ * @param pool        Pool to set up.
+ * @param size        Object size in bytes.
+ * @param align       Object alignment in bytes (a power of two; 0 for 8 bytes).
+ * @param chunk_pages Pages taken from alloc_pages() each time the pool grows (0 for POOL_DEFAULT_PAGES).
+ * @return 1 on success, 0 if the alignment is not a power of two or no object fits in a chunk.
+ */
+int pool_init(pool_t* pool, uint32_t size, uint32_t align, uint32_t chunk_pages);
+
+/**
+ * @brief Allocates one object from a pool in O(1).
+ *
+ * Takes the most recently freed object, else the next unused object of
+ * the newest chunk, else a new chunk.
+ *
+ * @param pool Pool to allocate from.
+ * @return Pointer to the object, or NULL if a new chunk could not be allocated.
+ */
+void* pool_alloc(pool_t* pool);
+
+/**
+ * @brief Returns an object to its pool in O(1).
+ *
+ * @param pool Pool the object was allocated from.
+ * @param obj  Object to free (NULL does nothing).
+ */
+void pool_free(pool_t* pool, void* obj);
+
+/**
+ * @brief Frees every chunk of a pool, and with them every object still allocated.
+ *
+ * The pool stays set up and can be allocated from again.
+ *
+ * @param pool Pool to empty.
+ */
+void pool_destroy(pool_t* pool);
+
+/**
+ * @brief Sets up an empty arena.
+ *
+ * A zero-initialized arena_t is also ready to use, with ARENA_DEFAULT_PAGES blocks.
+ *
+ * @param arena       Arena to set up.
+ * @param block_pages Pages taken from alloc_pages() each time the arena grows (0 for ARENA_DEFAULT_PAGES).
+ */
+void arena_init(arena_t* arena, uint32_t block_pages);
+
+/**
+ * @brief Allocates `size` bytes from an arena in O(1), aligned to 8 bytes.
+ *
+ * The memory stays valid until the next arena_reset() or arena_destroy();
+ * it cannot be freed on its own. A request larger than a block gets a
+ * block of its own.
+ *
+ * @param arena Arena to allocate from.
+ * @param size  Number of bytes.
+ * @return Pointer to the memory, or NULL if a new block could not be allocated.
+ */
+void* arena_alloc(arena_t* arena, uint32_t size);
+
+/**
+ * @brief Frees everything allocated from an arena at once.
+ *
+ * One block is kept for the next round of allocations; any others are
+ * given back with free_pages().
+ *
+ * @param arena Arena to reset.
+ */
+void arena_reset(arena_t* arena);
+
+/**
+ * @brief Frees every block of an arena.
+ *
+ * @param arena Arena to free; it can be allocated from again afterwards.
+ */
+void arena_destroy(arena_t* arena);
+
+#endif // POOL_H
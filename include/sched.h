@@ -0,0 +1,239 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include "stdint.h"
+#include "spinlock.h"
+
+#define SCHED_PRIORITIES   8  // Priority levels, each with its own run queue; 0 is the highest
+#define SCHED_PRIO_DEFAULT 3  // Priority of the boot task (the shell) and of ordinary kernel threads
+#define SCHED_PRIO_IDLE    (SCHED_PRIORITIES - 1) // Idle thread only; it never waits on a run queue
+#define SCHED_TIME_SLICE   5  // Timer ticks a task runs before others of its priority get the CPU
+#define TASK_STACK_PAGES   4  // Kernel stack of each thread (16 KiB, as boot.asm gives the boot task)
+#define TASK_NAME_LEN      16 // Bytes of a task name, including the terminator
+#define MAX_TASK_INFO      32 // Tasks the "ps" command lists
+
+// Task states
+#define TASK_RUNNABLE 0 // Running, or waiting on a run queue for the CPU
+#define TASK_BLOCKED  1 // Waiting on a wait queue
+#define TASK_SLEEPING 2 // Waiting for a timer tick
+#define TASK_DEAD     3 // Exited; its stack is freed by the next task to run on its CPU
+
+typedef void (*task_entry_t)(void* arg);
+
+typedef struct task task_t;
+
+// Kernel thread
+struct task {
+    uint32_t esp;             // Saved stack pointer while switched out (first: switch.asm stores it here)
+    uint32_t id;              // Task number, in creation order (the boot task is 0)
+    uint32_t state;           // TASK_* state
+    uint32_t priority;        // Run queue (0 to SCHED_PRIO_IDLE)
+    uint32_t slice;           // Ticks left of the current time slice
+    uint32_t wake_tick;       // TASK_SLEEPING: timer_ticks() value to wake at
+    uint32_t ticks;           // Timer ticks that found this task running
+    uint32_t switches;        // Times the task was switched to
+    uint32_t cpu;             // CPU it last ran on, whose run queue it goes back to
+    volatile uint32_t on_cpu; // Set from the switch to the task until its stack is saved again; nobody else may run it meanwhile
+    uint32_t on_rq;           // Queued on cpu's run queue (changed under that queue's lock)
+    uint8_t* stack;           // Lowest address of the kernel stack (NULL for the boot task and the APs' idle threads, which keep their boot stacks)
+    task_entry_t entry;       // Function the thread runs, and its argument
+    void* arg;
+    task_t* next;             // Next task on the same run queue, wait queue or sleep list
+    task_t* prev;             // Previous task on the same run queue
+    task_t* all_next;         // Next task in creation order
+    char name[TASK_NAME_LEN];
+};
+
+// Tasks waiting for an event, woken in the order they started waiting. A zero-initialized queue is empty.
+typedef struct {
+    spinlock_t lock;          // Held while the condition is checked and by wait_queue_wake()
+    task_t* head;
+    task_t* tail;
+} wait_queue_t;
+
+// Runnable tasks of one CPU: a deque per priority. The owning CPU takes the
+// oldest task from the head (round robin); an idle CPU steals the newest
+// from the tail, which is the one least likely to still be cache-warm here.
+typedef struct {
+    spinlock_t lock;
+    task_t* heads[SCHED_PRIORITIES];
+    task_t* tails[SCHED_PRIORITIES];
+    uint32_t bitmap;          // Bit p is set while heads[p] is not empty
+    uint32_t count;           // Tasks queued
+} run_queue_t;
+
+// Snapshot of one task for the "ps" command
+typedef struct {
+    uint32_t id;
+    uint32_t state;
+    uint32_t priority;
+    uint32_t ticks;
+    uint32_t switches;
+    uint32_t cpu;
+    char name[TASK_NAME_LEN];
+} task_info_t;
+
+/**
+ * @brief Starts scheduling: the code calling this becomes the boot task, and the idle thread is created.
+ *
+ * Nothing is preempted until the timer runs (init_timer()). The idle
+ * thread runs the idle tasks registered with register_idle_task() and
+ * halts when none has work left. Each CPU has its own run queues; the
+ * APs join with sched_start_cpu(). pic_remap(), init_idt() and
+ * init_physical_allocator() must have run.
+ *
+ * @return 1 on success, 0 if the idle thread could not be created.
+ */
+int init_scheduler();
+
+/**
+ * @brief Turns the calling AP's boot context into its idle thread and starts taking work.
+ *
+ * Called by ap_main() once the CPU's GDT, IDT and local APIC are set up.
+ * The CPU is marked online and runs tasks from its own run queue, or
+ * stolen from the others, from then on.
+ */
+void sched_start_cpu() __attribute__((noreturn));
+
+/**
+ * @brief Returns whether init_scheduler() has run, so blocking waits can sleep instead of halting.
+ */
+int sched_running();
+
+/**
+ * @brief Returns the task running on this CPU.
+ */
+task_t* current_task();
+
+/**
+ * @brief Creates a kernel thread and puts it on its run queue.
+ *
+ * The thread starts with interrupts enabled in `entry(arg)`, and exits
+ * when entry returns or calls task_exit(). It is queued on the calling
+ * CPU; an idle CPU is poked so it can steal it.
+ *
+ * @param name     Name shown by "ps" (truncated to TASK_NAME_LEN - 1 characters).
+ * @param entry    Function the thread runs.
+ * @param arg      Argument passed to entry.
+ * @param priority Priority (0 highest, up to SCHED_PRIO_IDLE - 1).
+ * @return The new task, or NULL if its task structure or stack could not be allocated.
+ */
+task_t* task_create(const char* name, task_entry_t entry, void* arg, uint32_t priority);
+
+/**
+ * @brief Ends the calling thread; its stack is freed once another task runs.
+ *
+ * Must not be called by the boot task.
+ */
+void task_exit() __attribute__((noreturn));
+
+/**
+ * @brief Gives the CPU to the next runnable task of the same or higher priority, if any.
+ */
+void sched_yield();
+
+/**
+ * @brief Blocks the calling task for `ticks` timer ticks (at least).
+ *
+ * @param ticks Ticks to sleep (0 just yields).
+ */
+void sched_sleep(uint32_t ticks);
+
+/**
+ * @brief Takes a wait queue's lock, so the condition waited for can be checked without missing a wake-up.
+ *
+ * @param queue Queue about to be waited on.
+ * @return EFLAGS for wait_queue_unlock(); interrupts are disabled until then.
+ */
+uint32_t wait_queue_lock(wait_queue_t* queue);
+
+/**
+ * @brief Releases a wait queue's lock taken with wait_queue_lock().
+ *
+ * @param queue Queue waited on.
+ * @param flags Value returned by wait_queue_lock().
+ */
+void wait_queue_unlock(wait_queue_t* queue, uint32_t flags);
+
+/**
+ * @brief Blocks the calling task on a wait queue until wait_queue_wake().
+ *
+ * Must be called with the queue locked by wait_queue_lock(), after
+ * checking the condition waited for, so a wake-up from another CPU
+ * cannot be missed in between. The lock is dropped while the task sleeps
+ * and held again when this returns. Callers loop until the condition
+ * holds:
+ *
+ *     uint32_t flags = wait_queue_lock(&queue);
+ *     while (!condition) wait_queue_sleep(&queue);
+ *     wait_queue_unlock(&queue, flags);
+ *
+ * @param queue Queue to wait on.
+ */
+void wait_queue_sleep(wait_queue_t* queue);
+
+/**
+ * @brief Makes every task waiting on a queue runnable.
+ *
+ * Safe in interrupt handlers. The condition must be made true before the
+ * call. A woken task goes back to the run queue of the CPU it slept on,
+ * and preempts the task running there if its priority is higher.
+ *
+ * @param queue Queue to wake.
+ */
+void wait_queue_wake(wait_queue_t* queue);
+
+/**
+ * @brief Keeps the running task on the CPU until the matching preempt_enable().
+ *
+ * Interrupts still run. Calls nest. The task must not sleep meanwhile.
+ */
+void preempt_disable();
+
+/**
+ * @brief Ends a preempt_disable() section, switching tasks if a switch was deferred.
+ */
+void preempt_enable();
+
+/**
+ * @brief Accounts a timer tick: wakes sleepers whose time has come and ends expired time slices.
+ *
+ * Called by the timer interrupt handler of each CPU (the PIT on the
+ * bootstrap CPU, the local APIC timer on the others).
+ */
+void sched_tick();
+
+/**
+ * @brief Switches tasks on the way out of an interrupt if one became due.
+ *
+ * Called by isr_dispatch() after a hardware interrupt has been acknowledged,
+ * so a task that never returns through the interrupt (a new thread)
+ * cannot leave the PIC waiting for an EOI.
+ */
+void sched_irq_exit();
+
+/**
+ * @brief Fills `out` with a snapshot of the tasks, oldest first (the "ps" command).
+ *
+ * @param out Array to fill.
+ * @param max Entries in out.
+ * @return Number of entries filled.
+ */
+uint32_t sched_get_tasks(task_info_t* out, uint32_t max);
+
+/**
+ * @brief Returns the number of context switches since init_scheduler().
+ */
+uint32_t sched_switch_count();
+
+/**
+ * @brief Saves the callee-saved registers and stack pointer in `*save_esp`, then resumes the task whose stack is `load_esp`.
+ *
+ * Implemented in switch.asm. Returns once the saved task is switched back to.
+ *
+ * @param save_esp Where to store the current stack pointer.
+ * @param load_esp Stack pointer saved by an earlier context_switch() (or prepared by task_create()).
+ */
+void context_switch(uint32_t* save_esp, uint32_t load_esp);
+
+#endif // SCHED_H
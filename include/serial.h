@@ -0,0 +1,75 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include "stdint.h"
+
+#define COM1_PORT 0x3F8              // I/O base of the first serial port
+#define SERIAL_CLOCK 115200          // UART input clock divided by 16: the highest baud rate
+#define SERIAL_FIFO_SIZE 16          // Transmit FIFO depth of a 16550A
+#define SERIAL_TX_BUFFER_SIZE 4096   // Bytes queued for transmission (power of two)
+
+// Baud rate used by kernel_main(); override with make SERIAL_BAUD=...
+#ifndef SERIAL_BAUD
+#define SERIAL_BAUD 115200
+#endif
+
+// 16550 register offsets from the port base
+#define UART_DATA 0  // Receive/transmit buffer (divisor low byte when DLAB is set)
+#define UART_IER  1  // Interrupt enable (divisor high byte when DLAB is set)
+#define UART_IIR  2  // Interrupt identification (read)
+#define UART_FCR  2  // FIFO control (write)
+#define UART_LCR  3  // Line control
+#define UART_MCR  4  // Modem control
+#define UART_LSR  5  // Line status
+
+#define UART_IER_RDA  0x01  // Interrupt when received data is available
+#define UART_IER_THRE 0x02  // Interrupt when the transmit holding register is empty
+#define UART_LCR_DLAB 0x80  // Divisor latch access
+#define UART_LCR_8N1  0x03  // 8 data bits, no parity, 1 stop bit
+#define UART_FCR_INIT 0xC7  // Enable and clear both FIFOs, receive trigger at 14 bytes
+#define UART_MCR_OUT2 0x08  // Gates the UART interrupt line to the PIC
+#define UART_MCR_INIT 0x0B  // DTR, RTS and OUT2
+#define UART_MCR_LOOP 0x1E  // Loopback mode with RTS, OUT1 and OUT2 (self test)
+#define UART_LSR_DR   0x01  // A received byte is waiting
+#define UART_LSR_THRE 0x20  // Transmit holding register (and FIFO) empty
+
+/**
+ * @brief Initializes COM1: baud rate, 8N1 framing and the FIFOs.
+ *
+ * The port is tested in loopback mode first; if nothing answers, every
+ * serial call becomes a no-op. The interrupt handler is installed and
+ * IRQ 4 unmasked, so pic_remap() and init_idt() must have run. Received
+ * bytes are queued as console input, like keystrokes.
+ *
+ * @param baud Baud rate (SERIAL_CLOCK divided by a whole number, e.g. 115200, 38400, 9600).
+ * @return 1 if a UART was found, 0 otherwise.
+ */
+int init_serial(uint32_t baud);
+
+/**
+ * @brief Queues a byte for transmission.
+ *
+ * Bytes are sent from a ring buffer by the transmit interrupt, one FIFO
+ * load at a time. Only when the ring is full does the caller wait for the
+ * UART, and then for a whole FIFO load rather than for every byte.
+ *
+ * @param c Byte to send.
+ */
+void serial_putc(char c);
+
+/**
+ * @brief Queues a null-terminated string for transmission, turning "\n" into "\r\n".
+ *
+ * The whole string is queued under one hold of the transmit lock, so
+ * strings printed by different CPUs do not interleave on the line.
+ *
+ * @param s String to send.
+ */
+void serial_print(const char* s);
+
+/**
+ * @brief Waits until every queued byte has been handed to the UART.
+ */
+void serial_flush();
+
+#endif // SERIAL_H
@@ -0,0 +1,98 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include "stdint.h"
+#include "percpu.h"
+#include "spinlock.h"
+
+#define SLAB_MIN_SIZE 8           // Smallest kmalloc size class in bytes
+#define SLAB_MIN_SHIFT 3          // log2(SLAB_MIN_SIZE)
+#define SLAB_MAX_SIZE 1024        // Largest kmalloc size class in bytes; bigger requests use the heap (2048 would fit once per slab page)
+#define KMALLOC_CACHE_COUNT 8     // Number of power-of-two size classes from SLAB_MIN_SIZE to SLAB_MAX_SIZE
+#define SLAB_CACHE_LINE 64        // Objects are aligned to their size up to one cache line
+
+typedef struct Slab Slab;
+
+// Cache of equally sized objects carved out of single-page slabs.
+typedef struct kmem_cache {
+    uint32_t object_size;       // Size of each object, rounded up to the cache alignment
+    uint32_t objects_per_slab;  // Number of objects that fit in one slab page
+    uint32_t first_offset;      // Offset of the first object from the start of the slab page
+    Slab* partial;              // Slabs with at least one free object (allocations come from the head)
+    Slab* empty;                // One completely free slab kept back to avoid page churn
+    spinlock_t lock;            // Guards partial, empty and the slabs' free lists, which every CPU refills from
+    slab_magazine_t magazines[MAX_CPUS]; // Per-CPU stacks of free objects in front of the slabs
+} kmem_cache_t;
+
+/**
+ * @brief Sets up the static kmalloc size-class caches (8 to 1024 bytes).
+ *
+ * Until this is called, kmalloc() serves every request from the heap.
+ */
+void init_slab_allocator();
+
+/**
+ * @brief Creates a cache for objects of a fixed size.
+ *
+ * Each slab is one page from alloc_page() with a small slab header at the
+ * start; objects carry no per-object header.
+ *
+ * @param size  Object size in bytes.
+ * @param align Object alignment in bytes (a power of two; 0 for 8 bytes).
+ * @return Pointer to the new cache, or NULL if the object does not fit in a page
+ *         or the descriptor could not be allocated.
+ */
+kmem_cache_t* kmem_cache_create(uint32_t size, uint32_t align);
+
+/**
+ * @brief Allocates one object from a cache in O(1).
+ *
+ * Served from the calling CPU's magazine, which is refilled with
+ * SLAB_MAGAZINE_BATCH objects from the slabs when it runs empty.
+ *
+ * @param cache Cache to allocate from.
+ * @return Pointer to the object, or NULL if no page could be allocated for a new slab.
+ */
+void* kmem_cache_alloc(kmem_cache_t* cache);
+
+/**
+ * @brief Returns an object to its cache in O(1).
+ *
+ * The object goes onto the calling CPU's magazine; a full magazine first
+ * returns SLAB_MAGAZINE_BATCH objects to their slabs. A slab that becomes
+ * completely free is kept as the cache's spare slab, or given back with
+ * free_page() if the cache already has one.
+ *
+ * @param cache Cache the object was allocated from.
+ * @param obj   Object to free.
+ */
+void kmem_cache_free(kmem_cache_t* cache, void* obj);
+
+/**
+ * @brief Returns the kmalloc size-class cache serving `size` bytes.
+ *
+ * @param size Requested allocation size.
+ * @return The cache, or NULL if the size is above SLAB_MAX_SIZE or the
+ *         caches are not initialized yet.
+ */
+kmem_cache_t* kmalloc_cache_for(uint32_t size);
+
+/**
+ * @brief Frees an object allocated from any slab cache.
+ *
+ * The owning cache is found from the slab header at the start of the
+ * object's page; used by kfree() for small allocations.
+ *
+ * @param obj Object to free.
+ */
+void slab_free(void* obj);
+
+/**
+ * @brief Returns the object size of the cache an object belongs to.
+ *
+ * @param obj Object allocated from any slab cache.
+ * @return Size of the object in bytes.
+ */
+uint32_t slab_object_size(void* obj);
+
+#endif // SLAB_H
@@ -0,0 +1,64 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include "stdint.h"
+
+#define AP_TRAMPOLINE_ADDR    0x8000 // Physical page the AP startup code (ap_boot.asm) is copied to: below 1 MiB, SIPI vector 0x08
+#define AP_INIT_DELAY_MS      10     // Wait between the INIT IPI and the first STARTUP IPI
+#define AP_SIPI_DELAY_US      200    // Wait after each STARTUP IPI before checking on the AP
+#define AP_STARTUP_TIMEOUT_MS 100    // Time an AP gets to come online before it is given up on
+
+// Values ap_boot.asm loads before jumping to ap_main(); smp.c fills them in for each AP
+typedef struct {
+    uint32_t cr0;   // Control registers of the bootstrap CPU (paging, write protect, FPU/SSE bits)
+    uint32_t cr3;
+    uint32_t cr4;
+    uint32_t stack; // Top of the AP's boot stack, which becomes its idle thread's
+    uint32_t entry; // ap_main()
+    uint32_t cpu;   // Index of the AP's per-CPU area
+} ap_boot_params_t;
+
+/**
+ * @brief Starts the application processors listed in the ACPI MADT.
+ *
+ * Each AP gets a per-CPU area (GDT, TSS, magazines, run queue), a boot
+ * stack that becomes its idle thread, and a local APIC timer ticking at
+ * TIMER_HZ, then takes work from the run queues of the others. Without
+ * a MADT or a local APIC the system keeps running on the bootstrap CPU
+ * alone. init_scheduler() and init_timer() must have run, and interrupts
+ * must be enabled (the startup delays and the APIC timer calibration use
+ * the PIT).
+ *
+ * @return Number of CPUs online, the bootstrap CPU included.
+ */
+uint32_t init_smp();
+
+/**
+ * @brief Returns the number of CPUs online.
+ */
+uint32_t smp_cpu_count();
+
+/**
+ * @brief Sends a reschedule interrupt, so a CPU looks at its run queue (and those of others) now.
+ *
+ * @param cpu Index of the CPU to interrupt.
+ */
+void smp_send_reschedule(uint32_t cpu);
+
+/**
+ * @brief Flushes the TLB of every other online CPU and waits until they have.
+ *
+ * Called after kernel mappings were removed or changed, before the frames
+ * behind them are reused. Waits with interrupts disabled; the other CPUs
+ * answer from the IPI handler, or from smp_poll() while they spin for a lock.
+ */
+void tlb_shootdown();
+
+/**
+ * @brief Carries out a TLB flush another CPU asked this one for, if any.
+ *
+ * Called by the TLB shootdown IPI handler and by spin_lock() while it waits.
+ */
+void smp_poll();
+
+#endif // SMP_H
@@ -0,0 +1,77 @@
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include "stdint.h"
+#include "cpu.h"
+#include "smp.h"
+
+// Ticket lock: CPUs get the lock in the order they asked for it. A zero-initialized lock is unlocked.
+typedef struct {
+    volatile uint16_t next;  // Ticket handed to the next CPU that asks
+    volatile uint16_t owner; // Ticket of the CPU holding the lock
+} spinlock_t;
+
+/**
+ * @brief Takes a lock, spinning until every CPU that asked earlier has released it.
+ *
+ * Interrupts are left alone; use spin_lock_irqsave() for data interrupt
+ * handlers touch as well. A waiting CPU keeps answering TLB shootdowns
+ * (smp_poll()), so spinning with interrupts off cannot hold up a CPU that
+ * is changing kernel mappings while it holds the lock.
+ *
+ * @param lock Lock to take.
+ */
+static inline void spin_lock(spinlock_t* lock) {
+    uint16_t ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+    while (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket) {
+        asm volatile("pause");
+        smp_poll();
+    }
+}
+
+/**
+ * @brief Takes a lock only if no CPU holds or waits for it.
+ *
+ * @param lock Lock to take.
+ * @return 1 if the lock was taken, 0 otherwise.
+ */
+static inline int spin_trylock(spinlock_t* lock) {
+    uint16_t owner = __atomic_load_n(&lock->owner, __ATOMIC_RELAXED);
+    uint16_t free_ticket = owner;
+    return __atomic_compare_exchange_n(&lock->next, &free_ticket, (uint16_t)(owner + 1), 0,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Releases a lock, serving the next waiting CPU.
+ *
+ * @param lock Lock taken with spin_lock() or spin_trylock().
+ */
+static inline void spin_unlock(spinlock_t* lock) {
+    __atomic_store_n(&lock->owner, (uint16_t)(lock->owner + 1), __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Disables interrupts on this CPU, then takes a lock.
+ *
+ * @param lock Lock to take.
+ * @return EFLAGS before interrupts were disabled; pass it to spin_unlock_irqrestore().
+ */
+static inline uint32_t spin_lock_irqsave(spinlock_t* lock) {
+    uint32_t flags = irq_save();
+    spin_lock(lock);
+    return flags;
+}
+
+/**
+ * @brief Releases a lock, then re-enables interrupts if spin_lock_irqsave() found them enabled.
+ *
+ * @param lock  Lock to release.
+ * @param flags Value returned by the matching spin_lock_irqsave().
+ */
+static inline void spin_unlock_irqrestore(spinlock_t* lock, uint32_t flags) {
+    spin_unlock(lock);
+    irq_restore(flags);
+}
+
+#endif // SPINLOCK_H
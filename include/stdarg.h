@@ -0,0 +1,12 @@
+#ifndef STDARG_H
+#define STDARG_H
+
+// Variable argument lists, using the compiler's built-in support (no libc is available)
+typedef __builtin_va_list va_list;
+
+#define va_start(ap, last) __builtin_va_start(ap, last)
+#define va_arg(ap, type)   __builtin_va_arg(ap, type)
+#define va_end(ap)         __builtin_va_end(ap)
+#define va_copy(dst, src)  __builtin_va_copy(dst, src)
+
+#endif // STDARG_H
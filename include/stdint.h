@@ -7,4 +7,9 @@ typedef unsigned short uint16_t;        // 16-bit unsigned integer
 typedef unsigned int uint32_t;          // 32-bit unsigned integer
 typedef unsigned long long uint64_t;    // 64-bit unsigned integer
 
+typedef signed char  int8_t;            // 8-bit signed integer
+typedef short int16_t;                  // 16-bit signed integer
+typedef int int32_t;                    // 32-bit signed integer
+typedef long long int64_t;              // 64-bit signed integer
+
 #endif // STDINT_H
\ No newline at end of file
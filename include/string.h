@@ -0,0 +1,74 @@
+#ifndef STRING_H
+#define STRING_H
+
+#include "stdint.h"
+
+#define STRING_SSE_MIN 512 // Smallest memset/memcpy/memmove size that takes the SSE2 path once init_string_sse() enabled it
+
+/**
+ * @brief Enables SSE (CR4.OSFXSR) and the SSE2 bulk paths of memset/memcpy/memmove.
+ *
+ * Only has an effect when built with STRING_SSE (`make STRING_SSE=1`) on
+ * a CPU with SSE2; otherwise the rep-string paths stay in use. The XMM
+ * registers are only used with interrupts disabled and never across a
+ * call, so no XMM state needs to be saved on interrupts or task switches.
+ *
+ * @return 1 if the SSE2 paths are in use, 0 otherwise.
+ */
+int init_string_sse();
+
+/**
+ * @brief Fills `n` bytes at `dst` with the byte `value`.
+ *
+ * @return `dst`.
+ */
+void* memset(void* dst, int value, uint32_t n);
+
+/**
+ * @brief Fills `count` 16-bit cells at `dst` with `value` (e.g. VGA character/attribute pairs).
+ *
+ * @return `dst`.
+ */
+void* memset16(void* dst, uint16_t value, uint32_t count);
+
+/**
+ * @brief Copies `n` bytes from `src` to `dst`. The buffers must not overlap.
+ *
+ * @return `dst`.
+ */
+void* memcpy(void* dst, const void* src, uint32_t n);
+
+/**
+ * @brief Copies `n` bytes from `src` to `dst`; the buffers may overlap.
+ *
+ * @return `dst`.
+ */
+void* memmove(void* dst, const void* src, uint32_t n);
+
+/**
+ * @brief Compares `n` bytes of two buffers.
+ *
+ * @return Negative, zero or positive as `a` sorts before, equal to or after `b` (bytes compared unsigned).
+ */
+int memcmp(const void* a, const void* b, uint32_t n);
+
+/**
+ * @brief Returns the length of a null-terminated string.
+ */
+uint32_t strlen(const char* s);
+
+/**
+ * @brief Compares two null-terminated strings in byte order.
+ *
+ * @return Negative, zero or positive as `a` sorts before, equal to or after `b`.
+ */
+int strcmp(const char* a, const char* b);
+
+/**
+ * @brief Compares at most `n` characters of two null-terminated strings.
+ *
+ * @return Negative, zero or positive as `a` sorts before, equal to or after `b`.
+ */
+int strncmp(const char* a, const char* b, uint32_t n);
+
+#endif // STRING_H
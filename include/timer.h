@@ -0,0 +1,33 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "stdint.h"
+
+#define PIT_CHANNEL0  0x40     // PIT channel 0 data port (wired to IRQ 0)
+#define PIT_COMMAND   0x43     // PIT mode/command port
+#define PIT_FREQUENCY 1193182  // PIT input clock in Hz
+#define PIT_MODE_RATE 0x34     // Channel 0, low then high byte, mode 2 (rate generator)
+
+#define TIMER_HZ 100           // Timer interrupts per second (one scheduler tick each)
+
+/**
+ * @brief Programs PIT channel 0 to interrupt `hz` times per second and unmasks IRQ 0.
+ *
+ * Each interrupt advances the tick count and calls sched_tick().
+ * pic_remap() and init_idt() must have run.
+ *
+ * @param hz Interrupt rate (19 to PIT_FREQUENCY).
+ */
+void init_timer(uint32_t hz);
+
+/**
+ * @brief Returns the number of timer interrupts since init_timer().
+ */
+uint32_t timer_ticks();
+
+/**
+ * @brief Converts milliseconds to timer ticks, rounding up.
+ */
+uint32_t ms_to_ticks(uint32_t ms);
+
+#endif // TIMER_H
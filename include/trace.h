@@ -0,0 +1,79 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "stdint.h"
+
+#define TRACE_RING_ENTRIES 2048 // Events kept; the oldest are overwritten (power of two)
+
+// Binary dump format ("trace send"), all little-endian: a 12-byte header (u32 TRACE_MAGIC,
+// u16 TRACE_VERSION, u16 TRACE_RECORD_SIZE, u32 count), then `count` records oldest first,
+// each laid out as trace_event_t. Decoded by tools/trace_decode.py.
+#define TRACE_MAGIC       0x43525447 // "GTRC"
+#define TRACE_VERSION     1
+#define TRACE_RECORD_SIZE 20
+
+// Event ids, with what their two arguments hold. tools/trace_decode.py reads the names from here.
+#define TRACE_ALLOC_PAGE   1  // alloc_page(): a = page, b = caller
+#define TRACE_FREE_PAGE    2  // free_page(): a = page, b = caller
+#define TRACE_KMALLOC      3  // kmalloc(): a = size, b = pointer returned
+#define TRACE_KFREE        4  // kfree(): a = pointer, b = caller
+#define TRACE_HEAP_WALK    5  // Heap free-list search: a = size asked, b = blocks walked
+#define TRACE_MAP_PAGE     6  // map_page_with_directory(): a = vaddr, b = paddr
+#define TRACE_PAGE_TABLE   7  // New page table: a = page directory index, b = frame
+#define TRACE_PAGE_FAULT   8  // Page fault: a = address, b = error code
+#define TRACE_SCROLL       9  // Console scrolled: a = lines kept in the scrollback, b = 0
+#define TRACE_FLUSH_BEGIN  10 // console_flush() starts: a = 0, b = 0
+#define TRACE_FLUSH_END    11 // console_flush() is done: a = cells written to VGA memory, b = 0
+#define TRACE_TASK_SWITCH  12 // Context switch: a = id of the task switched from, b = id of the task switched to
+
+typedef struct {
+    uint64_t tsc;    // rdtsc when the event was recorded
+    uint16_t event;  // TRACE_* id
+    uint16_t reserved;
+    uint32_t a;      // Event arguments
+    uint32_t b;
+} trace_event_t;
+
+/**
+ * @brief Records a trace event: {tsc, event, a, b} into the trace ring.
+ *
+ * Built with TRACE (`make TRACE=1`) this calls trace_record(). Otherwise
+ * it compiles to nothing and its arguments are not evaluated.
+ */
+#ifdef TRACE
+#define TRACE_EVENT(event, a, b) trace_record((event), (uint32_t)(a), (uint32_t)(b))
+#else
+#define TRACE_EVENT(event, a, b) do { if (0) trace_record((event), (uint32_t)(a), (uint32_t)(b)); } while (0)
+#endif
+
+/**
+ * @brief Appends an event to the trace ring, overwriting the oldest when full.
+ *
+ * Safe in interrupt handlers and on several CPUs at once. Normally called
+ * through TRACE_EVENT().
+ *
+ * @param event TRACE_* id.
+ * @param a, b  Event arguments.
+ */
+void trace_record(uint32_t event, uint32_t a, uint32_t b);
+
+/**
+ * @brief Discards every recorded event.
+ */
+void trace_clear();
+
+/**
+ * @brief Prints the recorded events, oldest first, with TSC deltas (the "trace" command).
+ *
+ * @param max Most recent events to print (0 for all).
+ */
+void trace_dump(uint32_t max);
+
+/**
+ * @brief Sends the recorded events over the serial port in the binary dump format.
+ *
+ * @return Number of events sent.
+ */
+uint32_t trace_send();
+
+#endif // TRACE_H
@@ -0,0 +1,186 @@
+#include "acpi.h"
+#include "memory.h"
+#include "string.h"
+#include "kprintf.h"
+
+static const acpi_rsdp_t* boot_rsdp = NULL; // RSDP from the Multiboot2 information, if GRUB passed one
+
+// MADT: the header, then variable-length entries up to header.length
+typedef struct {
+    acpi_sdt_header_t header;
+    uint32_t lapic_address;   // 32-bit local APIC address (MADT_LAPIC_ADDR_OVERRIDE may replace it)
+    uint32_t flags;
+} __attribute__((packed)) acpi_madt_t;
+
+// Start of every MADT entry
+typedef struct {
+    uint8_t type;   // MADT_* entry type
+    uint8_t length; // Size of the entry, these two bytes included
+} __attribute__((packed)) madt_entry_t;
+
+typedef struct {
+    madt_entry_t entry;
+    uint8_t processor_id; // ACPI processor id
+    uint8_t apic_id;      // Local APIC id (the target of INIT/STARTUP IPIs)
+    uint32_t flags;       // MADT_LAPIC_* flags
+} __attribute__((packed)) madt_local_apic_t;
+
+typedef struct {
+    madt_entry_t entry;
+    uint8_t ioapic_id;
+    uint8_t reserved;
+    uint32_t address;     // Physical address of the I/O APIC registers
+    uint32_t gsi_base;    // First global system interrupt it handles
+} __attribute__((packed)) madt_io_apic_t;
+
+typedef struct {
+    madt_entry_t entry;
+    uint16_t reserved;
+    uint64_t address;     // Physical address of the local APICs
+} __attribute__((packed)) madt_lapic_override_t;
+
+/**
+ * @brief Returns whether `len` bytes sum to 0 modulo 256, as every ACPI checksum requires.
+ */
+static int checksum_ok(const void* data, uint32_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < len; i++) sum += p[i];
+    return sum == 0;
+}
+
+/**
+ * @brief Checks the signature and checksums of an RSDP.
+ */
+static int rsdp_valid(const acpi_rsdp_t* rsdp) {
+    if (memcmp(rsdp->signature, ACPI_RSDP_SIGNATURE, 8) || !checksum_ok(rsdp, ACPI_RSDP_V1_SIZE)) return 0;
+    return rsdp->revision < 2 || checksum_ok(rsdp, rsdp->length);
+}
+
+/**
+ * @brief Records the RSDP GRUB copied into the Multiboot2 information (tags 14 and 15).
+ *
+ * Called by parse_memory_map(). An ACPI 2.0 copy replaces a 1.0 one, not
+ * the other way round. The structure must stay mapped (the multiboot
+ * information is kept reserved).
+ *
+ * @param rsdp Copy of the RSDP inside the tag.
+ */
+void acpi_set_rsdp(const void* rsdp) {
+    const acpi_rsdp_t* candidate = (const acpi_rsdp_t*)rsdp;
+    if (boot_rsdp && boot_rsdp->revision >= candidate->revision) return;
+    boot_rsdp = candidate;
+}
+
+/**
+ * @brief Searches a physical range below 1 MiB for an RSDP (on its 16-byte boundaries).
+ *
+ * @return The RSDP through the direct map, or NULL if there is none.
+ */
+static const acpi_rsdp_t* scan_for_rsdp(uint32_t start, uint32_t end) {
+    for (uint32_t addr = start & ~15u; addr + sizeof(acpi_rsdp_t) <= end; addr += 16) {
+        const acpi_rsdp_t* rsdp = (const acpi_rsdp_t*)phys_to_virt(addr);
+        if (rsdp_valid(rsdp)) return rsdp;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Finds the RSDP: GRUB's copy first, then the first KiB of the EBDA, then the BIOS area.
+ */
+static const acpi_rsdp_t* find_rsdp() {
+    if (boot_rsdp && rsdp_valid(boot_rsdp)) return boot_rsdp;
+
+    uint32_t ebda = (uint32_t)*(uint16_t*)phys_to_virt(BIOS_EBDA_SEGMENT) << 4;
+    const acpi_rsdp_t* rsdp = NULL;
+    if (ebda >= 0x80000 && ebda < BIOS_ROM_START) rsdp = scan_for_rsdp(ebda, ebda + BIOS_EBDA_SCAN);
+    if (!rsdp) rsdp = scan_for_rsdp(BIOS_ROM_START, BIOS_ROM_END);
+    return rsdp;
+}
+
+/**
+ * @brief Maps a whole ACPI table and checks its checksum.
+ *
+ * @param paddr Physical address of the table.
+ * @return The table, or NULL if it could not be mapped or is corrupt.
+ */
+static const acpi_sdt_header_t* map_table(uint32_t paddr) {
+    const acpi_sdt_header_t* header = (const acpi_sdt_header_t*)map_physical(paddr, sizeof(acpi_sdt_header_t), 0);
+    if (!header || header->length < sizeof(acpi_sdt_header_t)) return NULL;
+
+    const acpi_sdt_header_t* table = (const acpi_sdt_header_t*)map_physical(paddr, header->length, 0);
+    if (!table || !checksum_ok(table, table->length)) return NULL;
+    return table;
+}
+
+/**
+ * @brief Finds a table by signature through the XSDT (ACPI 2.0) or the RSDT.
+ *
+ * @return The table, or NULL if no valid one is listed.
+ */
+static const acpi_sdt_header_t* find_table(const acpi_rsdp_t* rsdp, const char* signature) {
+    int xsdt = rsdp->revision >= 2 && rsdp->xsdt_address && !(rsdp->xsdt_address >> 32);
+    const acpi_sdt_header_t* root = map_table(xsdt ? (uint32_t)rsdp->xsdt_address : rsdp->rsdt_address);
+    if (!root) return NULL;
+
+    uint32_t entry_size = xsdt ? 8 : 4;
+    uint32_t count = (root->length - sizeof(acpi_sdt_header_t)) / entry_size;
+    const uint8_t* entries = (const uint8_t*)(root + 1);
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t addr = xsdt ? *(const uint64_t*)(entries + i * 8) : *(const uint32_t*)(entries + i * 4);
+        if (addr >> 32) continue; // Out of reach of 32-bit paging
+
+        const acpi_sdt_header_t* table = map_table((uint32_t)addr);
+        if (table && !memcmp(table->signature, signature, 4)) return table;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Looks up the processors and APICs in the ACPI MADT.
+ *
+ * Uses the RSDP recorded by acpi_set_rsdp(), or searches the EBDA and
+ * the BIOS area for one. Tables are reached with map_physical(), so
+ * setup_paging() must have run, and they may be gone once
+ * reclaim_acpi_memory() has run.
+ *
+ * @param info Filled in with what the MADT lists.
+ * @return 1 if a valid MADT was found, 0 otherwise.
+ */
+int acpi_parse_madt(madt_info_t* info) {
+    memset(info, 0, sizeof(madt_info_t));
+
+    const acpi_rsdp_t* rsdp = find_rsdp();
+    if (!rsdp) return 0;
+    const acpi_madt_t* madt = (const acpi_madt_t*)find_table(rsdp, ACPI_MADT_SIGNATURE);
+    if (!madt) return 0;
+
+    info->lapic_address = madt->lapic_address ? madt->lapic_address : LAPIC_DEFAULT_ADDRESS;
+
+    const uint8_t* p = (const uint8_t*)(madt + 1);
+    const uint8_t* end = (const uint8_t*)madt + madt->header.length;
+    while (p + sizeof(madt_entry_t) <= end) {
+        const madt_entry_t* entry = (const madt_entry_t*)p;
+        if (entry->length < sizeof(madt_entry_t) || p + entry->length > end) break; // Corrupt
+
+        if (entry->type == MADT_LOCAL_APIC) {
+            const madt_local_apic_t* lapic = (const madt_local_apic_t*)entry;
+            // Online-capable entries are hot-plug slots with no processor present yet
+            if ((lapic->flags & MADT_LAPIC_ENABLED) && info->cpu_count < MAX_CPUS) {
+                info->apic_ids[info->cpu_count++] = lapic->apic_id;
+            }
+        } else if (entry->type == MADT_IO_APIC) {
+            const madt_io_apic_t* ioapic = (const madt_io_apic_t*)entry;
+            if (!info->ioapic_count++) info->ioapic_address = ioapic->address;
+        } else if (entry->type == MADT_LAPIC_ADDR_OVERRIDE) {
+            const madt_lapic_override_t* override = (const madt_lapic_override_t*)entry;
+            if (!(override->address >> 32)) info->lapic_address = (uint32_t)override->address;
+        }
+        p += entry->length;
+    }
+
+    klog(LOG_INFO, "acpi: MADT (ACPI %s) lists %u CPUs, %u I/O APICs, local APIC at %x",
+         rsdp->revision >= 2 ? "2.0+" : "1.0", info->cpu_count, info->ioapic_count, info->lapic_address);
+    return 1;
+}
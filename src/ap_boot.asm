@@ -0,0 +1,68 @@
+global ap_trampoline_start ;Start and end of the code smp.c copies to AP_TRAMPOLINE_ADDR before starting each AP.
+global ap_trampoline_end
+global ap_boot_params      ;ap_boot_params_t (smp.h) inside the copied code; smp.c fills in the copy.
+
+AP_TRAMPOLINE_ADDR equ 0x8000 ;Where the code runs (AP_TRAMPOLINE_ADDR in smp.h). A STARTUP IPI with vector 0x08 starts the AP at 0x0800:0000.
+%define TRAMPOLINE(label) (AP_TRAMPOLINE_ADDR + (label) - ap_trampoline_start) ;Address of a label in the copy.
+
+section .rodata         ;Never run where it is linked, only copied, so it sits with the read-only data.
+
+align 16
+bits 16                 ;An AP starts in real mode.
+ap_trampoline_start:
+    cli                 ;No IDT until ap_main() loads the kernel's.
+    cld
+    xor ax, ax
+    mov ds, ax          ;Segment 0, so the absolute addresses below work as offsets.
+
+    lgdt [TRAMPOLINE(ap_gdt_descriptor)]
+    mov eax, cr0
+    or eax, 1           ;Set CR0.PE.
+    mov cr0, eax
+    jmp dword 0x08:TRAMPOLINE(ap_protected_mode) ;Far jump to reload CS with a 32-bit code segment.
+
+bits 32
+ap_protected_mode:
+    mov ax, 0x10        ;Data segment selector.
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    ;Take over the bootstrap CPU's paging setup: CR4 first (4MB and global pages), then the kernel page directory, then CR0.PG.
+    mov eax, [TRAMPOLINE(ap_cr4)]
+    mov cr4, eax
+    mov eax, [TRAMPOLINE(ap_cr3)]
+    mov cr3, eax
+    mov eax, [TRAMPOLINE(ap_cr0)]
+    mov cr0, eax        ;This page is identity mapped while APs start, so execution carries on here.
+
+    mov esp, [TRAMPOLINE(ap_stack)] ;Higher-half boot stack of this AP.
+    push dword [TRAMPOLINE(ap_cpu)] ;Argument of ap_main(): the per-CPU area index.
+    mov eax, [TRAMPOLINE(ap_entry)]
+    call eax            ;Absolute call into the higher half; ap_main() never returns.
+
+.hang:
+    cli
+    hlt
+    jmp .hang
+
+align 8
+ap_gdt:                 ;Flat segments with the selectors boot.asm uses (0x08 code, 0x10 data), until cpu_init() loads the per-CPU GDT.
+    dq 0                ;Null descriptor.
+    dq 0x00CF9A000000FFFF ;0x08: ring 0 code, base 0, limit 4 GiB, 32-bit.
+    dq 0x00CF92000000FFFF ;0x10: ring 0 data, base 0, limit 4 GiB, 32-bit.
+ap_gdt_descriptor:      ;Operand of LGDT: limit, then the linear base address of the copy.
+    dw ap_gdt_descriptor - ap_gdt - 1
+    dd TRAMPOLINE(ap_gdt)
+
+align 4
+ap_boot_params:         ;Same layout as ap_boot_params_t.
+ap_cr0:   dd 0
+ap_cr3:   dd 0
+ap_cr4:   dd 0
+ap_stack: dd 0
+ap_entry: dd 0
+ap_cpu:   dd 0
+ap_trampoline_end:
@@ -0,0 +1,98 @@
+#include "bench.h"
+#include "cpu.h"
+#include "kprintf.h"
+#include "string.h"
+
+// Defined by the linker script around the .bench section
+extern const benchmark_t bench_start[];
+extern const benchmark_t bench_end[];
+
+static uint32_t samples[BENCH_REPEATS]; // Cycles per operation of each timed run
+
+/**
+ * @brief Measures the cycles a back-to-back rdtsc pair takes, so it can be subtracted from samples.
+ */
+static uint32_t timing_overhead() {
+    uint32_t best = 0xFFFFFFFF;
+    for (uint32_t i = 0; i < BENCH_WARMUP; i++) {
+        uint64_t start = rdtsc();
+        uint32_t cycles = (uint32_t)(rdtsc() - start);
+        if (cycles < best) best = cycles;
+    }
+    return best;
+}
+
+/**
+ * @brief Sorts the samples in ascending order (insertion sort; the array is small).
+ */
+static void sort_samples(uint32_t* a, uint32_t n) {
+    for (uint32_t i = 1; i < n; i++) {
+        uint32_t value = a[i];
+        uint32_t j = i;
+        while (j > 0 && a[j - 1] > value) {
+            a[j] = a[j - 1];
+            j--;
+        }
+        a[j] = value;
+    }
+}
+
+/**
+ * @brief Times one benchmark.
+ *
+ * Runs setup(), BENCH_WARMUP untimed runs, BENCH_REPEATS runs timed with
+ * rdtsc (minus the cost of the timing itself), then teardown().
+ *
+ * @param b      Benchmark to run.
+ * @param result Receives the cycles per operation.
+ */
+void bench_run(const benchmark_t* b, bench_result_t* result) {
+    uint32_t overhead = timing_overhead();
+    uint32_t ops = b->ops ? b->ops : 1;
+
+    if (b->setup) b->setup();
+    for (uint32_t i = 0; i < BENCH_WARMUP; i++) b->run();
+
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < BENCH_REPEATS; i++) {
+        uint64_t start = rdtsc();
+        b->run();
+        uint64_t cycles = rdtsc() - start;
+
+        cycles = cycles > overhead ? cycles - overhead : 0;
+        if (cycles > 0xFFFFFFFF) cycles = 0xFFFFFFFF;
+        samples[i] = (uint32_t)cycles / ops;
+        total += samples[i];
+    }
+    if (b->teardown) b->teardown();
+
+    sort_samples(samples, BENCH_REPEATS);
+    result->min = samples[0];
+    result->median = samples[BENCH_REPEATS / 2];
+    result->p99 = samples[BENCH_REPEATS * 99 / 100];
+    result->mean = (uint32_t)(total / BENCH_REPEATS);
+}
+
+/**
+ * @brief Runs the registered benchmarks whose name starts with `prefix` and prints their results.
+ *
+ * Each result is one console line (mirrored to serial when enabled):
+ * "bench <name>: min=<n> median=<n> p99=<n> mean=<n> cycles/op".
+ *
+ * @param prefix Name prefix to select benchmarks ("" or NULL for all).
+ * @return Number of benchmarks run.
+ */
+uint32_t bench_run_matching(const char* prefix) {
+    uint32_t prefix_len = prefix ? strlen(prefix) : 0;
+    uint32_t count = 0;
+
+    for (const benchmark_t* b = bench_start; b < bench_end; b++) {
+        if (prefix_len && strncmp(b->name, prefix, prefix_len)) continue;
+
+        bench_result_t r;
+        bench_run(b, &r);
+        kprintf("bench %s: min=%u median=%u p99=%u mean=%u cycles/op\n", b->name, r.min, r.median, r.p99, r.mean);
+        count++;
+    }
+    return count;
+}
@@ -0,0 +1,182 @@
+#include "bench.h"
+#include "memory.h"
+#include "cpu.h"
+#include "io.h"
+#include "pool.h"
+#include "sched.h"
+
+#define BENCH_MAP_VADDR KERNEL_HEAP_END // Unused 4MB window above the kernel heap (page directory entry 1020)
+#define BENCH_MAP_PAGES 64         // Pages mapped per map_page run
+#define BENCH_BATCH     256        // Pages or objects held at once by the batch benchmarks
+#define BENCH_YIELDS    64         // Round trips per task_switch run (two context switches each)
+
+static void* held[BENCH_BATCH];    // Allocations kept live within one run
+static uint32_t bench_frame = 0;   // Frame the map_page benchmark maps everywhere
+static uint32_t saved_outputs = 0; // Console outputs to restore after a console benchmark
+static console_snapshot_t saved_console; // Screen and scrollback to restore after a console benchmark
+static pool_t bench_pool;          // 48-byte objects, for comparison with kmalloc_small
+static arena_t bench_arena;
+static task_t* bench_partner = NULL;     // Thread the task_switch benchmark switches to and from
+static volatile int partner_stop = 0;    // Tells bench_partner to exit
+
+// =====================
+// Page allocator
+// =====================
+
+static void run_page_alloc_free() {
+    for (uint32_t i = 0; i < 64; i++) free_page(alloc_page());
+}
+
+static void run_page_alloc_batch() {
+    for (uint32_t i = 0; i < BENCH_BATCH; i++) held[i] = alloc_page();
+    for (uint32_t i = 0; i < BENCH_BATCH; i++) {
+        if (held[i]) free_page(held[i]);
+    }
+}
+
+BENCHMARK(page_alloc_free, NULL, run_page_alloc_free, NULL, 64);
+BENCHMARK(page_alloc_batch, NULL, run_page_alloc_batch, NULL, BENCH_BATCH);
+
+// =====================
+// Kernel heap
+// =====================
+
+static const uint32_t small_sizes[] = { 16, 32, 24, 64, 48, 128, 8, 256 };
+static const uint32_t mixed_sizes[] = { 16, 4096, 64, 300, 1024, 24, 2048, 8192, 128, 40, 512, 3000 };
+
+/**
+ * @brief Allocates BENCH_BATCH objects cycling through `sizes`, then frees every other one and the rest.
+ */
+static void kmalloc_pattern(const uint32_t* sizes, uint32_t count) {
+    for (uint32_t i = 0; i < BENCH_BATCH; i++) held[i] = kmalloc(sizes[i % count]);
+    for (uint32_t i = 0; i < BENCH_BATCH; i += 2) kfree(held[i]);
+    for (uint32_t i = 1; i < BENCH_BATCH; i += 2) kfree(held[i]);
+}
+
+static void run_kmalloc_small() {
+    kmalloc_pattern(small_sizes, sizeof(small_sizes) / sizeof(small_sizes[0]));
+}
+
+static void run_kmalloc_mixed() {
+    kmalloc_pattern(mixed_sizes, sizeof(mixed_sizes) / sizeof(mixed_sizes[0]));
+}
+
+BENCHMARK(kmalloc_small, NULL, run_kmalloc_small, NULL, BENCH_BATCH);
+BENCHMARK(kmalloc_mixed, NULL, run_kmalloc_mixed, NULL, BENCH_BATCH);
+
+// =====================
+// Pools and arenas
+// =====================
+
+static void setup_pool() {
+    pool_init(&bench_pool, 48, 0, 0);
+}
+
+static void run_pool_alloc_batch() {
+    for (uint32_t i = 0; i < BENCH_BATCH; i++) held[i] = pool_alloc(&bench_pool);
+    for (uint32_t i = 0; i < BENCH_BATCH; i += 2) pool_free(&bench_pool, held[i]);
+    for (uint32_t i = 1; i < BENCH_BATCH; i += 2) pool_free(&bench_pool, held[i]);
+}
+
+static void teardown_pool() {
+    pool_destroy(&bench_pool);
+}
+
+static void run_arena_alloc_reset() {
+    for (uint32_t i = 0; i < BENCH_BATCH; i++) arena_alloc(&bench_arena, small_sizes[i % 8]);
+    arena_reset(&bench_arena);
+}
+
+static void teardown_arena() {
+    arena_destroy(&bench_arena);
+}
+
+BENCHMARK(pool_alloc_batch, setup_pool, run_pool_alloc_batch, teardown_pool, BENCH_BATCH);
+BENCHMARK(arena_alloc_reset, NULL, run_arena_alloc_reset, teardown_arena, BENCH_BATCH);
+
+// =====================
+// Paging
+// =====================
+
+static void setup_map_page() {
+    bench_frame = (uint32_t)alloc_page();
+}
+
+static void run_map_page() {
+    if (!bench_frame) return;
+
+    uint32_t* pd = (uint32_t*)(read_cr3() & ~0xFFF);
+    for (uint32_t i = 0; i < BENCH_MAP_PAGES; i++) {
+        map_page_with_directory(pd, BENCH_MAP_VADDR + i * PAGE_SIZE, bench_frame, PAGE_WRITABLE);
+    }
+    unmap_range(pd, BENCH_MAP_VADDR, BENCH_MAP_PAGES * PAGE_SIZE, 0);
+}
+
+static void teardown_map_page() {
+    if (bench_frame) free_page((void*)bench_frame);
+    bench_frame = 0;
+}
+
+BENCHMARK(map_page, setup_map_page, run_map_page, teardown_map_page, BENCH_MAP_PAGES);
+
+// =====================
+// Console
+// =====================
+
+// Console benchmarks draw on VGA only: a serial line would make them measure the baud rate
+// The screen is saved and put back around them, so earlier results stay visible
+static void setup_console() {
+    saved_outputs = console_set_outputs(CONSOLE_VGA);
+    console_save(&saved_console);
+    clrscr();
+}
+
+static void teardown_console() {
+    console_restore(&saved_console);
+    console_set_outputs(saved_outputs);
+}
+
+static void run_console_putc() {
+    for (uint32_t i = 0; i < SCREEN_COLS; i++) putc('.');
+}
+
+static void run_console_scroll() {
+    for (uint32_t i = 0; i < SCREEN_ROWS; i++) putc('\n');
+}
+
+static void run_console_print() {
+    print("The quick brown fox jumps over the lazy dog, then prints the rest of this line.\n");
+}
+
+BENCHMARK(console_putc, setup_console, run_console_putc, teardown_console, SCREEN_COLS);
+BENCHMARK(console_scroll, setup_console, run_console_scroll, teardown_console, SCREEN_ROWS);
+BENCHMARK(console_print, setup_console, run_console_print, teardown_console, 80);
+
+// =====================
+// Scheduler
+// =====================
+
+// Yields back as soon as it runs, so every sched_yield() of the benchmark is a round trip
+static void yield_partner(void* arg) {
+    (void)arg;
+    while (!partner_stop) sched_yield();
+}
+
+static void setup_task_switch() {
+    partner_stop = 0;
+    bench_partner = task_create("bench", yield_partner, NULL, current_task()->priority);
+}
+
+static void run_task_switch() {
+    if (!bench_partner) return;
+    for (uint32_t i = 0; i < BENCH_YIELDS; i++) sched_yield();
+}
+
+static void teardown_task_switch() {
+    if (!bench_partner) return;
+    partner_stop = 1;
+    sched_yield(); // Let it see the flag and exit
+    bench_partner = NULL;
+}
+
+BENCHMARK(task_switch, setup_task_switch, run_task_switch, teardown_task_switch, 2 * BENCH_YIELDS);
@@ -1,9 +1,64 @@
 global start            ;Exposes the `start` label as the entry point to the linker, so the bootloader or GRUB knows where execution begins.
+global stack_top        ;Top of the boot stack; kernel_main() records it in the bootstrap CPU's per-CPU area.
+global boot_page_directory ;Page directory paging is enabled with; setup_paging() keeps it as the kernel page directory.
 extern kernel_main      ;Tells the assembler that `kernel_main` is defined in another file, and will be linked later.
 
-section .text           ;Marks the beginning of the code section.
+KERNEL_VIRTUAL_BASE equ 0xC0000000  ;Where the kernel is linked (same value in linker.ld and memory.h). Physical address P is mapped at P + KERNEL_VIRTUAL_BASE.
+BOOT_PAGE_TABLES    equ 4           ;Page tables set up here: 4 × 4 MiB = the first 16 MiB of physical memory (BOOT_MAP_SIZE in memory.h).
+KERNEL_PD_INDEX     equ KERNEL_VIRTUAL_BASE >> 22 ;Page directory entry of KERNEL_VIRTUAL_BASE (768).
+
+section .boot.text progbits alloc exec nowrite align=16 ;Runs at its physical address, before paging is on, so it is linked low (see linker.ld).
 bits 32                 ;Assembles this file in 32-bit mode.
-start:                  ;The actual entry point after GRUB hands control to the kernel.
+start:                  ;The actual entry point after GRUB hands control to the kernel. EBX holds the (physical) multiboot info pointer and must survive.
+
+    cld                 ;String instructions count upwards, as the C code expects.
+
+    ;Fill the boot page tables: entry i maps physical page i, present and writable.
+    mov edi, boot_page_tables - KERNEL_VIRTUAL_BASE ;Labels are higher-half addresses; subtract the base to get the physical ones.
+    mov eax, 0x003      ;Physical page 0 | PAGE_PRESENT | PAGE_WRITABLE.
+    mov ecx, BOOT_PAGE_TABLES * 1024 ;One entry per 4 KiB page.
+.fill_table:
+    stosd               ;Store EAX at [EDI] and advance EDI by 4.
+    add eax, 0x1000     ;Next physical page.
+    loop .fill_table
+
+    ;Link the tables twice: at 0, so this code keeps running once paging is on, and at KERNEL_VIRTUAL_BASE, where the rest of the kernel is linked.
+    mov edi, boot_page_directory - KERNEL_VIRTUAL_BASE
+    mov eax, (boot_page_tables - KERNEL_VIRTUAL_BASE) + 0x003
+    xor ecx, ecx
+.link_table:
+    mov [edi + ecx * 4], eax                        ;Identity mapping (dropped again by setup_paging()).
+    mov [edi + ecx * 4 + KERNEL_PD_INDEX * 4], eax  ;Higher-half mapping (extended into the direct map by init_physical_allocator()).
+    add eax, 0x1000     ;Next page table.
+    inc ecx
+    cmp ecx, BOOT_PAGE_TABLES
+    jb .link_table
+
+    ;Enable paging.
+    mov eax, boot_page_directory - KERNEL_VIRTUAL_BASE
+    mov cr3, eax        ;Load the page directory base register.
+    mov eax, cr0
+    or eax, 0x80000000  ;Set CR0.PG.
+    mov cr0, eax
+
+    ;Jump to the higher half. An absolute jump through a register, since a relative one would stay in the low mapping.
+    mov eax, higher_half
+    jmp eax
+
+section .text           ;Marks the beginning of the code section.
+bits 32
+higher_half:            ;From here on everything runs at its linked (higher-half) address.
+
+    ;GRUB's GDT may lie anywhere in low memory, which loses its mapping once setup_paging() drops the identity map; load one inside the kernel.
+    lgdt [gdt_descriptor]
+    jmp 0x08:.reload_segments ;Far jump to reload CS with the new code segment.
+.reload_segments:
+    mov ax, 0x10        ;Data segment selector.
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
 
     mov esp, stack_top  ;Sets up the stack by putting the address of `stack_top` into `ESP`, the stack pointer. This is required because C code (like `kernel_main()`) depends on a working stack for function calls, variables, etc.
 
@@ -15,7 +70,26 @@ start:                  ;The actual entry point after GRUB hands control to the
     hlt                 ;Halt the CPU (wait for the next interrupt — which never comes here).
     jmp .hang           ;Infinite loop to stop execution if `kernel_main` ever returns (it shouldn't).
 
-section .bss            ;Reserves uninitialized memory space.
+section .data           ;Initialized data.
+
+align 8
+gdt_start:              ;Flat segments covering all 4 GiB, as GRUB set up: the selectors (0x08 code, 0x10 data) are unchanged.
+    dq 0                ;Null descriptor.
+    dq 0x00CF9A000000FFFF ;0x08: ring 0 code, base 0, limit 4 GiB, 32-bit.
+    dq 0x00CF92000000FFFF ;0x10: ring 0 data, base 0, limit 4 GiB, 32-bit.
+gdt_end:
+
+gdt_descriptor:         ;Operand of LGDT: limit, then linear base address.
+    dw gdt_end - gdt_start - 1
+    dd gdt_start
+
+section .bss align=4096 ;Reserves uninitialized memory space (page aligned, for the paging structures below).
+
+align 4096              ;Page directories and page tables must be page aligned.
+boot_page_directory:    ;GRUB zeroes .bss, so every entry not linked above starts out not present.
+    resb 4096
+boot_page_tables:       ;Page tables mapping the first 16 MiB at both 0 and KERNEL_VIRTUAL_BASE.
+    resb 4096 * BOOT_PAGE_TABLES
 
 align 16                ;Ensures stack_bottom is 16-byte aligned — good for performance and ABI (Application Binary Interface) compliance.
 stack_bottom:           ;Label marking the end of 16 KiB reserved space.
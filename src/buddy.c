@@ -0,0 +1,224 @@
+#include "buddy.h"
+#include "memory.h"
+
+// Free-list node stored in the first bytes of every free block.
+// Free blocks are reached through the direct map (block_of()), so the
+// managed span never reaches past DIRECT_MAP_SIZE.
+typedef struct BuddyBlock {
+    struct BuddyBlock* next; // Next free block of the same order
+    struct BuddyBlock* prev; // Previous free block of the same order
+} BuddyBlock;
+
+static BuddyBlock* free_areas[BUDDY_MAX_ORDER + 1];  // Free list heads, one per order
+static uint32_t* order_maps[BUDDY_MAX_ORDER + 1];    // Bit set = block at this index and order is on its free list
+static uint32_t buddy_base_frame = 0;                // Frame number of block index 0, aligned to the maximum order
+static uint32_t buddy_span_frames = 0;               // Number of frames covered by the order maps
+static uint32_t buddy_free_count = 0;                // Free pages across all orders
+
+/**
+ * @brief Returns the free-list node of the block starting at `frame`.
+ */
+static inline BuddyBlock* block_of(uint32_t frame) {
+    return (BuddyBlock*)phys_to_virt(frame * PAGE_SIZE);
+}
+
+/**
+ * @brief Returns the first frame of the block holding free-list node `block`.
+ */
+static inline uint32_t frame_of(const BuddyBlock* block) {
+    return virt_to_phys(block) / PAGE_SIZE;
+}
+
+/**
+ * @brief Clips the managed span to the direct map and rounds it out to whole maximum-order blocks.
+ *
+ * DIRECT_MAP_SIZE is a multiple of the largest block, so the rounding
+ * never takes the span past it.
+ */
+static void buddy_span(uint32_t first_frame, uint32_t frame_count, uint32_t* base, uint32_t* span) {
+    uint32_t block = 1u << BUDDY_MAX_ORDER;
+    uint32_t end = first_frame + frame_count;
+    if (end > DIRECT_MAP_SIZE / PAGE_SIZE) end = DIRECT_MAP_SIZE / PAGE_SIZE;
+    if (first_frame > end) first_frame = end;
+
+    *base = first_frame & ~(block - 1);
+    *span = ((end + block - 1) & ~(block - 1)) - *base;
+}
+
+/**
+ * @brief Returns the size of the order-k map in 32-bit words.
+ */
+static uint32_t order_map_words(uint32_t span, uint32_t order) {
+    return ((span >> order) + 31) / 32;
+}
+
+/**
+ * @brief Returns the number of bytes of metadata the buddy allocator needs.
+ *
+ * The metadata is one "free at this order" bitmap per order, covering the
+ * frame span rounded out to a whole number of maximum-order blocks.
+ *
+ * @param first_frame Physical frame number of the lowest managed page.
+ * @param frame_count Number of frames in the managed span (holes included).
+ * @return Size of the metadata area in bytes.
+ */
+uint32_t buddy_metadata_size(uint32_t first_frame, uint32_t frame_count) {
+    uint32_t base, span, words = 0;
+    buddy_span(first_frame, frame_count, &base, &span);
+
+    for (uint32_t order = 0; order <= BUDDY_MAX_ORDER; order++) {
+        words += order_map_words(span, order);
+    }
+    return words * sizeof(uint32_t);
+}
+
+/**
+ * @brief Initializes the buddy allocator with every frame marked as used.
+ *
+ * Free memory is handed to the allocator afterwards with buddy_free_range().
+ * Only frames in the direct map can be managed: the span is clipped at
+ * DIRECT_MAP_SIZE (as by buddy_metadata_size()).
+ *
+ * @param metadata    Zero-initialized storage of at least buddy_metadata_size() bytes.
+ * @param first_frame Physical frame number of the lowest managed page.
+ * @param frame_count Number of frames in the managed span (holes included).
+ */
+void buddy_init(void* metadata, uint32_t first_frame, uint32_t frame_count) {
+    buddy_span(first_frame, frame_count, &buddy_base_frame, &buddy_span_frames);
+
+    // Carve the metadata area into one map per order
+    uint32_t* map = (uint32_t*)metadata;
+    for (uint32_t order = 0; order <= BUDDY_MAX_ORDER; order++) {
+        order_maps[order] = map;
+        free_areas[order] = NULL;
+        map += order_map_words(buddy_span_frames, order);
+    }
+
+    buddy_free_count = 0;
+}
+
+/**
+ * @brief Pushes the block starting at `frame` onto the order's free list.
+ */
+static void buddy_push(uint32_t frame, uint32_t order) {
+    uint32_t index = (frame - buddy_base_frame) >> order;
+    BuddyBlock* block = block_of(frame);
+
+    block->prev = NULL;
+    block->next = free_areas[order];
+    if (block->next) block->next->prev = block;
+    free_areas[order] = block;
+
+    BITMAP_SET(order_maps[order], index);
+}
+
+/**
+ * @brief Unlinks the block starting at `frame` from the order's free list.
+ */
+static void buddy_unlink(uint32_t frame, uint32_t order) {
+    uint32_t index = (frame - buddy_base_frame) >> order;
+    BuddyBlock* block = block_of(frame);
+
+    if (block->prev) {
+        block->prev->next = block->next;
+    } else {
+        free_areas[order] = block->next;
+    }
+    if (block->next) block->next->prev = block->prev;
+
+    BITMAP_CLEAR(order_maps[order], index);
+}
+
+/**
+ * @brief Allocates a block of 2^order physically contiguous pages.
+ *
+ * Takes the smallest free block of at least the requested order and
+ * splits it down, returning the unused halves to their free lists.
+ * The block is aligned to its own size.
+ *
+ * @param order Block order (0 = one 4KB page, BUDDY_MAX_ORDER = 4MB).
+ * @return Physical address of the block, or NULL if none is available.
+ */
+void* buddy_alloc(uint32_t order) {
+    if (order > BUDDY_MAX_ORDER) return NULL;
+
+    // Find the smallest order with a free block
+    uint32_t k = order;
+    while (k <= BUDDY_MAX_ORDER && !free_areas[k]) k++;
+    if (k > BUDDY_MAX_ORDER) return NULL; // Out of memory
+
+    BuddyBlock* block = free_areas[k];
+    uint32_t frame = frame_of(block);
+    buddy_unlink(frame, k);
+
+    // Split down to the requested order, keeping the lower half each time
+    while (k > order) {
+        k--;
+        buddy_push(frame + (1u << k), k);
+    }
+
+    buddy_free_count -= 1u << order;
+    return (void*)(frame * PAGE_SIZE);
+}
+
+/**
+ * @brief Frees a block of 2^order pages and coalesces it with its free buddies.
+ *
+ * @param addr  Physical address of the block (aligned to its size).
+ * @param order Order the block was allocated with.
+ */
+void buddy_free(void* addr, uint32_t order) {
+    uint32_t frame = (uint32_t)addr / PAGE_SIZE;
+    if (frame < buddy_base_frame || frame - buddy_base_frame >= buddy_span_frames) return;
+
+    buddy_free_count += 1u << order;
+
+    // Merge with the buddy for as long as it is free at the same order
+    while (order < BUDDY_MAX_ORDER) {
+        uint32_t buddy = frame ^ (1u << order);
+        uint32_t index = (buddy - buddy_base_frame) >> order;
+
+        if (!BITMAP_TEST(order_maps[order], index)) break;
+
+        buddy_unlink(buddy, order);
+        frame &= ~(1u << order); // The merged block starts at the lower of the two
+        order++;
+    }
+
+    buddy_push(frame, order);
+}
+
+/**
+ * @brief Frees an arbitrary page range by splitting it into aligned blocks.
+ *
+ * Each page is coalesced with its neighbours, so freeing a range page by
+ * page or in one call ends in the same state. Frames outside the managed
+ * span are ignored.
+ *
+ * @param addr  Physical address of the first page.
+ * @param count Number of pages to free.
+ */
+void buddy_free_range(void* addr, uint32_t count) {
+    uint32_t frame = (uint32_t)addr / PAGE_SIZE;
+    uint32_t end = frame + count;
+
+    while (frame < end) {
+        // Largest block that is aligned at this frame and still fits in the range
+        uint32_t order = 0;
+        while (order < BUDDY_MAX_ORDER &&
+               !(frame & (1u << order)) &&
+               frame + (2u << order) <= end) {
+            order++;
+        }
+
+        buddy_free((void*)(frame * PAGE_SIZE), order);
+        frame += 1u << order;
+    }
+}
+
+/**
+ * @brief Returns the number of free pages held by the buddy allocator.
+ */
+uint32_t buddy_free_pages() {
+    return buddy_free_count;
+}
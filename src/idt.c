@@ -0,0 +1,121 @@
+#include "idt.h"
+#include "kprintf.h"
+#include "pic.h"
+#include "lapic.h"
+#include "sched.h"
+
+extern uint32_t isr_stub_table[]; // Stub addresses, defined in isr.asm
+
+static idt_entry_t idt[IDT_ENTRIES];                   // The Interrupt Descriptor Table
+static idt_ptr_t idt_ptr;                              // LIDT operand
+static interrupt_handler_t handlers[IDT_ENTRIES];      // C handler of each vector
+
+// Names of the CPU exceptions, printed when one is not handled
+static const char* exception_names[IDT_EXCEPTIONS] = {
+    "Divide error", "Debug", "NMI", "Breakpoint", "Overflow", "Bound range exceeded",
+    "Invalid opcode", "Device not available", "Double fault", "Coprocessor segment overrun",
+    "Invalid TSS", "Segment not present", "Stack fault", "General protection fault",
+    "Page fault", "Reserved", "x87 floating point error", "Alignment check", "Machine check",
+    "SIMD floating point error", "Virtualization error", "Control protection error",
+    "Reserved", "Reserved", "Reserved", "Reserved", "Reserved", "Reserved",
+    "Hypervisor injection", "VMM communication", "Security exception", "Reserved"
+};
+
+/**
+ * @brief Sets one IDT gate.
+ *
+ * @param vector   Interrupt vector.
+ * @param handler  Address of the assembly stub.
+ * @param selector Code segment selector.
+ * @param flags    Gate type and attributes (e.g., IDT_INTERRUPT_GATE).
+ */
+static void idt_set_gate(uint8_t vector, uint32_t handler, uint16_t selector, uint8_t flags) {
+    idt[vector].offset_low = handler & 0xFFFF;
+    idt[vector].selector = selector;
+    idt[vector].zero = 0;
+    idt[vector].type_attr = flags;
+    idt[vector].offset_high = handler >> 16;
+}
+
+/**
+ * @brief Fills in the IDT with the stubs from isr.asm and loads it with LIDT.
+ *
+ * Covers the CPU exceptions, the PIC IRQs (see pic.h) and the local APIC
+ * vectors (see lapic.h).
+ *
+ * The gates use the code segment selector that is loaded at the time of the
+ * call (GDT_KERNEL_CODE once cpu_init() has run).
+ */
+void init_idt() {
+    uint16_t cs;
+    asm volatile("mov %%cs, %0" : "=r"(cs));
+
+    for (uint32_t i = 0; i < IDT_STUBS; i++) {
+        idt_set_gate(i, isr_stub_table[i], cs, IDT_INTERRUPT_GATE);
+    }
+
+    idt_ptr.limit = sizeof(idt) - 1;
+    idt_ptr.base = (uint32_t)&idt;
+    idt_load();
+}
+
+/**
+ * @brief Loads the IDT filled in by init_idt() on the calling CPU (the APs share it).
+ */
+void idt_load() {
+    asm volatile("lidt %0" :: "m"(idt_ptr));
+}
+
+/**
+ * @brief Installs the C handler called for an interrupt vector.
+ *
+ * @param vector  Interrupt vector (0-255).
+ * @param handler Function to call, or NULL to remove the handler.
+ */
+void register_interrupt_handler(uint8_t vector, interrupt_handler_t handler) {
+    handlers[vector] = handler;
+}
+
+/**
+ * @brief Common entry point of all interrupt stubs.
+ *
+ * Calls the registered handler for the vector. A CPU exception without a
+ * handler is reported on screen and halts the system. PIC IRQs are
+ * acknowledged after their handler returns, and so are local APIC
+ * interrupts; spurious ones are dropped. On the way out of either the
+ * scheduler may switch to another task.
+ *
+ * @param frame Saved register state.
+ */
+void isr_dispatch(interrupt_frame_t* frame) {
+    if (frame->int_no >= IRQ_BASE && frame->int_no < IRQ_BASE + IRQ_COUNT) {
+        uint8_t irq = frame->int_no - IRQ_BASE;
+        if (pic_is_spurious(irq)) return;
+
+        if (handlers[frame->int_no]) handlers[frame->int_no](frame);
+        pic_send_eoi(irq);
+        sched_irq_exit(); // The handler may have woken a task that should run now
+        return;
+    }
+
+    if (frame->int_no >= LAPIC_VECTOR_BASE && frame->int_no < IDT_STUBS) {
+        if (frame->int_no == LAPIC_SPURIOUS_VECTOR) return; // Must not be acknowledged
+
+        if (handlers[frame->int_no]) handlers[frame->int_no](frame);
+        lapic_eoi();
+        sched_irq_exit();
+        return;
+    }
+
+    if (handlers[frame->int_no]) {
+        handlers[frame->int_no](frame);
+        return;
+    }
+
+    if (frame->int_no < IDT_EXCEPTIONS) {
+        klog(LOG_ERROR, "Unhandled exception: %s (error %p) at %p",
+             exception_names[frame->int_no], (void*)frame->err_code, (void*)frame->eip);
+
+        while (1) asm volatile("cli\n\thlt");
+    }
+}
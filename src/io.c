@@ -1,7 +1,17 @@
 #include "io.h"
+#include "memory.h"
+#include "cpu.h"
+#include "idt.h"
+#include "pic.h"
+#include "kprintf.h"
+#include "serial.h"
+#include "string.h"
+#include "trace.h"
+#include "sched.h"
+#include "spinlock.h"
 
-// VGA (Video Graphics Array) text buffer base address
-static uint16_t* vga = (uint16_t*) 0xB8000;
+// VGA (Video Graphics Array) text buffer base address, reached through the direct map
+static uint16_t* vga = (uint16_t*) (KERNEL_VIRTUAL_BASE + 0xB8000);
 
 // Default text color: light cyan (0xB) on black (0x0)
 static uint8_t color = 0xB;
@@ -9,66 +19,316 @@ static uint8_t color = 0xB;
 // Current cursor position
 static uint32_t row = 0, col = 0;
 
+// Devices console output goes to (CONSOLE_* bits)
+static uint32_t console_outputs = CONSOLE_VGA;
+
+// Serializes the shadow buffer, the cursor and VGA memory between CPUs (COM1 has its own lock)
+static spinlock_t console_lock;
+
+// Shadow of the screen in RAM. Lines form a ring of SCROLLBACK_LINES, so scrolling
+// moves screen_top instead of copying the screen, and older lines stay available.
+static uint16_t shadow[SCROLLBACK_LINES][SCREEN_COLS];
+static uint32_t screen_top = 0;  // Ring index of the line shown on screen row 0
+static uint32_t history = 0;     // Lines above screen_top still held by the ring
+static uint32_t view_offset = 0; // Lines the view is scrolled back by (0 = following the output)
+
+// Columns [dirty_first, dirty_end) of each screen row differ from VGA memory
+static uint8_t dirty_first[SCREEN_ROWS];
+static uint8_t dirty_end[SCREEN_ROWS];
+
 static int shift_pressed = 0;
 static int caps_lock_on = 0;
 
+// Console input ring: interrupt handlers (which never nest) only move input_head,
+// the reading side only moves input_tail
+static char input_buffer[INPUT_BUFFER_SIZE];
+static volatile uint32_t input_head = 0; // Count of characters written
+static volatile uint32_t input_tail = 0; // Count of characters read
+static wait_queue_t input_waiters;       // Tasks sleeping until input arrives
+
+static idle_task_t idle_tasks[MAX_IDLE_TASKS]; // Work run while the system is idle
+static uint32_t idle_task_count = 0;
+static spinlock_t idle_lock;                    // Held by the CPU running the idle tasks
+
+static uint16_t hw_cursor = 0xFFFF; // Position last written to the VGA cursor registers
+
+// Line editor state, kept between try_read_line() calls
+static char edit_line[LINE_MAX];  // Line being edited (not terminated)
+static uint32_t edit_len = 0;     // Characters in edit_line
+static uint32_t edit_pos = 0;     // Cursor position within edit_line
+static uint32_t edit_escape = 0;  // Progress through an ANSI escape sequence (ESC, '[', digit)
+static int edit_last_cr = 0;      // The previous character was '\r' (so a following '\n' is skipped)
+
+// Command history ring: entry i (counted from 0) is at history_lines[i % LINE_HISTORY]
+static char history_lines[LINE_HISTORY][LINE_MAX];
+static uint32_t history_count = 0;  // Lines ever added
+static uint32_t history_browse = 0; // How far back up/down has gone (0 = the line being typed)
+
+/**
+ * @brief Returns the shadow line shown on a screen row when following the output.
+ */
+static inline uint16_t* screen_line(uint32_t r) {
+    return shadow[(screen_top + r) & (SCROLLBACK_LINES - 1)];
+}
+
 /**
- * @brief Scrolls the VGA text screen up by one line.
+ * @brief Marks columns [first, end) of a screen row as needing a flush.
+ */
+static inline void mark_dirty(uint32_t r, uint32_t first, uint32_t end) {
+    if (first < dirty_first[r]) dirty_first[r] = first;
+    if (end > dirty_end[r]) dirty_end[r] = end;
+}
+
+/**
+ * @brief Marks the whole screen as needing a flush.
+ */
+static void mark_all_dirty() {
+    for (uint32_t r = 0; r < SCREEN_ROWS; r++) mark_dirty(r, 0, SCREEN_COLS);
+}
+
+/**
+ * @brief Scrolls the text screen up by one line.
  *
- * Copies each row of text one line up in the VGA buffer,
- * clears the last row, and adjusts the cursor position to stay
- * within screen bounds. Called automatically when text reaches
- * the bottom of the screen.
+ * Advances the start of the screen in the shadow line ring, clears the new
+ * last row and adjusts the cursor position to stay within screen bounds.
+ * The line that scrolled off stays in the ring as scrollback. Called
+ * automatically when text reaches the bottom of the screen.
  */
 static void scroll() {
-    // Move each row up one
-    for (uint32_t r = 1; r < 25; r++) {
-        for (uint32_t c = 0; c < 80; c++) {
-            vga[(r - 1) * 80 + c] = vga[r * 80 + c];
-        }
-    }
+    screen_top = (screen_top + 1) & (SCROLLBACK_LINES - 1);
+    if (history < SCROLLBACK_LINES - SCREEN_ROWS) history++;
+    TRACE_EVENT(TRACE_SCROLL, history, 0);
 
     // Clear the last row
-    for (uint32_t c = 0; c < 80; c++) {
-        vga[(24 * 80) + c] = (color << 8) | ' ';
-    }
+    memset16(screen_line(SCREEN_ROWS - 1), (color << 8) | ' ', SCREEN_COLS);
+
+    // Every row now shows a different line
+    mark_all_dirty();
 
     // Update cursor position
     if (row > 0) row--;
 }
 
 /**
- * @brief Outputs a single character to the screen at the current cursor position.
- *
- * Automatically handles newline characters and wraps text at the edge
- * of the screen. If the cursor moves beyond the last screen row,
- * the terminal is scrolled up by one line.
- *
- * @param c Character to display.
+ * @brief Puts a character into the shadow buffer without flushing it to VGA memory.
  */
-void putc(char c) {
+static void console_write(char c) {
+    // New output brings a scrolled back view to the bottom again
+    if (view_offset) {
+        view_offset = 0;
+        mark_all_dirty();
+    }
+
     if (c == '\n') {
         col = 0;
         row++;
     } else {
-        vga[row * 80 + col++] = (color << 8) | c;
-        if (col == 80) {
+        screen_line(row)[col] = (color << 8) | c;
+        mark_dirty(row, col, col + 1);
+        col++;
+        if (col == SCREEN_COLS) {
             col = 0;
             row++;
         }
     }
-    if (row == 25) {
+    if (row == SCREEN_ROWS) {
         scroll();
     }
 }
 
+/**
+ * @brief Copies the dirty parts of the shadow buffer to VGA memory (console_lock held).
+ */
+static void vga_flush() {
+    uint32_t cells = 0; // Written to VGA memory, for TRACE_FLUSH_END
+    TRACE_EVENT(TRACE_FLUSH_BEGIN, 0, 0);
+
+    for (uint32_t r = 0; r < SCREEN_ROWS; r++) {
+        if (dirty_first[r] >= dirty_end[r]) continue;
+
+        uint16_t* line = shadow[(screen_top - view_offset + r) & (SCROLLBACK_LINES - 1)];
+        memcpy(&vga[r * SCREEN_COLS + dirty_first[r]], &line[dirty_first[r]], (dirty_end[r] - dirty_first[r]) * sizeof(uint16_t));
+        cells += dirty_end[r] - dirty_first[r];
+
+        dirty_first[r] = SCREEN_COLS;
+        dirty_end[r] = 0;
+    }
+
+    // Move the blinking hardware cursor (CRT controller registers 0x0E/0x0F) if it changed
+    uint16_t pos = view_offset ? SCREEN_ROWS * SCREEN_COLS : row * SCREEN_COLS + col; // Off screen while scrolled back
+    if (pos != hw_cursor) {
+        hw_cursor = pos;
+        outb(0x3D4, 0x0F);
+        outb(0x3D5, pos & 0xFF);
+        outb(0x3D4, 0x0E);
+        outb(0x3D5, pos >> 8);
+    }
+    TRACE_EVENT(TRACE_FLUSH_END, cells, 0);
+}
+
+/**
+ * @brief Copies the dirty parts of the shadow buffer to VGA memory.
+ *
+ * Only writes to VGA memory, never reads it back. Also moves the hardware
+ * cursor to the output position.
+ */
+void console_flush() {
+    uint32_t flags = spin_lock_irqsave(&console_lock);
+    vga_flush();
+    spin_unlock_irqrestore(&console_lock, flags);
+}
+
+/**
+ * @brief Moves the cursor back by `n` cells, across row boundaries, without changing the text.
+ */
+static void console_cursor_left(uint32_t n) {
+    uint32_t pos = row * SCREEN_COLS + col;
+    pos = n < pos ? pos - n : 0;
+    row = pos / SCREEN_COLS;
+    col = pos % SCREEN_COLS;
+}
+
+/**
+ * @brief Moves the view through the scrollback.
+ *
+ * @param lines Lines to scroll back by (positive) or forward by (negative).
+ *              The view stops at the oldest line kept and at the live screen.
+ */
+void console_scroll_view(int32_t lines) {
+    uint32_t flags = spin_lock_irqsave(&console_lock);
+    int32_t offset = (int32_t)view_offset + lines;
+    if (offset < 0) offset = 0;
+    if (offset > (int32_t)history) offset = history;
+
+    if ((uint32_t)offset != view_offset) {
+        view_offset = offset;
+        mark_all_dirty();
+        vga_flush();
+    }
+    spin_unlock_irqrestore(&console_lock, flags);
+}
+
+/**
+ * @brief Copies the console text, scrollback and cursor, so console_restore() can put them back.
+ *
+ * @param snap Receives the copy (static storage: it holds the whole scrollback).
+ */
+void console_save(console_snapshot_t* snap) {
+    uint32_t flags = spin_lock_irqsave(&console_lock);
+    memcpy(snap->lines, shadow, sizeof(shadow));
+    snap->screen_top = screen_top;
+    snap->history = history;
+    snap->row = row;
+    snap->col = col;
+    spin_unlock_irqrestore(&console_lock, flags);
+}
+
+/**
+ * @brief Puts back the console as console_save() found it and redraws the screen.
+ *
+ * @param snap Copy made by console_save().
+ */
+void console_restore(const console_snapshot_t* snap) {
+    uint32_t flags = spin_lock_irqsave(&console_lock);
+    memcpy(shadow, snap->lines, sizeof(shadow));
+    screen_top = snap->screen_top;
+    history = snap->history;
+    row = snap->row;
+    col = snap->col;
+    view_offset = 0;
+    mark_all_dirty();
+    vga_flush();
+    spin_unlock_irqrestore(&console_lock, flags);
+}
+
+/**
+ * @brief Outputs a single character to the screen at the current cursor position.
+ *
+ * Automatically handles newline characters and wraps text at the edge
+ * of the screen. If the cursor moves beyond the last screen row,
+ * the terminal is scrolled up by one line. Only the changed cells are
+ * written to VGA memory.
+ *
+ * @param c Character to display.
+ */
+void putc(char c) {
+    if (console_outputs & CONSOLE_VGA) {
+        uint32_t flags = spin_lock_irqsave(&console_lock);
+        console_write(c);
+        vga_flush();
+        spin_unlock_irqrestore(&console_lock, flags);
+    }
+    if (console_outputs & CONSOLE_SERIAL) {
+        if (c == '\n') serial_putc('\r');
+        serial_putc(c);
+    }
+}
+
 /**
  * @brief Outputs a null-terminated string to the screen.
  *
+ * The string is written to the shadow buffer and VGA memory is updated
+ * once at the end. With CONSOLE_SERIAL it is also queued on COM1.
+ *
  * @param s Pointer to the string to print.
  */
 void print(const char* s) {
-    while (*s) putc(*s++);
+    if (console_outputs & CONSOLE_VGA) {
+        uint32_t flags = spin_lock_irqsave(&console_lock);
+        for (const char* p = s; *p; p++) console_write(*p);
+        vga_flush();
+        spin_unlock_irqrestore(&console_lock, flags);
+    }
+    if (console_outputs & CONSOLE_SERIAL) serial_print(s);
+}
+
+/**
+ * @brief Selects the devices console output goes to.
+ *
+ * @param outputs CONSOLE_VGA and/or CONSOLE_SERIAL.
+ * @return The outputs selected before, so they can be restored.
+ */
+uint32_t console_set_outputs(uint32_t outputs) {
+    uint32_t previous = console_outputs;
+    console_outputs = outputs;
+    return previous;
+}
+
+/**
+ * @brief Prints an unsigned integer in decimal.
+ *
+ * @param value Number to print.
+ */
+void print_dec(uint32_t value) {
+    char buf[11]; // Up to 10 digits for a 32-bit value, plus the terminator
+    int i = sizeof(buf) - 1;
+
+    buf[i] = '\0';
+    do {
+        buf[--i] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+
+    print(&buf[i]);
+}
+
+/**
+ * @brief Prints an unsigned integer as 8 hexadecimal digits with a "0x" prefix.
+ *
+ * @param value Number to print.
+ */
+void print_hex(uint32_t value) {
+    static const char digits[] = "0123456789ABCDEF";
+    char buf[11];
+
+    buf[0] = '0';
+    buf[1] = 'x';
+    for (int i = 0; i < 8; i++) {
+        buf[2 + i] = digits[(value >> (28 - 4 * i)) & 0xF];
+    }
+    buf[10] = '\0';
+
+    print(buf);
 }
 
 /**
@@ -84,20 +344,32 @@ uint8_t inb(uint16_t port) {
 }
 
 /**
- * @brief Waits for and returns the next ASCII character input from the keyboard.
+ * @brief Writes a byte to the given I/O port.
  *
- * Processes basic US QWERTY layout, including Shift and Caps Lock functionality for
- * letter case and symbol selection. Ignores key releases and unmapped keys.
+ * @param port I/O port to write to.
+ * @param value Byte to write.
+ */
+void outb(uint16_t port, uint8_t value) {
+    __asm__ volatile ("outb %0, %1" :: "a"(value), "Nd"(port));
+}
+
+/**
+ * @brief Waits roughly 1-4 microseconds by writing to the unused POST port 0x80.
+ */
+void io_wait() {
+    outb(0x80, 0);
+}
+
+/**
+ * @brief Translates a scancode (set 1) into an ASCII character.
  *
- * Special handling includes:
- * - Shift keys (left/right) for uppercase letters and symbols.
- * - Caps Lock toggle for letter case.
- * - Ignores non-character scancodes and key release events.
+ * Tracks the Shift and Caps Lock state. Key releases and keys without a
+ * character only update that state.
  *
- * @return The ASCII character corresponding to the pressed key.
+ * @param code Scancode read from the keyboard controller.
+ * @return The character, or 0 if the scancode does not produce one.
  */
-char read_char() {
-
+static char decode_scancode(uint8_t code) {
     // US QWERTY mapping
     static const char keymap[128] = {
         0, 27, '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '-', '=', '\b', '\t',
@@ -112,90 +384,458 @@ char read_char() {
         'A','S','D','F','G','H','J','K','L',':','"','~', 0, '|',
         'Z','X','C','V','B','N','M','<','>','?', 0, '*', 0, ' ', 0
     };
-    
-    while (1) {
-        // Wait for keyboard buffer to have data
-        if ((inb(0x64) & 1) == 0) continue;
 
-        uint8_t code = inb(0x60);
+    // Handle Shift press (0x2A = left shift, 0x36 = right shift)
+    if (code == 0x2A || code == 0x36) {
+        shift_pressed = 1;
+        return 0;
+    }
 
-        // Handle Shift press (0x2A = left shift, 0x36 = right shift)
-        if (code == 0x2A || code == 0x36) {
-            shift_pressed = 1;
-            continue;
-        }
+    // Handle Shift release (0xAA = left, 0xB6 = right)
+    if (code == 0xAA || code == 0xB6) {
+        shift_pressed = 0;
+        return 0;
+    }
 
-        // Handle Shift release (0xAA = left, 0xB6 = right)
-        if (code == 0xAA || code == 0xB6) {
-            shift_pressed = 0;
-            continue;
+    // Handle Caps Lock (toggle on 0x3A)
+    if (code == 0x3A) {
+        caps_lock_on = !caps_lock_on;
+        return 0;
+    }
+
+    // Ignore key releases (high bit set), including the 0xE0 prefix of extended keys
+    if (code & 0x80) return 0;
+
+    // Navigation keys (the dedicated keys send the same codes after an 0xE0 prefix)
+    switch (code) {
+    case 0x47: return KEY_HOME;
+    case 0x48: return KEY_UP;
+    case 0x49: return KEY_PAGE_UP;
+    case 0x4B: return KEY_LEFT;
+    case 0x4D: return KEY_RIGHT;
+    case 0x4F: return KEY_END;
+    case 0x50: return KEY_DOWN;
+    case 0x51: return KEY_PAGE_DOWN;
+    case 0x53: return KEY_DELETE;
+    }
+
+    char c = keymap[code]; // Always start from base map
+
+    // If it's a letter, apply Caps Lock and Shift logic
+    if (c >= 'a' && c <= 'z') {
+        if (caps_lock_on ^ shift_pressed) {
+            c = c - ('a' - 'A'); // Convert to uppercase
+        }
+    } else {
+        // For non-letter keys (like 1 -> !), use shift_keymap if Shift is pressed
+        if (shift_pressed) {
+            c = shift_keymap[code];
         }
+    }
+
+    return c;
+}
+
+/**
+ * @brief Queues a character of console input.
+ *
+ * Called by the keyboard and serial interrupt handlers. Interrupt handlers
+ * never nest, so there is a single producer at a time and the ring needs
+ * no lock. Characters arriving while the buffer is full are dropped. A task
+ * waiting in read_char() or read_line() is woken.
+ *
+ * @param c Character (or KEY_* code) to queue.
+ */
+void console_input(char c) {
+    if (input_head - input_tail < INPUT_BUFFER_SIZE) {
+        input_buffer[input_head & (INPUT_BUFFER_SIZE - 1)] = c;
+        __asm__ volatile ("" ::: "memory"); // Store the character before publishing it
+        input_head++;
+    }
+    wait_queue_wake(&input_waiters);
+}
+
+/**
+ * @brief IRQ 1 handler: reads the scancode and queues the decoded character.
+ */
+static void keyboard_irq(interrupt_frame_t* frame) {
+    (void)frame;
+
+    char c = decode_scancode(inb(0x60));
+    if (c) console_input(c);
+}
+
+/**
+ * @brief Installs the IRQ 1 handler and unmasks the keyboard line.
+ *
+ * The handler decodes scancodes into the console input ring that
+ * read_char() takes characters from. pic_remap() and init_idt() must
+ * have run.
+ */
+void init_keyboard() {
+    // Discard anything the controller buffered before the handler existed
+    while (inb(0x64) & 1) inb(0x60);
+
+    register_interrupt_handler(IRQ_BASE + IRQ_KEYBOARD, keyboard_irq);
+    pic_unmask(IRQ_KEYBOARD);
+}
+
+/**
+ * @brief Returns the next input character if one is queued.
+ *
+ * @return The character (0-255), or -1 if the input ring is empty.
+ */
+int try_read_char() {
+    if (input_tail == input_head) return -1;
+
+    uint8_t c = input_buffer[input_tail & (INPUT_BUFFER_SIZE - 1)];
+    __asm__ volatile ("" ::: "memory"); // Read the character before releasing its slot
+    input_tail++;
+    return c;
+}
+
+/**
+ * @brief Adds work to run while the system is idle.
+ *
+ * @param task Function doing a bounded amount of work; returns 1 if it has more to do.
+ * @return 1 on success, 0 if MAX_IDLE_TASKS tasks are registered already.
+ */
+int register_idle_task(idle_task_t task) {
+    if (idle_task_count == MAX_IDLE_TASKS) return 0;
+    idle_tasks[idle_task_count++] = task;
+    return 1;
+}
+
+/**
+ * @brief Drains the log ring to the console and runs each idle task once.
+ *
+ * Only one CPU runs them at a time; on the others this returns 0 at once.
+ *
+ * @return 1 if an idle task has more work left, 0 otherwise.
+ */
+int run_idle_tasks() {
+    // The idle tasks keep state of their own; another idle CPU finds them taken and goes back to sleep
+    if (!spin_trylock(&idle_lock)) return 0;
 
-        // Handle Caps Lock (toggle on 0x3A)
-        if (code == 0x3A) {
-            caps_lock_on = !caps_lock_on;
+    preempt_disable(); // A task woken meanwhile may be writing to the console too
+    klog_drain();
+    preempt_enable();
+
+    int busy = 0;
+    for (uint32_t i = 0; i < idle_task_count; i++) busy |= idle_tasks[i]();
+    spin_unlock(&idle_lock);
+    return busy;
+}
+
+/**
+ * @brief Waits until an interrupt has queued console input.
+ *
+ * With the scheduler running the task sleeps, and the idle thread does
+ * the idle work. Before that, waiting for input is idle time, so the log
+ * ring is drained and the idle tasks run first; the CPU only halts once
+ * none of them has work left.
+ */
+static void wait_for_input() {
+    if (sched_running()) {
+        // Checked under the queue lock, so a wakeup from another CPU cannot come in between
+        uint32_t flags = wait_queue_lock(&input_waiters);
+        while (input_tail == input_head) wait_queue_sleep(&input_waiters);
+        wait_queue_unlock(&input_waiters, flags);
+        return;
+    }
+
+    while (1) {
+        int busy = run_idle_tasks();
+
+        // Check and halt with interrupts off, so an IRQ cannot slip in between
+        __asm__ volatile ("cli" ::: "memory");
+        if (input_tail != input_head) break;
+        if (busy) {
+            irq_enable(); // More idle work first; input is checked again after each round
             continue;
         }
+        __asm__ volatile ("sti\n\thlt" ::: "memory"); // STI only takes effect after HLT has started
+    }
+    irq_enable();
+}
 
-        // Ignore key releases (high bit set)
-        if (code & 0x80) continue;
+/**
+ * @brief Waits for and returns the next ASCII character input from the keyboard.
+ *
+ * Characters are decoded by the keyboard interrupt handler (US QWERTY
+ * layout, with Shift and Caps Lock) and queued in a ring buffer, which
+ * the serial port feeds too. While the buffer is empty the calling task
+ * sleeps until an input interrupt wakes it, so waiting for input costs no
+ * CPU time; before init_scheduler() the CPU is halted instead, after the
+ * log ring is drained and the idle tasks have run. Interrupts must be enabled.
+ *
+ * @return The ASCII character corresponding to the pressed key.
+ */
+char read_char() {
+    int c;
+    while ((c = try_read_char()) < 0) wait_for_input();
+    return (char)c;
+}
+
+/**
+ * @brief Echoes one character of line editing without flushing VGA memory.
+ */
+static void echo_char(char c) {
+    if (console_outputs & CONSOLE_VGA) {
+        uint32_t flags = spin_lock_irqsave(&console_lock);
+        console_write(c);
+        spin_unlock_irqrestore(&console_lock, flags);
+    }
+    if (console_outputs & CONSOLE_SERIAL) {
+        if (c == '\n') serial_putc('\r');
+        serial_putc(c);
+    }
+}
 
-        char c = keymap[code]; // Always start from base map
+/**
+ * @brief Moves the echo cursor back by `n` characters (BS on the serial line).
+ */
+static void echo_left(uint32_t n) {
+    if (console_outputs & CONSOLE_VGA) {
+        uint32_t flags = spin_lock_irqsave(&console_lock);
+        console_cursor_left(n);
+        spin_unlock_irqrestore(&console_lock, flags);
+    }
+    if (console_outputs & CONSOLE_SERIAL) {
+        for (uint32_t i = 0; i < n; i++) serial_putc('\b');
+    }
+}
 
-        // If it's a letter, apply Caps Lock and Shift logic
-        if (c >= 'a' && c <= 'z') {
-            if (caps_lock_on ^ shift_pressed) {
-                c = c - ('a' - 'A'); // Convert to uppercase
-            }
-        } else {
-            // For non-letter keys (like 1 -> !), use shift_keymap if Shift is pressed
-            if (shift_pressed) {
-                c = shift_keymap[code];
-            }
+/**
+ * @brief Redraws the line from position `from` to its end and puts the cursor back at edit_pos.
+ *
+ * @param from  First character that changed.
+ * @param erase Number of cells after the new end of the line to blank (the line got shorter).
+ */
+static void echo_tail(uint32_t from, uint32_t erase) {
+    for (uint32_t i = from; i < edit_len; i++) echo_char(edit_line[i]);
+    for (uint32_t i = 0; i < erase; i++) echo_char(' ');
+    echo_left(edit_len + erase - edit_pos);
+}
+
+/**
+ * @brief Replaces the line being edited with a history entry (or an empty line).
+ */
+static void edit_replace(const char* text, uint32_t len) {
+    uint32_t old_len = edit_len;
+
+    echo_left(edit_pos);
+    memcpy(edit_line, text, len);
+    edit_len = len;
+    edit_pos = len; // Leave the cursor at the end, as after typing the line
+    echo_tail(0, old_len > len ? old_len - len : 0); // Only steps back over the blanked cells
+}
+
+/**
+ * @brief Shows an older (steps > 0) or newer (steps < 0) history entry.
+ */
+static void edit_history(int32_t steps) {
+    uint32_t available = history_count < LINE_HISTORY ? history_count : LINE_HISTORY;
+    int32_t browse = (int32_t)history_browse + steps;
+    if (browse < 0 || browse > (int32_t)available) return;
+
+    history_browse = browse;
+    if (!browse) {
+        edit_replace("", 0);
+        return;
+    }
+
+    const char* entry = history_lines[(history_count - browse) % LINE_HISTORY];
+    edit_replace(entry, strlen(entry));
+}
+
+/**
+ * @brief Applies one input character to the line being edited.
+ *
+ * @param c     Character or KEY_* code.
+ * @param limit Longest line the caller can take.
+ * @return 1 if the character completed the line, 0 otherwise.
+ */
+static int edit_key(char c, uint32_t limit) {
+    // \r\n from a terminal is a single Enter
+    if (c == '\n' && edit_last_cr) {
+        edit_last_cr = 0;
+        return 0;
+    }
+    edit_last_cr = c == '\r';
+
+    // ANSI escape sequences from a serial terminal: ESC [ A/B/C/D/H/F, ESC [ 3 ~
+    if (edit_escape == 1) {
+        edit_escape = c == '[' ? 2 : 0;
+        return 0;
+    }
+    if (edit_escape == 2) {
+        edit_escape = 0;
+        switch (c) {
+        case 'A': c = KEY_UP; break;
+        case 'B': c = KEY_DOWN; break;
+        case 'C': c = KEY_RIGHT; break;
+        case 'D': c = KEY_LEFT; break;
+        case 'H': c = KEY_HOME; break;
+        case 'F': c = KEY_END; break;
+        case '3': edit_escape = 3; return 0;
+        default: return 0;
         }
+    } else if (edit_escape == 3) {
+        edit_escape = 0;
+        if (c != '~') return 0;
+        c = KEY_DELETE;
+    }
 
-        return c;
+    switch (c) {
+    case '\r':
+    case '\n':
+        return 1;
+    case 27:
+        edit_escape = 1;
+        break;
+    case '\b':
+    case 0x7F: // DEL, sent by most terminals for Backspace
+        if (!edit_pos) break;
+        edit_pos--;
+        echo_left(1);
+        memmove(&edit_line[edit_pos], &edit_line[edit_pos + 1], edit_len - edit_pos - 1);
+        edit_len--;
+        echo_tail(edit_pos, 1);
+        break;
+    case KEY_DELETE:
+        if (edit_pos == edit_len) break;
+        memmove(&edit_line[edit_pos], &edit_line[edit_pos + 1], edit_len - edit_pos - 1);
+        edit_len--;
+        echo_tail(edit_pos, 1);
+        break;
+    case KEY_LEFT:
+        if (edit_pos) {
+            edit_pos--;
+            echo_left(1);
+        }
+        break;
+    case KEY_RIGHT:
+        if (edit_pos < edit_len) echo_char(edit_line[edit_pos++]);
+        break;
+    case KEY_HOME:
+        echo_left(edit_pos);
+        edit_pos = 0;
+        break;
+    case KEY_END:
+        while (edit_pos < edit_len) echo_char(edit_line[edit_pos++]);
+        break;
+    case KEY_UP:
+        edit_history(1);
+        break;
+    case KEY_DOWN:
+        edit_history(-1);
+        break;
+    case KEY_PAGE_UP:
+    case KEY_PAGE_DOWN:
+        // Browse the scrollback without touching the line
+        console_scroll_view(c == KEY_PAGE_UP ? SCREEN_ROWS / 2 : -(SCREEN_ROWS / 2));
+        break;
+    default:
+        if ((uint8_t)c < ' ' || edit_len >= limit) break; // Unprintable, or no room left
+
+        memmove(&edit_line[edit_pos + 1], &edit_line[edit_pos], edit_len - edit_pos);
+        edit_line[edit_pos] = c;
+        edit_len++;
+        if (edit_pos + 1 == edit_len) {
+            echo_char(c); // Typing at the end (the usual case) echoes just the new character
+            edit_pos++;
+        } else {
+            edit_pos++;
+            echo_tail(edit_pos - 1, 0);
+        }
+        break;
     }
+    return 0;
 }
 
 /**
- * @brief Reads a line of input from the keyboard until ENTER is pressed
- *        or the buffer is full. Echoes typed characters to the screen.
+ * @brief Processes the queued input and returns a line once Enter has been received.
  *
- * Input stops when a newline character ('\n') is received or when the buffer
- * reaches its maximum capacity (max_len - 1), leaving space for the null terminator.
- * In either case, a newline is printed to the screen.
+ * Never blocks: the line being edited is kept between calls. Supports
+ * Backspace, Delete, Left/Right, Home/End, Up/Down through the last
+ * LINE_HISTORY lines and Page Up/Down through the scrollback, from the
+ * keyboard or as ANSI sequences from a serial terminal. Only the cells
+ * that change are redrawn, so typing or pasting at the end of the line
+ * costs one echo per character. Characters beyond the buffer are refused
+ * (not echoed) rather than cut off later.
  *
  * @param buf Pointer to the buffer where the input line will be stored.
  * @param max_len Maximum size of the buffer including space for the null terminator.
+ * @return Length of the line, or -1 if no complete line is available yet.
  */
-void read_line(char* buf, int max_len) {
-    int i = 0;
+int try_read_line(char* buf, int max_len) {
+    if (max_len <= 0) return -1;
 
-    while (1) {
-        char c = read_char();
+    uint32_t limit = (uint32_t)max_len - 1;
+    if (limit > LINE_MAX - 1) limit = LINE_MAX - 1;
 
-        if (c == '\n' || i == max_len - 1) {
-            putc('\n');
-            break;
-        }
+    int done = 0;
+    int c;
+    while (!done && (c = try_read_char()) >= 0) done = edit_key((char)c, limit);
+
+    if (done) {
+        while (edit_pos < edit_len) echo_char(edit_line[edit_pos++]); // Leave the cursor after the line
+        echo_char('\n');
+    }
+    if (console_outputs & CONSOLE_VGA) console_flush();
+    if (!done) return -1;
+
+    // Hand the line over, cut to this caller's buffer if an earlier one allowed more
+    uint32_t len = edit_len < limit ? edit_len : limit;
+    memcpy(buf, edit_line, len);
+    buf[len] = '\0';
 
-        buf[i++] = c;
-        putc(c);
+    // Remember it, unless it is empty or repeats the previous entry
+    if (len) {
+        const char* last = history_lines[(history_count - 1) % LINE_HISTORY];
+        if (!history_count || strcmp(last, buf)) {
+            memcpy(history_lines[history_count % LINE_HISTORY], buf, len + 1);
+            history_count++;
+        }
     }
 
-    buf[i] = '\0'; // Null-terminate the input string
+    edit_len = 0;
+    edit_pos = 0;
+    edit_escape = 0;
+    history_browse = 0;
+    return len;
+}
+
+/**
+ * @brief Reads a line of input, with line editing and history, until Enter is pressed.
+ *
+ * Waits (asleep, as read_char() does) for input and edits the line as try_read_line() does.
+ * Once the buffer is full, further characters are refused until Enter.
+ *
+ * @param buf Pointer to the buffer where the input line will be stored.
+ * @param max_len Maximum size of the buffer including space for the null terminator.
+ * @return Length of the line.
+ */
+int read_line(char* buf, int max_len) {
+    int len;
+    while ((len = try_read_line(buf, max_len)) < 0) wait_for_input();
+    return len;
 }
 
 /**
  * @brief Clears the entire VGA text screen and resets the cursor.
+ *
+ * Lines that scrolled off earlier stay in the scrollback.
  */
 void clrscr() {
-    for (uint32_t r = 0; r < 25; r++) {
-        for (uint32_t c = 0; c < 80; c++) {
-            vga[r * 80 + c] = (color << 8) | ' ';
-        }
-    }
+    uint32_t flags = spin_lock_irqsave(&console_lock);
+    for (uint32_t r = 0; r < SCREEN_ROWS; r++) memset16(screen_line(r), (color << 8) | ' ', SCREEN_COLS);
     row = 0;
     col = 0;
+    view_offset = 0;
+
+    mark_all_dirty();
+    vga_flush();
+    spin_unlock_irqrestore(&console_lock, flags);
 }
@@ -0,0 +1,110 @@
+global isr_stub_table   ;Table of the stub addresses, used by init_idt() to fill in the IDT.
+extern isr_dispatch     ;C dispatcher defined in idt.c.
+
+section .text           ;Marks the beginning of the code section.
+bits 32                 ;Assembles this file in 32-bit mode.
+
+;Stub for a vector where the CPU pushes no error code: push a 0 so every frame has the same layout.
+%macro ISR_NOERR 1
+isr_stub_%1:
+    push dword 0        ;Dummy error code.
+    push dword %1       ;Vector number.
+    jmp isr_common
+%endmacro
+
+;Stub for a vector where the CPU has already pushed an error code.
+%macro ISR_ERR 1
+isr_stub_%1:
+    push dword %1       ;Vector number.
+    jmp isr_common
+%endmacro
+
+;CPU exceptions 0-31. Vectors 8, 10-14, 17, 21, 29 and 30 come with an error code.
+ISR_NOERR 0
+ISR_NOERR 1
+ISR_NOERR 2
+ISR_NOERR 3
+ISR_NOERR 4
+ISR_NOERR 5
+ISR_NOERR 6
+ISR_NOERR 7
+ISR_ERR   8
+ISR_NOERR 9
+ISR_ERR   10
+ISR_ERR   11
+ISR_ERR   12
+ISR_ERR   13
+ISR_ERR   14
+ISR_NOERR 15
+ISR_NOERR 16
+ISR_ERR   17
+ISR_NOERR 18
+ISR_NOERR 19
+ISR_NOERR 20
+ISR_ERR   21
+ISR_NOERR 22
+ISR_NOERR 23
+ISR_NOERR 24
+ISR_NOERR 25
+ISR_NOERR 26
+ISR_NOERR 27
+ISR_NOERR 28
+ISR_ERR   29
+ISR_ERR   30
+ISR_NOERR 31
+
+;Hardware interrupts (IRQ 0-15, remapped to vectors 32-47 by pic_remap()).
+ISR_NOERR 32
+ISR_NOERR 33
+ISR_NOERR 34
+ISR_NOERR 35
+ISR_NOERR 36
+ISR_NOERR 37
+ISR_NOERR 38
+ISR_NOERR 39
+ISR_NOERR 40
+ISR_NOERR 41
+ISR_NOERR 42
+ISR_NOERR 43
+ISR_NOERR 44
+ISR_NOERR 45
+ISR_NOERR 46
+ISR_NOERR 47
+
+;Local APIC interrupts (timer, inter-processor interrupts and the spurious vector 63, see lapic.h).
+ISR_NOERR 48
+ISR_NOERR 49
+ISR_NOERR 50
+ISR_NOERR 51
+ISR_NOERR 52
+ISR_NOERR 53
+ISR_NOERR 54
+ISR_NOERR 55
+ISR_NOERR 56
+ISR_NOERR 57
+ISR_NOERR 58
+ISR_NOERR 59
+ISR_NOERR 60
+ISR_NOERR 61
+ISR_NOERR 62
+ISR_NOERR 63
+
+;Saves the general purpose registers, calls isr_dispatch(frame) and returns from the interrupt.
+isr_common:
+    pusha               ;Save EAX, ECX, EDX, EBX, ESP, EBP, ESI, EDI (the frame now matches interrupt_frame_t).
+    cld                 ;The C code expects the direction flag to be clear.
+    push esp            ;Pass a pointer to the frame.
+    call isr_dispatch
+    add esp, 4          ;Drop the argument.
+    popa                ;Restore the registers (possibly modified by the handler).
+    add esp, 8          ;Drop the vector number and error code.
+    iret                ;Return to the interrupted code.
+
+section .rodata         ;Read-only data.
+
+isr_stub_table:
+%assign i 0
+%rep 64
+    dd isr_stub_%+i     ;Address of the stub for vector i.
+%assign i i+1
+%endrep
@@ -1,34 +1,354 @@
 #include "io.h"
+#include "idt.h"
+#include "pic.h"
+#include "cpu.h"
+#include "kprintf.h"
 #include "memory.h"
+#include "serial.h"
+#include "slab.h"
+#include "pool.h"
+#include "string.h"
+#include "bench.h"
+#include "trace.h"
+#include "sched.h"
+#include "timer.h"
+#include "percpu.h"
+#include "smp.h"
+
+#define QEMU_EXIT_PORT 0xF4 // QEMU isa-debug-exit device: writing v exits QEMU with status (v << 1) | 1
+
+extern char stack_top[]; // Top of the boot stack (boot.asm)
+
+static char boot_command_line[128]; // Command line GRUB passed to the kernel (e.g. "bench")
+static arena_t shell_arena;         // Scratch memory for the command run() is executing; reset after each one
+
+/**
+ * @brief Copy the boot command line (Multiboot2 tag type 1) into boot_command_line.
+ *
+ * @param multiboot_info Pointer to the start of the Multiboot information structure.
+ */
+static void read_command_line(uint8_t* multiboot_info) {
+    multiboot_tag* tag = (multiboot_tag*)(multiboot_info + 8); // Skip total_size and reserved
+
+    while (tag->type != 0) {
+        if (tag->type == MULTIBOOT_TAG_CMDLINE) {
+            const char* s = (const char*)tag + 8;
+            uint32_t len = strlen(s);
+            if (len > sizeof(boot_command_line) - 1) len = sizeof(boot_command_line) - 1;
+            memcpy(boot_command_line, s, len);
+            boot_command_line[len] = '\0';
+            return;
+        }
+        tag = (multiboot_tag*)((uint8_t*)tag + ((tag->size + 7) & ~7)); // Tags are 8-byte aligned
+    }
+}
+
+/**
+ * @brief Check whether a space-separated word of the boot command line equals `option`.
+ */
+static int has_boot_option(const char* option) {
+    uint32_t len = strlen(option);
+    const char* p = boot_command_line;
+
+    while (*p) {
+        while (*p == ' ') p++;
+        if (!strncmp(p, option, len) && (p[len] == ' ' || p[len] == '\0')) return 1;
+        while (*p && *p != ' ') p++;
+    }
+    return 0;
+}
+
+/**
+ * @brief Print allocator counters (two lines, without the final newline).
+ *
+ * @param c    Counters to print.
+ * @param unit Unit of the in-use and high-water figures (e.g. "pages").
+ */
+static void print_counters(const alloc_counters_t* c, const char* unit) {
+    kprintf("  allocs: %u  frees: %u  failed: %u\n", c->allocs, c->frees, c->failed_allocs);
+    kprintf("  in use: %u %s  high water: %u %s", c->in_use, unit, c->high_water, unit);
+}
 
 /**
- * @brief Compare two null-terminated strings for equality.
+ * @brief Print the non-empty buckets of a latency histogram.
  *
- * @param a Pointer to the first string.
- * @param b Pointer to the second string.
- * @return 1 if the strings are equal, 0 otherwise.
+ * @param name Name of the measured function.
+ * @param h    Histogram to print.
  */
-int streq(const char* a, const char* b) {
-    while (*a && *b) {
-        if (*a != *b) return 0;
-        a++; b++;
+static void print_latency(const char* name, const latency_histogram_t* h) {
+    kprintf("%s latency (cycles):", name);
+    for (uint32_t i = 0; i < LATENCY_BUCKETS; i++) {
+        if (!h->buckets[i]) continue;
+        if (i == 0) {
+            kprintf(" <%u", 1u << (LATENCY_MIN_SHIFT + 1));
+        } else if (i == LATENCY_BUCKETS - 1) {
+            kprintf(" >=%u", 1u << (LATENCY_MIN_SHIFT + i));
+        } else {
+            kprintf(" %u+", 1u << (LATENCY_MIN_SHIFT + i));
+        }
+        kprintf(":%u", h->buckets[i]);
     }
-    return *a == *b;
+    print("\n");
+}
+
+/**
+ * @brief Print allocator statistics (the "meminfo" command).
+ */
+void meminfo() {
+    memory_stats_t st;
+    get_memory_stats(&st);
+
+    kprintf("Physical pages: total: %u  free: %u  per-CPU cached: %u  pre-zeroed: %u\n",
+            st.total_pages, st.free_pages, st.cached_pages, st.zeroed_pages);
+    if (st.high_pages) kprintf("  high memory: %u  free: %u\n", st.high_pages, st.free_high_pages);
+    print_counters(&st.pages, "pages");
+    if (st.check_failures) kprintf("  PMM check failures: %u", st.check_failures);
+    print("\n");
+
+    kprintf("Kernel heap: break %p  mapped: %u bytes\n", (void*)st.heap_break, st.heap_mapped_bytes);
+    print_counters(&st.heap, "bytes");
+    print("\n");
+    kprintf("  free list: %u blocks, %u bytes, largest %u", st.free_blocks, st.free_bytes, st.largest_free_block);
+    if (st.free_bytes >= 100) {
+        // Share of free-list space that a single allocation cannot use
+        uint32_t usable = st.largest_free_block / (st.free_bytes / 100);
+        if (usable > 100) usable = 100;
+        kprintf(", fragmentation %u%%", 100 - usable);
+    }
+    print("\n");
+
+    print_latency("alloc_page", &st.page_latency);
+    print_latency("kmalloc", &st.kmalloc_latency);
+}
+
+typedef void (*command_fn)(int argc, char** argv);
+
+typedef struct {
+    const char* name;  // Word that runs the command
+    const char* args;  // Argument synopsis shown by "help" ("" if none)
+    const char* help;  // One-line description shown by "help"
+    command_fn handler;
+} command_t;
+
+static void cmd_bench(int argc, char** argv);
+static void cmd_clear(int argc, char** argv);
+static void cmd_dmesg(int argc, char** argv);
+static void cmd_help(int argc, char** argv);
+static void cmd_meminfo(int argc, char** argv);
+static void cmd_ps(int argc, char** argv);
+static void cmd_trace(int argc, char** argv);
+
+// Shell commands, sorted by name so run() can binary search them
+static const command_t commands[] = {
+    { "bench",   "[name]",         "Run all benchmarks, or those starting with name",  cmd_bench },
+    { "clear",   "",               "Clear the screen",                                 cmd_clear },
+    { "dmesg",   "",               "Print the kernel log",                             cmd_dmesg },
+    { "help",    "[command]",      "List commands, or describe one",                   cmd_help },
+    { "meminfo", "",               "Print memory allocator statistics",                cmd_meminfo },
+    { "ps",      "",               "List tasks with their state and CPU time",         cmd_ps },
+    { "trace",   "[n|clear|send]", "Print the last n trace events, clear or send them", cmd_trace },
+};
+
+#define COMMAND_COUNT (sizeof(commands) / sizeof(commands[0]))
+
+/**
+ * @brief Find a command by name with a binary search of the sorted table.
+ *
+ * @param name Command name.
+ * @return The table entry, or NULL if there is no such command.
+ */
+static const command_t* find_command(const char* name) {
+    uint32_t lo = 0, hi = COMMAND_COUNT;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        int order = strcmp(name, commands[mid].name);
+        if (!order) return &commands[mid];
+        if (order < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Check that the command table is sorted, which find_command() relies on.
+ */
+static void check_command_table() {
+    for (uint32_t i = 1; i < COMMAND_COUNT; i++) {
+        if (strcmp(commands[i - 1].name, commands[i].name) >= 0)
+            klog(LOG_ERROR, "shell: command table not sorted at \"%s\"", commands[i].name);
+    }
+}
+
+/**
+ * @brief Print one command's synopsis and description.
+ */
+static void print_command_help(const command_t* c) {
+    int len = kprintf("  %s %s", c->name, c->args);
+    for (; len < 24; len++) putc(' '); // Line the descriptions up
+    kprintf("%s\n", c->help);
+}
+
+static void cmd_help(int argc, char** argv) {
+    if (argc > 1) {
+        const command_t* c = find_command(argv[1]);
+        if (c) {
+            print_command_help(c);
+        } else {
+            kprintf("help: no command \"%s\"\n", argv[1]);
+        }
+        return;
+    }
+
+    print("Commands:\n");
+    for (uint32_t i = 0; i < COMMAND_COUNT; i++) print_command_help(&commands[i]);
+}
+
+static void cmd_bench(int argc, char** argv) {
+    const char* prefix = argc > 1 ? argv[1] : "";
+    if (!bench_run_matching(prefix)) kprintf("bench: no benchmark matches \"%s\"\n", prefix);
+}
+
+static void cmd_clear(int argc, char** argv) {
+    (void)argc; (void)argv;
+    clrscr();
+}
+
+static void cmd_dmesg(int argc, char** argv) {
+    (void)argc; (void)argv;
+    klog_dump();
+}
+
+static void cmd_meminfo(int argc, char** argv) {
+    (void)argc; (void)argv;
+    meminfo();
+}
+
+static void cmd_ps(int argc, char** argv) {
+    (void)argc; (void)argv;
+    static const char* const state_names[] = { "run", "wait", "sleep", "dead" };
+
+    task_info_t tasks[MAX_TASK_INFO];
+    uint32_t count = sched_get_tasks(tasks, MAX_TASK_INFO);
+    kprintf("%u tasks, %u context switches, %u ticks at %u Hz\n", count, sched_switch_count(), timer_ticks(), TIMER_HZ);
+
+    print("   ID PRI CPU STATE      TICKS   SWITCHES NAME\n");
+    for (uint32_t i = 0; i < count; i++) {
+        kprintf("%5u %3u %3u %5s %10u %10u %s\n", tasks[i].id, tasks[i].priority, tasks[i].cpu, state_names[tasks[i].state],
+                tasks[i].ticks, tasks[i].switches, tasks[i].name);
+    }
+}
+
+static void cmd_trace(int argc, char** argv) {
+#ifndef TRACE
+    print("trace: trace points are compiled out (build with TRACE=1)\n");
+#endif
+
+    if (argc < 2) {
+        trace_dump(0);
+    } else if (!strcmp(argv[1], "clear")) {
+        trace_clear();
+    } else if (!strcmp(argv[1], "send")) {
+        // Keep console text out of the binary stream while it is sent
+        uint32_t outputs = console_set_outputs(CONSOLE_VGA);
+        if (!(outputs & CONSOLE_SERIAL) && !init_serial(SERIAL_BAUD)) {
+            console_set_outputs(outputs);
+            print("trace: no serial port\n");
+            return;
+        }
+        uint32_t count = trace_send();
+        console_set_outputs(outputs);
+        kprintf("trace: sent %u events\n", count);
+    } else {
+        uint32_t max = 0;
+        for (const char* p = argv[1]; *p; p++) {
+            if (*p < '0' || *p > '9') {
+                kprintf("trace: bad argument \"%s\"\n", argv[1]);
+                return;
+            }
+            max = max * 10 + (*p - '0');
+            if (max > TRACE_RING_ENTRIES) max = TRACE_RING_ENTRIES; // The ring holds no more; also keeps max from wrapping
+        }
+        trace_dump(max); // 0 prints them all, as with no argument
+    }
+}
+
+/**
+ * @brief Split a command line in place into words separated by spaces or tabs.
+ *
+ * @param line Line to split; separators are overwritten with null terminators.
+ * @param argv Receives pointers to the words.
+ * @param max  Room in argv.
+ * @return Number of words; any beyond `max` are ignored.
+ */
+static int split_args(char* line, char** argv, int max) {
+    int argc = 0;
+    while (*line) {
+        while (*line == ' ' || *line == '\t') *line++ = '\0';
+        if (!*line) break;
+        if (argc == max) break;
+
+        argv[argc++] = line;
+        while (*line && *line != ' ' && *line != '\t') line++;
+    }
+    return argc;
 }
 
 /**
  * @brief Interpret and execute a command string.
- * Currently supports only the "help, clear" command.
+ *
+ * The first word selects an entry of the command table; the handler gets
+ * all the words as argc/argv. An empty line does nothing. The copy of the
+ * line and argv live in shell_arena, which is reset once the command is
+ * done, so lines of any length are split without a fixed buffer.
  *
  * @param cmd Pointer to the command string.
  */
 void run(const char* cmd) {
-    if (streq(cmd, "help")) {
-        print("Commands: help, clear\n");
-    } else if (streq(cmd, "clear")) {
-        clrscr();
-    } else
-        print("Unknown command\n");
+    uint32_t len = strlen(cmd);
+    int max_args = len / 2 + 1; // Words need a separator between them
+    char* line = arena_alloc(&shell_arena, len + 1);
+    char** argv = arena_alloc(&shell_arena, max_args * sizeof(char*));
+    if (!line || !argv) {
+        print("shell: out of memory\n");
+        arena_reset(&shell_arena);
+        return;
+    }
+    memcpy(line, cmd, len + 1);
+
+    int argc = split_args(line, argv, max_args);
+    if (argc) {
+        const command_t* c = find_command(argv[0]);
+        if (c) {
+            c->handler(argc, argv);
+        } else {
+            kprintf("Unknown command \"%s\" (try \"help\")\n", argv[0]);
+        }
+    }
+
+    arena_reset(&shell_arena);
+}
+
+/**
+ * @brief Halts with a message unless the multiboot information lies within the boot mapping.
+ *
+ * Until init_physical_allocator() completes the direct map, only the first
+ * BOOT_MAP_SIZE of physical memory is mapped at KERNEL_VIRTUAL_BASE, and a
+ * page fault this early (before init_idt()) would triple fault silently.
+ *
+ * @param multiboot_info Physical address GRUB passed.
+ */
+static void check_multiboot_info(uint32_t multiboot_info) {
+    if (multiboot_info <= BOOT_MAP_SIZE - 8) { // total_size and reserved must be mapped to be read
+        uint32_t total_size = *(uint32_t*)phys_to_virt(multiboot_info);
+        if (total_size <= BOOT_MAP_SIZE - multiboot_info) return;
+    }
+
+    klog(LOG_ERROR, "boot: multiboot information at %p is not in the first %u MiB", (void*)multiboot_info,
+         BOOT_MAP_SIZE >> 20);
+    while (1) asm volatile("cli\n\thlt");
 }
 
 /**
@@ -36,13 +356,54 @@ void run(const char* cmd) {
  * Initializes the shell loop and handles user input.
  */
 void kernel_main(uint32_t multiboot_info) {
+    // Load this CPU's GDT, TSS and per-CPU segment before anything uses this_cpu()
+    cpu_init(0, (uint32_t)stack_top);
     clrscr(); // Clear screen
-    // Parse memory map
-    parse_memory_map((uint8_t*) multiboot_info);
+    // Parse memory map and boot options (GRUB passes a physical address; boot.asm mapped it at KERNEL_VIRTUAL_BASE)
+    check_multiboot_info(multiboot_info);
+    parse_memory_map((uint8_t*) phys_to_virt(multiboot_info));
+    read_command_line((uint8_t*) phys_to_virt(multiboot_info));
     // Initialize physical memory allocator (sets up page_bitmap, marks used pages)
     init_physical_allocator();
+    // Install the exception handlers
+    init_idt();
+    // Use SSE2 for bulk memset/memcpy when built with STRING_SSE and the CPU has it
+    if (init_string_sse()) klog(LOG_INFO, "string: SSE2 bulk copies enabled");
     // Setup paging by initializing the page directory
     setup_paging();
+    // Set up the kmalloc size-class caches
+    init_slab_allocator();
+    // Clear frames for alloc_zeroed_page() while the shell waits for input
+    register_idle_task(refill_zeroed_pages);
+    // Route hardware interrupts past the exception vectors, then take keyboard input by IRQ
+    pic_remap();
+    init_keyboard();
+    // Turn this code into the first task and preempt it on timer ticks; read_char() now sleeps instead of halting
+    if (!init_scheduler()) klog(LOG_ERROR, "sched: out of memory, running without the scheduler");
+    init_timer(TIMER_HZ);
+    // Mirror the console to COM1 for headless runs; "bench" boots (make bench) always report there
+    int bench_mode = has_boot_option("bench");
+    int serial_console = bench_mode;
+#ifdef SERIAL_CONSOLE
+    serial_console = 1;
+#endif
+    if (serial_console && init_serial(SERIAL_BAUD)) console_set_outputs(CONSOLE_VGA | CONSOLE_SERIAL);
+    irq_enable();
+    // Start the other CPUs listed by ACPI; they take tasks from the run queues
+    init_smp();
+    // Nothing reads the ACPI tables any more, so their memory can be allocated
+    reclaim_acpi_memory();
+
+    if (bench_mode) {
+        // Run every benchmark, then leave QEMU with the outcome (status 1 = success, 3 = failure)
+        uint32_t count = bench_run_matching("");
+        kprintf("bench: done, %u benchmarks\n", count);
+        serial_flush();
+        outb(QEMU_EXIT_PORT, count ? 0 : 1);
+        // Not under QEMU: carry on to the shell
+    }
+
+    check_command_table();
 
     print("Welcome to GeeOS\n");
     char buf[128]; // Buffer to hold user input
@@ -0,0 +1,287 @@
+#include "kprintf.h"
+#include "io.h"
+#include "cpu.h"
+#include "string.h"
+
+log_entry_t klog_ring[LOG_RING_ENTRIES];      // Message ring; entry i is at klog_ring[i % LOG_RING_ENTRIES]
+static volatile uint32_t log_head = 0;        // Sequence number the next message gets
+static uint32_t log_tail = 0;                 // Sequence number of the next message to drain
+static volatile uint32_t log_level = LOG_INFO; // Most verbose level kept
+static volatile uint32_t draining = 0;        // Set while klog_drain() runs, so it is never re-entered
+
+static log_sink_t sinks[LOG_MAX_SINKS] = { print }; // Outputs the ring is drained to
+static uint32_t sink_count = 1;
+
+static const char* level_names[] = { "error", "warn", "info", "debug" };
+
+// Output state shared by the kvsnprintf() helpers
+typedef struct {
+    char* buf;     // Output buffer
+    uint32_t size; // Size of the buffer
+    uint32_t len;  // Characters produced so far (may exceed size)
+} format_out_t;
+
+/**
+ * @brief Appends one character, keeping room for the terminator.
+ */
+static void out_char(format_out_t* out, char c) {
+    if (out->len + 1 < out->size) out->buf[out->len] = c;
+    out->len++;
+}
+
+/**
+ * @brief Appends an unsigned number in a base, padded to a field width.
+ *
+ * @param out      Output state.
+ * @param value    Number to print.
+ * @param base     10 or 16.
+ * @param upper    Non-zero for uppercase hex digits.
+ * @param negative Non-zero to print a minus sign before the number.
+ * @param width    Minimum field width.
+ * @param pad      '0' or ' '.
+ */
+static void out_number(format_out_t* out, uint32_t value, uint32_t base, int upper, int negative, uint32_t width, char pad) {
+    const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    char tmp[10]; // Up to 10 decimal digits for a 32-bit value
+    uint32_t n = 0;
+
+    do {
+        tmp[n++] = digits[value % base];
+        value /= base;
+    } while (value);
+
+    uint32_t len = n + (negative ? 1 : 0);
+    if (negative && pad == '0') out_char(out, '-'); // The sign goes before zero padding
+    for (; len < width; len++) out_char(out, pad);
+    if (negative && pad != '0') out_char(out, '-');
+    while (n) out_char(out, tmp[--n]);
+}
+
+/**
+ * @brief Formats a string into a buffer.
+ *
+ * Supports %d, %i, %u, %x, %X, %p, %s, %c and %%, with an optional '0'
+ * flag and field width (e.g. %08x). An 'l' length modifier is accepted
+ * and ignored, since long is 32 bits.
+ *
+ * @param buf  Output buffer.
+ * @param size Size of the buffer; the output is cut to size - 1 characters and terminated.
+ * @param fmt  Format string.
+ * @param ap   Arguments.
+ * @return Number of characters the full output has (excluding the terminator).
+ */
+int kvsnprintf(char* buf, uint32_t size, const char* fmt, va_list ap) {
+    format_out_t out = { buf, size, 0 };
+
+    for (; *fmt; fmt++) {
+        if (*fmt != '%') {
+            out_char(&out, *fmt);
+            continue;
+        }
+        fmt++;
+
+        // Flags and field width
+        char pad = ' ';
+        uint32_t width = 0;
+        if (*fmt == '0') {
+            pad = '0';
+            fmt++;
+        }
+        while (*fmt >= '0' && *fmt <= '9') width = width * 10 + (*fmt++ - '0');
+        while (*fmt == 'l') fmt++;
+
+        switch (*fmt) {
+        case 'd':
+        case 'i': {
+            int32_t value = va_arg(ap, int32_t);
+            out_number(&out, value < 0 ? -(uint32_t)value : (uint32_t)value, 10, 0, value < 0, width, pad);
+            break;
+        }
+        case 'u':
+            out_number(&out, va_arg(ap, uint32_t), 10, 0, 0, width, pad);
+            break;
+        case 'x':
+        case 'X':
+            out_number(&out, va_arg(ap, uint32_t), 16, *fmt == 'X', 0, width, pad);
+            break;
+        case 'p':
+            out_char(&out, '0');
+            out_char(&out, 'x');
+            out_number(&out, (uint32_t)va_arg(ap, void*), 16, 0, 0, 8, '0');
+            break;
+        case 's': {
+            const char* s = va_arg(ap, const char*);
+            if (!s) s = "(null)";
+            uint32_t len = strlen(s);
+            for (; len < width; len++) out_char(&out, ' ');
+            while (*s) out_char(&out, *s++);
+            break;
+        }
+        case 'c':
+            out_char(&out, (char)va_arg(ap, int));
+            break;
+        case '%':
+            out_char(&out, '%');
+            break;
+        case '\0':
+            fmt--; // Lone '%' at the end of the string
+            break;
+        default:
+            // Unknown conversion: print it as is
+            out_char(&out, '%');
+            out_char(&out, *fmt);
+            break;
+        }
+    }
+
+    if (size) buf[out.len < size ? out.len : size - 1] = '\0';
+    return out.len;
+}
+
+/**
+ * @brief Formats a string into a buffer; see kvsnprintf().
+ */
+int ksnprintf(char* buf, uint32_t size, const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int len = kvsnprintf(buf, size, fmt, ap);
+    va_end(ap);
+    return len;
+}
+
+/**
+ * @brief Formats a string and prints it on the console right away; see kvsnprintf().
+ *
+ * @return Number of characters printed.
+ */
+int kprintf(const char* fmt, ...) {
+    char buf[KPRINTF_BUFFER_SIZE];
+
+    va_list ap;
+    va_start(ap, fmt);
+    int len = kvsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+
+    print(buf);
+    return len < (int)sizeof(buf) ? len : (int)sizeof(buf) - 1;
+}
+
+/**
+ * @brief Logs a formatted message; use the klog() macro instead.
+ *
+ * Claims the next sequence number with an atomic add, so interrupt handlers
+ * can log while other code is in the middle of a message, formats straight
+ * into the ring entry and publishes it by storing its sequence number last.
+ */
+void klog_write(uint32_t level, const char* fmt, ...) {
+    if (level > log_level) return;
+
+    uint32_t seq = __atomic_fetch_add(&log_head, 1, __ATOMIC_RELAXED);
+    log_entry_t* entry = &klog_ring[seq & (LOG_RING_ENTRIES - 1)];
+
+    entry->seq = 0; // Incomplete until the sequence number is stored below
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+    entry->level = level;
+    entry->timestamp = rdtsc();
+
+    va_list ap;
+    va_start(ap, fmt);
+    kvsnprintf(entry->text, LOG_MESSAGE_MAX, fmt, ap);
+    va_end(ap);
+
+    __atomic_store_n(&entry->seq, seq + 1, __ATOMIC_RELEASE);
+
+    // Errors may come right before a hang, so do not wait for the system to go idle
+    if (level == LOG_ERROR) klog_drain();
+}
+
+/**
+ * @brief Sets the most verbose level klog() keeps (LOG_INFO by default).
+ *
+ * @param level LOG_* level.
+ */
+void klog_set_level(uint32_t level) {
+    log_level = level;
+}
+
+/**
+ * @brief Adds an output the log ring is drained to.
+ *
+ * The console is registered by default.
+ *
+ * @param sink Function printing a string.
+ * @return 1 on success, 0 if LOG_MAX_SINKS outputs are registered already.
+ */
+int klog_add_sink(log_sink_t sink) {
+    if (sink_count == LOG_MAX_SINKS) return 0;
+    sinks[sink_count++] = sink;
+    return 1;
+}
+
+/**
+ * @brief Copies a complete ring entry and formats it as a line.
+ *
+ * @param seq  Sequence number of the message.
+ * @param line Receives "[level] text\n".
+ * @return 1 if the entry held that message, 0 if it is incomplete or was overwritten.
+ */
+static int format_entry(uint32_t seq, char* line, uint32_t size) {
+    log_entry_t* entry = &klog_ring[seq & (LOG_RING_ENTRIES - 1)];
+    if (__atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE) != seq + 1) return 0;
+
+    uint32_t level = entry->level < 4 ? entry->level : LOG_DEBUG;
+    ksnprintf(line, size, "[%s] %s\n", level_names[level], entry->text);
+
+    // A producer that wrapped around while the entry was copied invalidates the copy
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    return entry->seq == seq + 1;
+}
+
+/**
+ * @brief Writes all messages logged since the last drain to the sinks.
+ *
+ * Messages older than the ring can hold are reported as a count of lost
+ * messages. Stops at a message that is still being written (by code an
+ * interrupt handler interrupted); it is picked up by the next drain.
+ */
+void klog_drain() {
+    if (__atomic_exchange_n(&draining, 1, __ATOMIC_ACQUIRE)) return;
+
+    char line[LOG_MESSAGE_MAX + 16];
+
+    while (log_tail != log_head) {
+        uint32_t head = log_head;
+
+        // Skip what has been overwritten already
+        if (head - log_tail > LOG_RING_ENTRIES) {
+            ksnprintf(line, sizeof(line), "[klog] %u messages lost\n", head - LOG_RING_ENTRIES - log_tail);
+            for (uint32_t i = 0; i < sink_count; i++) sinks[i](line);
+            log_tail = head - LOG_RING_ENTRIES;
+        }
+
+        if (!format_entry(log_tail, line, sizeof(line))) {
+            log_entry_t* entry = &klog_ring[log_tail & (LOG_RING_ENTRIES - 1)];
+            if (entry->seq == 0 || entry->seq < log_tail + 1) break; // Still being written
+            continue; // Overwritten meanwhile; the check above skips ahead
+        }
+
+        for (uint32_t i = 0; i < sink_count; i++) sinks[i](line);
+        log_tail++;
+    }
+
+    __atomic_store_n(&draining, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Prints every message still held by the ring on the console (the "dmesg" command).
+ */
+void klog_dump() {
+    char line[LOG_MESSAGE_MAX + 16];
+    uint32_t head = log_head;
+    uint32_t seq = head > LOG_RING_ENTRIES ? head - LOG_RING_ENTRIES : 0;
+
+    for (; seq != head; seq++) {
+        if (format_entry(seq, line, sizeof(line))) print(line);
+    }
+}
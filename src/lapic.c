@@ -0,0 +1,110 @@
+#include "lapic.h"
+#include "memory.h"
+#include "timer.h"
+#include "cpu.h"
+
+static volatile uint32_t* lapic = NULL; // Registers of the local APIC, mapped uncached by init_lapic()
+
+/**
+ * @brief Reads a local APIC register.
+ */
+static inline uint32_t lapic_read(uint32_t reg) {
+    return lapic[reg / 4];
+}
+
+/**
+ * @brief Writes a local APIC register.
+ */
+static inline void lapic_write(uint32_t reg, uint32_t value) {
+    lapic[reg / 4] = value;
+}
+
+/**
+ * @brief Maps the local APIC registers (the same physical page on every CPU, each seeing its own APIC).
+ *
+ * @param phys Physical address of the registers (from the MADT).
+ * @return 1 on success, 0 if the page could not be mapped.
+ */
+int init_lapic(uint32_t phys) {
+    lapic = (volatile uint32_t*)map_physical(phys, PAGE_SIZE, PAGE_WRITABLE | PAGE_CACHE_DISABLE | PAGE_WRITE_THROUGH);
+    return lapic != NULL;
+}
+
+/**
+ * @brief Returns whether init_lapic() has mapped the local APIC.
+ */
+int lapic_present() {
+    return lapic != NULL;
+}
+
+/**
+ * @brief Software-enables the calling CPU's local APIC and lets every interrupt priority through.
+ */
+void lapic_enable() {
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+}
+
+/**
+ * @brief Returns the local APIC id of the calling CPU.
+ */
+uint32_t lapic_id() {
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+/**
+ * @brief Acknowledges the local APIC interrupt being serviced.
+ */
+void lapic_eoi() {
+    lapic_write(LAPIC_EOI, 0);
+}
+
+/**
+ * @brief Sends an inter-processor interrupt and waits until the target's APIC has accepted it.
+ *
+ * @param apic_id Local APIC id of the target CPU.
+ * @param command Low interrupt command word: a vector, or LAPIC_ICR_INIT / LAPIC_ICR_STARTUP with their flags.
+ */
+void lapic_send_ipi(uint32_t apic_id, uint32_t command) {
+    uint32_t flags = irq_save(); // An interrupt handler sending an IPI must not come between the two writes
+    lapic_write(LAPIC_ICR_HIGH, apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, command);
+    while (lapic_read(LAPIC_ICR_LOW) & LAPIC_ICR_PENDING) asm volatile("pause");
+    irq_restore(flags);
+}
+
+/**
+ * @brief Measures how many local APIC timer counts make up one PIT tick.
+ *
+ * Takes LAPIC_CALIBRATE_TICKS ticks; init_timer() must have run and
+ * interrupts must be enabled.
+ *
+ * @return Timer counts (at LAPIC_TIMER_DIV_16) per tick.
+ */
+uint32_t lapic_timer_calibrate() {
+    lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED | LAPIC_TIMER_VECTOR);
+
+    // Start right after a tick, so a whole number of ticks is measured
+    uint32_t start = timer_ticks();
+    while (timer_ticks() == start) asm volatile("pause");
+
+    lapic_write(LAPIC_TIMER_INITIAL, 0xFFFFFFFF);
+    start = timer_ticks();
+    while (timer_ticks() - start < LAPIC_CALIBRATE_TICKS) asm volatile("pause");
+    uint32_t elapsed = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CURRENT);
+
+    lapic_write(LAPIC_TIMER_INITIAL, 0); // Stop it again
+    return elapsed / LAPIC_CALIBRATE_TICKS;
+}
+
+/**
+ * @brief Makes the calling CPU's local APIC timer interrupt periodically on LAPIC_TIMER_VECTOR.
+ *
+ * @param count Counts between interrupts, as returned by lapic_timer_calibrate().
+ */
+void lapic_timer_start(uint32_t count) {
+    lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_PERIODIC | LAPIC_TIMER_VECTOR);
+    lapic_write(LAPIC_TIMER_INITIAL, count ? count : 1);
+}
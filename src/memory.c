@@ -1,4 +1,15 @@
 #include "memory.h"
+#include "buddy.h"
+#include "slab.h"
+#include "percpu.h"
+#include "acpi.h"
+#include "smp.h"
+#include "spinlock.h"
+#include "cpu.h"
+#include "idt.h"
+#include "kprintf.h"
+#include "string.h"
+#include "trace.h"
 
 // Header structure for a memory block in the heap allocator's free list
 typedef struct BlockHeader {
@@ -6,137 +17,1934 @@ typedef struct BlockHeader {
     struct BlockHeader* next;    // Pointer to the next free block in the linked list
 } BlockHeader;
 
-uint8_t* page_bitmap = 0;         // Bitmap for tracking used/free pages
-uint32_t bitmap_size_bytes = 0;   // Size of the bitmap in bytes
-uint32_t total_pages = 0;         // Total number of physical pages
-uint32_t memory_start = 0;        // Lowest physical address in usable memory
+// Physical frames the page allocator tracks: the whole pages of one memory region, on one side
+// of DIRECT_MAP_SIZE. Page indices of consecutive ranges follow each other (except for the
+// padding before the high memory zone), so the bitmap and the reference counts only hold
+// entries for frames that exist.
+typedef struct {
+    uint32_t frame;      // Physical frame number of the first page
+    uint32_t pages;      // Number of pages (never 0)
+    uint32_t first_page; // Page index of the first page
+} page_range_t;
+
+uint32_t* page_bitmap = 0;        // Bitmap for tracking used/free pages (1 bit per page, 32 pages per word)
+uint32_t bitmap_size_bytes = 0;   // Size of the bitmap in bytes (always a whole number of words)
+uint32_t bitmap_size_words = 0;   // Size of the bitmap in 32-bit words
+static uint32_t bitmap_hint = 0;  // Index of the first word that may contain a free page; every word below it is full
+uint16_t* page_refcounts = 0;     // Mappings of each copy-on-write shared page (0 when the page has a single owner)
+uint32_t total_pages = 0;         // Total number of physical pages (page indices run from 0 to total_pages - 1)
+static uint32_t memory_end = 0;   // End of the highest page tracked below DIRECT_MAP_SIZE (the end of the direct map)
+static page_range_t page_ranges[MAX_MEMORY_REGIONS + 1]; // Sorted by frame (and page index); a region may be split at DIRECT_MAP_SIZE
+static uint32_t page_range_count = 0;
+static uint32_t low_pages = 0;        // Page indices below this are in the direct map
+static uint32_t high_first_word = 0;  // First bitmap word of the high memory zone (padding bits before it stay used)
+static uint32_t high_pages = 0;       // Pages of the high memory zone
+static uint32_t high_hint = 0;        // Bitmap word the high memory search starts at (under pmm_lock)
+static uint32_t* kmap_ptes = 0;       // Page table entries of the kmap() slots, through the direct map
 uint32_t* page_directory = 0;     // Page directory used in paging
-uint32_t usable_region_count = 0; // Number of usable memory regions found (populated by parse_memory_map)
+extern uint32_t boot_page_directory[1024]; // Directory boot.asm enabled paging with (in the kernel image), adopted by setup_paging()
+static int large_pages_enabled = 0;  // Set by init_physical_allocator() once CR4.PSE is on
+static int global_pages_enabled = 0; // Set by init_physical_allocator() once CR4.PGE is on
+static int paging_enabled = 0;       // Set by setup_paging() once the recursive mapping is in place
+static uint32_t direct_map_limit = 0; // End of the physical memory the direct map covers (set by init_direct_map())
+static uint32_t mmio_next = KERNEL_MMIO_START; // First unused address of the MMIO window (under paging_lock)
+uint32_t memory_region_count = 0; // Number of memory regions found (populated by parse_memory_map)
+static uint64_t dropped_region_bytes = 0; // RAM left out because the region table was full
+static uint32_t multiboot_info_start = 0; // Multiboot information structure, kept reserved by init_physical_allocator()
+static uint32_t multiboot_info_end = 0;
+static uint32_t metadata_phys_start = 0;  // Allocator metadata placed by init_physical_allocator()
+static uint32_t metadata_phys_end = 0;
+#ifdef PMM_CHECK
+uint32_t pmm_check_failures = 0;  // Buddy operations that disagreed with the page bitmap
+#endif
+
+static uint32_t heap_current = KERNEL_HEAP_START; // Current end of the heap (the break); used by kmalloc to allocate new memory blocks
+static uint32_t heap_mapped_end = KERNEL_HEAP_START; // End of the pages mapped into the heap window (page aligned, >= heap_current)
+static BlockHeader* free_list = NULL; // Head pointer for the free list of memory blocks (used by kmalloc/kfree)
+
+static uint32_t zeroed_pool[ZEROED_POOL_SIZE]; // Free frames already cleared, for alloc_zeroed_page()
+static uint32_t zeroed_count = 0;              // Frames in zeroed_pool (changed under pmm_lock)
+
+static uint32_t zero_page = 0;        // Shared all-zero page mapped read-only for reads of untouched demand-zero pages
+static demand_region_t heap_region = { 0, KERNEL_HEAP_START, KERNEL_HEAP_START, PAGE_WRITABLE }; // Heap window up to heap_mapped_end
+static demand_region_t demand_regions[MAX_DEMAND_REGIONS]; // Ranges reserved with reserve_region()
+
+static alloc_counters_t page_counters;        // alloc_page/alloc_pages activity, in pages
+static alloc_counters_t heap_counters;        // kmalloc activity, in bytes handed out (slab object or heap block size)
+static latency_histogram_t page_latency;      // alloc_page() cycle counts
+static latency_histogram_t kmalloc_latency;   // kmalloc() cycle counts
+
+// Locks of the state shared by every CPU, taken in this order when nested
+static spinlock_t heap_lock;   // Heap free list, break and mapped end
+static spinlock_t paging_lock; // Page tables changed by the page fault handler, and the MMIO window of map_physical()
+static spinlock_t pmm_lock;    // Global bitmap or buddy lists, zeroed_pool, page_refcounts
+static spinlock_t stats_lock;  // page_counters, heap_counters and the latency histograms
+
+// RAM regions from the memory map: usable, or ACPI tables to reclaim later
+MemoryRegion memory_regions[MAX_MEMORY_REGIONS];
+
+_Static_assert(KMAP_SLOTS >= MAX_CPUS, "every CPU needs a kmap() slot");
+
+/**
+ * @brief Returns the index of the lowest set bit in a non-zero word.
+ *
+ * Uses the BSF (bit scan forward) instruction so a word is searched in a
+ * single instruction instead of testing its 32 bits one by one.
+ *
+ * @param word Value to scan. Must not be 0 (BSF leaves the result undefined).
+ * @return Bit index (0-31) of the lowest set bit.
+ */
+static inline uint32_t bit_scan_forward(uint32_t word) {
+    uint32_t index;
+    asm("bsf %1, %0" : "=r"(index) : "rm"(word));
+    return index;
+}
+
+/**
+ * @brief Returns the index of the highest set bit in a non-zero word (BSR).
+ *
+ * @param word Value to scan. Must not be 0.
+ * @return Bit index (0-31) of the highest set bit.
+ */
+static inline uint32_t bit_scan_reverse(uint32_t word) {
+    uint32_t index;
+    asm("bsr %1, %0" : "=r"(index) : "rm"(word));
+    return index;
+}
+
+/**
+ * @brief Finds the first page in [from, to) whose bitmap bit matches the requested state.
+ *
+ * Works on whole words: the first word is masked to start at `from`, and
+ * every following word is tested in a single comparison.
+ *
+ * @param from  First page index to examine.
+ * @param to    One past the last page index to examine.
+ * @param used  1 to look for a used page, 0 to look for a free page.
+ * @return Index of the first matching page, or `to` if there is none.
+ */
+static uint32_t bitmap_find(uint32_t from, uint32_t to, int used) {
+    uint32_t invert = used ? 0 : BITMAP_WORD_FULL; // Flip the word so the wanted state reads as set bits
+
+    while (from < to) {
+        uint32_t w = from / BITMAP_BITS_PER_WORD;
+        uint32_t word = (page_bitmap[w] ^ invert) & (BITMAP_WORD_FULL << (from % BITMAP_BITS_PER_WORD));
+
+        if (word) {
+            uint32_t index = w * BITMAP_BITS_PER_WORD + bit_scan_forward(word);
+            return index < to ? index : to;
+        }
+
+        from = (w + 1) * BITMAP_BITS_PER_WORD;
+    }
+    return to;
+}
+
+/**
+ * @brief Marks `count` pages starting at page index `first` as used or free.
+ *
+ * Only the partial words at either edge of the range are masked; words
+ * fully inside the range are written whole.
+ *
+ * @param first First page index of the range.
+ * @param count Number of pages in the range.
+ * @param used  1 to mark the pages used, 0 to mark them free.
+ */
+static void bitmap_fill(uint32_t first, uint32_t count, int used) {
+    uint32_t end = first + count;
+
+    while (first < end) {
+        uint32_t w = first / BITMAP_BITS_PER_WORD;
+        uint32_t bit = first % BITMAP_BITS_PER_WORD;
+        uint32_t n = BITMAP_BITS_PER_WORD - bit;
+        if (n > end - first) n = end - first;
+
+        uint32_t mask = (n == BITMAP_BITS_PER_WORD) ? BITMAP_WORD_FULL : ((1u << n) - 1) << bit;
+        if (used) {
+            page_bitmap[w] |= mask;
+        } else {
+            page_bitmap[w] &= ~mask;
+        }
+
+        first += n;
+    }
+}
+
+/**
+ * @brief Returns the end address of a memory region.
+ */
+static inline uint64_t region_end(const MemoryRegion* region) {
+    return region->base + region->length;
+}
+
+/**
+ * @brief Returns the page range holding physical frame `frame`, or NULL if it is not tracked.
+ *
+ * Binary search over page_ranges, so the lookup stays short however the
+ * memory map is fragmented.
+ */
+static const page_range_t* range_of_frame(uint32_t frame) {
+    uint32_t lo = 0, hi = page_range_count; // Find the last range starting at or below the frame
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (page_ranges[mid].frame <= frame) lo = mid + 1; else hi = mid;
+    }
+    if (lo == 0) return NULL;
+
+    const page_range_t* range = &page_ranges[lo - 1];
+    return frame - range->frame < range->pages ? range : NULL;
+}
+
+/**
+ * @brief Returns the page range holding page index `index` (which must be below total_pages).
+ */
+static const page_range_t* range_of_index(uint32_t index) {
+    uint32_t lo = 0, hi = page_range_count;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (page_ranges[mid].first_page <= index) lo = mid + 1; else hi = mid;
+    }
+    return &page_ranges[lo - 1];
+}
+
+/**
+ * @brief Returns the page index of a physical address, or total_pages if the allocator does not track it.
+ */
+static uint32_t page_index_of(uint32_t paddr) {
+    const page_range_t* range = range_of_frame(paddr / PAGE_SIZE);
+    return range ? range->first_page + (paddr / PAGE_SIZE - range->frame) : total_pages;
+}
+
+/**
+ * @brief Returns the physical address of the page with index `index` (below total_pages).
+ */
+static uint32_t page_address(uint32_t index) {
+    const page_range_t* range = range_of_index(index);
+    return (range->frame + (index - range->first_page)) * PAGE_SIZE;
+}
+
+/**
+ * @brief Marks physical frames [first_frame, end_frame) as used or free.
+ *
+ * Frames the bitmap does not track are skipped.
+ */
+static void bitmap_fill_frames(uint64_t first_frame, uint64_t end_frame, int used) {
+    for (uint32_t i = 0; i < page_range_count; i++) {
+        const page_range_t* range = &page_ranges[i];
+        uint64_t range_end = (uint64_t)range->frame + range->pages;
+        uint64_t from = first_frame > range->frame ? first_frame : range->frame;
+        uint64_t to = end_frame < range_end ? end_frame : range_end;
+        if (from < to) bitmap_fill(range->first_page + (uint32_t)(from - range->frame), (uint32_t)(to - from), used);
+    }
+}
+
+/**
+ * @brief Marks every page overlapping physical addresses [start, end) as used.
+ *
+ * The range is clipped to the pages the bitmap tracks.
+ */
+static void reserve_physical_range(uint64_t start, uint64_t end) {
+    if (start >= end) return;
+    bitmap_fill_frames(start / PAGE_SIZE, (end + PAGE_SIZE - 1) / PAGE_SIZE, 1);
+}
+
+/**
+ * @brief Adds a frame range to page_ranges, extending the last range if it continues it.
+ *
+ * Ranges must be added in ascending order. The last range is only
+ * extended when both its frames and its page indices carry on.
+ */
+static void add_page_range(uint32_t frame, uint32_t pages) {
+    page_range_t* last = page_range_count ? &page_ranges[page_range_count - 1] : NULL;
+    if (last && last->frame + last->pages == frame && last->first_page + last->pages == total_pages) {
+        last->pages += pages;
+    } else {
+        page_range_t* range = &page_ranges[page_range_count++];
+        range->frame = frame;
+        range->pages = pages;
+        range->first_page = total_pages;
+    }
+    total_pages += pages;
+}
+
+/**
+ * @brief Returns whether physical addresses [start, end) lie inside a single usable region.
+ *
+ * Regions of the same type are merged, so one region covers any usable
+ * range whole.
+ */
+static int in_usable_region(uint64_t start, uint64_t end) {
+    for (uint32_t i = 0; i < memory_region_count; i++) {
+        const MemoryRegion* region = &memory_regions[i];
+        if (region->type == MULTIBOOT_MEMORY_AVAILABLE && region->base <= start && end <= region_end(region)) return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Turns on 4MB pages (with PAGING_PSE) and global pages if the CPU supports them.
+ */
+static void detect_paging_features() {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+
+#ifdef PAGING_PSE
+    if (edx & CPUID_EDX_PSE) {
+        write_cr4(read_cr4() | CR4_PSE);
+        large_pages_enabled = 1;
+    }
+#endif
+
+    if (edx & CPUID_EDX_PGE) {
+        write_cr4(read_cr4() | CR4_PGE);
+        global_pages_enabled = 1;
+    }
+}
+
+/**
+ * @brief Returns how many page tables the direct map needs beyond the ones boot.asm set up.
+ *
+ * @param end End of the physical memory to map.
+ */
+static uint32_t direct_map_tables(uint32_t end) {
+    uint32_t entries = (end + LARGE_PAGE_SIZE - 1) / LARGE_PAGE_SIZE;
+    uint32_t boot_entries = BOOT_MAP_SIZE / LARGE_PAGE_SIZE;
+    if (large_pages_enabled || entries <= boot_entries) return 0;
+    return entries - boot_entries;
+}
+
+/**
+ * @brief Extends the boot mapping at KERNEL_VIRTUAL_BASE to all physical memory below `end`.
+ *
+ * With 4MB pages every directory entry becomes one large page. Otherwise
+ * the page tables boot.asm set up are kept and the rest are filled in at
+ * `tables` (direct_map_tables(end) frames). Either way the mappings are
+ * global when the CPU supports it, since the direct map is in every
+ * address space.
+ *
+ * @param tables Physical address of the frames for the new page tables (inside the boot mapping).
+ * @param end    End of the physical memory to map (at most DIRECT_MAP_SIZE).
+ */
+static void init_direct_map(uint32_t tables, uint32_t end) {
+    uint32_t* entries = &boot_page_directory[KERNEL_VIRTUAL_BASE >> 22];
+    uint32_t flags = PAGE_PRESENT | PAGE_WRITABLE | (global_pages_enabled ? PAGE_GLOBAL : 0);
+    uint32_t boot_entries = BOOT_MAP_SIZE / LARGE_PAGE_SIZE;
+    uint32_t count = (end + LARGE_PAGE_SIZE - 1) / LARGE_PAGE_SIZE;
+    if (count < boot_entries) count = boot_entries; // The kernel image must stay mapped
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t base = i * LARGE_PAGE_SIZE;
+
+        if (large_pages_enabled) {
+            entries[i] = base | flags | PAGE_LARGE;
+            continue;
+        }
+
+        uint32_t* table;
+        if (i < boot_entries) {
+            table = (uint32_t*)phys_to_virt(entries[i] & ~0xFFF); // Only the global bit is missing
+        } else {
+            table = (uint32_t*)phys_to_virt(tables);
+            entries[i] = tables | PAGE_PRESENT | PAGE_WRITABLE;
+            tables += PAGE_SIZE;
+        }
+        for (uint32_t j = 0; j < 1024; j++) {
+            table[j] = (base + j * PAGE_SIZE) | flags;
+        }
+    }
+
+    direct_map_limit = count * LARGE_PAGE_SIZE;
+    flush_tlb_global();
+}
+
+/**
+ * @brief Initializes the physical memory allocator.
+ * 
+ * Calculates usable memory from the multiboot memory map, sets up a bitmap
+ * to track allocated/free pages, and marks pages as free or reserved.
+ * The bitmap is built with whole-word fills over page ranges, so boot time
+ * does not grow with one read-modify-write per page.
+ *
+ * Only frames inside memory regions get a page index: the regions are
+ * numbered one after the other (page_ranges), so the bitmap and the page
+ * reference counts grow with the amount of RAM, not with the address
+ * span, and holes in the memory map cost nothing. ACPI reclaimable
+ * regions are tracked but stay used until reclaim_acpi_memory(), also
+ * where a usable region overlaps them.
+ *
+ * Reserved even when the memory map calls them usable: the first MiB
+ * (real-mode IVT, BIOS data and EBDA, and physical page 0, whose address
+ * doubles as NULL), the kernel image, the multiboot information, and the
+ * allocator's own metadata. That metadata (the bitmap, then the page
+ * reference counts used for copy-on-write sharing, then with PMM_BUDDY
+ * the buddy metadata) is placed right after the kernel, or after the
+ * multiboot information if it would overlap it.
+ *
+ * Frames above DIRECT_MAP_SIZE (and below 4 GiB) form the high memory
+ * zone. Their page indices start on a fresh bitmap word after the direct
+ * mapped ones, so the scans of either zone only look at its own words.
+ * alloc_page() and the other allocators whose frames are used through
+ * phys_to_virt() never see the zone: only alloc_highmem_page() takes
+ * from it, and it always uses the bitmap. The metadata (about 3 MiB at
+ * most) must lie within the BOOT_MAP_SIZE that boot.asm mapped and inside
+ * a usable region; if it cannot be placed so, this halts with an error
+ * rather than write to memory it does not own.
+ *
+ * The direct map is completed before the buddy allocator is set up, since
+ * the buddy free lists live in the free frames themselves.
+ *
+ * With PMM_BUDDY the free runs of the direct mapped zone are then handed
+ * to the buddy allocator, whose own maps cover the span from its lowest
+ * to its highest frame.
+ */
+void init_physical_allocator() {
+    detect_paging_features();
+
+    // Number the whole pages of every region: the direct mapped zone first, then high memory
+    total_pages = 0;
+    page_range_count = 0;
+    uint64_t ignored = 0; // RAM above 4 GiB
+    const uint64_t zone_start[2] = { 0, DIRECT_MAP_SIZE };
+    const uint64_t zone_end[2] = { DIRECT_MAP_SIZE, 0x100000000ull };
+    for (uint32_t zone = 0; zone < 2; zone++) {
+        if (zone == 1) {
+            // High memory starts on a word of its own; the padding indices never get a frame
+            low_pages = total_pages;
+            high_first_word = (total_pages + BITMAP_BITS_PER_WORD - 1) / BITMAP_BITS_PER_WORD;
+            total_pages = high_first_word * BITMAP_BITS_PER_WORD;
+        }
+
+        uint64_t tracked_end = zone_start[zone]; // Keeps overlapping regions from being counted twice
+        for (uint32_t i = 0; i < memory_region_count; i++) {
+            uint64_t start = (memory_regions[i].base + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+            uint64_t end = (memory_regions[i].base + memory_regions[i].length) & ~(uint64_t)(PAGE_SIZE - 1);
+            if (zone == 1 && end > zone_end[1]) ignored += end - (start > zone_end[1] ? start : zone_end[1]);
+            if (end > zone_end[zone]) end = zone_end[zone];
+            if (start < tracked_end) start = tracked_end;
+            if (start >= end) continue;
+
+            add_page_range((uint32_t)(start / PAGE_SIZE), (uint32_t)((end - start) / PAGE_SIZE));
+            tracked_end = end;
+        }
+        if (zone == 0) memory_end = (uint32_t)tracked_end;
+    }
+    high_pages = total_pages - high_first_word * BITMAP_BITS_PER_WORD;
+    high_hint = high_first_word;
+
+    if (high_pages) klog(LOG_INFO, "memory: %u MiB of high memory above %u MiB",
+                         high_pages / (0x100000 / PAGE_SIZE), DIRECT_MAP_SIZE >> 20);
+    if (ignored) klog(LOG_WARN, "memory: ignoring %u MiB of RAM above 4 GiB", (uint32_t)(ignored >> 20));
+    if (dropped_region_bytes) klog(LOG_WARN, "memory: region table full, %u KiB of RAM left out",
+                                   (uint32_t)(dropped_region_bytes >> 10));
+
+    // Calculate bitmap size
+    bitmap_size_words = (total_pages + BITMAP_BITS_PER_WORD - 1) / BITMAP_BITS_PER_WORD;
+    bitmap_size_bytes = bitmap_size_words * sizeof(uint32_t);
+
+    // Lay out the metadata: bitmap, reference counts, direct map page tables, then buddy metadata, each page aligned
+    uint32_t refcounts_offset = (bitmap_size_bytes + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    uint32_t metadata_size = refcounts_offset + total_pages * sizeof(uint16_t);
+    uint32_t direct_tables_offset = (metadata_size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    metadata_size = direct_tables_offset + direct_map_tables(memory_end) * PAGE_SIZE;
+#ifdef PMM_BUDDY
+    uint32_t first_frame = page_range_count ? page_ranges[0].frame : 0;
+    uint32_t span_frames = memory_end / PAGE_SIZE - first_frame;
+    uint32_t buddy_meta_offset = (metadata_size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    uint32_t buddy_meta_size = buddy_metadata_size(first_frame, span_frames);
+    metadata_size = buddy_meta_offset + buddy_meta_size;
+#endif
+
+    // Place it just after the kernel in memory, aligned to page boundary, and clear of the multiboot information
+    uint32_t metadata_start = (virt_to_phys(&kernel_end) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    if (metadata_start < multiboot_info_end && multiboot_info_start < metadata_start + metadata_size)
+        metadata_start = (multiboot_info_end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+
+    // Nothing past the boot mapping can be written yet, and the metadata must not land on firmware memory
+    if ((uint64_t)metadata_start + metadata_size > BOOT_MAP_SIZE ||
+        !in_usable_region(metadata_start, (uint64_t)metadata_start + metadata_size)) {
+        klog(LOG_ERROR, "memory: no room for %u KiB of allocator metadata at %p (must be usable RAM below %u MiB)",
+             metadata_size >> 10, (void*)metadata_start, BOOT_MAP_SIZE >> 20);
+        while (1) asm volatile("cli\n\thlt");
+    }
+
+    page_bitmap = (uint32_t*)phys_to_virt(metadata_start);
+    page_refcounts = (uint16_t*)phys_to_virt(metadata_start + refcounts_offset);
+
+    // Initially mark all pages as used, including the padding bits past total_pages in the last word
+    memset(page_bitmap, 0xFF, bitmap_size_bytes);
+
+    // Mark the whole pages inside usable regions as free
+    for (uint32_t i = 0; i < memory_region_count; i++) {
+        if (memory_regions[i].type != MULTIBOOT_MEMORY_AVAILABLE) continue;
+
+        uint64_t start = memory_regions[i].base;
+        uint64_t end = start + memory_regions[i].length;
+        bitmap_fill_frames((start + PAGE_SIZE - 1) / PAGE_SIZE, end / PAGE_SIZE, 0);
+    }
+
+    // ACPI tables stay put until reclaim_acpi_memory(), even where a usable region overlaps them
+    for (uint32_t i = 0; i < memory_region_count; i++) {
+        if (memory_regions[i].type == MULTIBOOT_MEMORY_ACPI_RECLAIMABLE)
+            reserve_physical_range(memory_regions[i].base, region_end(&memory_regions[i]));
+    }
+
+    // Take back what is in use or must not be handed out
+    reserve_physical_range(0, LOW_MEMORY_END);
+    reserve_physical_range(virt_to_phys(&kernel_start), virt_to_phys(&kernel_end));
+    reserve_physical_range(multiboot_info_start, multiboot_info_end);
+    reserve_physical_range(metadata_start, (uint64_t)metadata_start + metadata_size);
+    metadata_phys_start = metadata_start;
+    metadata_phys_end = metadata_start + metadata_size;
+
+    // All pages start unshared
+    memset(page_refcounts, 0, total_pages * sizeof(uint16_t));
+
+    bitmap_hint = 0;
+
+    // Every frame must be reachable before the first one is written to
+    init_direct_map(metadata_start + direct_tables_offset, memory_end);
+
+#ifdef PMM_BUDDY
+    uint8_t* buddy_meta = (uint8_t*)phys_to_virt(metadata_start + buddy_meta_offset);
+    memset(buddy_meta, 0, buddy_meta_size);
+
+    buddy_init(buddy_meta, first_frame, span_frames);
+
+    // Hand every run of free direct mapped pages to the buddy allocator (a run never leaves its range)
+    for (uint32_t i = 0; i < page_range_count && page_ranges[i].first_page < low_pages; i++) {
+        uint32_t range_end = page_ranges[i].first_page + page_ranges[i].pages;
+        uint32_t run_start = bitmap_find(page_ranges[i].first_page, range_end, 0);
+        while (run_start < range_end) {
+            uint32_t run_end = bitmap_find(run_start, range_end, 1);
+            buddy_free_range((void*)page_address(run_start), run_end - run_start);
+            run_start = bitmap_find(run_end, range_end, 0);
+        }
+    }
+#endif
+}
+
+/**
+ * @brief Searches bitmap words [from, to) for a free page and marks it used.
+ *
+ * @return Page index of the claimed page, or total_pages if none is free.
+ */
+static uint32_t bitmap_claim_in_words(uint32_t from, uint32_t to) {
+    for (uint32_t w = from; w < to; w++) {
+        uint32_t word = page_bitmap[w];
+        if (word == BITMAP_WORD_FULL) continue; // Skip 32 used pages at once
+
+        uint32_t bit = bit_scan_forward(~word);  // Lowest clear bit = first free page in this word
+        page_bitmap[w] = word | (1u << bit);
+        return w * BITMAP_BITS_PER_WORD + bit;
+    }
+    return total_pages;
+}
+
+/**
+ * @brief Moves the search hint of a page's zone back to it after the page was freed.
+ */
+static void bitmap_hint_freed(uint32_t page_index) {
+    uint32_t word_index = page_index / BITMAP_BITS_PER_WORD;
+    if (word_index >= high_first_word) {
+        if (word_index < high_hint) high_hint = word_index;
+    } else if (word_index < bitmap_hint) {
+        bitmap_hint = word_index;
+    }
+}
+
+/**
+ * @brief Takes one frame of the high memory zone (pmm_lock held).
+ *
+ * The zone is always kept in the bitmap, searched from its own hint like
+ * bitmap_alloc_page() searches the direct mapped zone.
+ *
+ * @return Physical address of the frame, or NULL if the zone is absent or full.
+ */
+static void* highmem_alloc_frame() {
+    uint32_t page_index = bitmap_claim_in_words(high_hint, bitmap_size_words);
+    if (page_index >= total_pages) {
+        page_index = bitmap_claim_in_words(high_first_word, high_hint);
+    }
+    if (page_index >= total_pages) return NULL;
+
+    high_hint = page_index / BITMAP_BITS_PER_WORD;
+    return (void*)page_address(page_index);
+}
+
+/**
+ * @brief Returns whether a tracked physical address is in the high memory zone.
+ */
+static inline int is_highmem(uint32_t paddr) {
+    return paddr >= DIRECT_MAP_SIZE;
+}
+
+#ifndef PMM_BUDDY
+/**
+ * @brief Bitmap backend for alloc_page().
+ *
+ * Scans the words of the direct mapped zone a 32-bit word at a time
+ * starting from the "first possibly free" hint, skipping fully used
+ * words, and wraps around once before giving up.
+ * 
+ * @return Pointer to the start of the allocated physical page, or NULL if none available.
+ */
+static void* bitmap_alloc_page() {
+    // Search from the hint to the end of the zone, then wrap around to cover words below it
+    uint32_t page_index = bitmap_claim_in_words(bitmap_hint, high_first_word);
+    if (page_index >= total_pages) {
+        page_index = bitmap_claim_in_words(0, bitmap_hint);
+    }
+    if (page_index >= total_pages) {
+        return 0; // Out of memory
+    }
+
+    // Words before the claimed one were found full, so the hint can advance to it
+    bitmap_hint = page_index / BITMAP_BITS_PER_WORD;
+
+    return (void*)page_address(page_index);
+}
+#endif
+
+/**
+ * @brief Bitmap backend for free_page(), and the free path of the high memory zone.
+ * 
+ * @param addr Physical address of the page to free.
+ */
+static void bitmap_free_page(void* addr) {
+    uint32_t page_index = page_index_of((uint32_t)addr);
+    if (page_index < total_pages) {
+        BITMAP_CLEAR(page_bitmap, page_index);
+
+        // Move the hint back so the next allocation finds this page first
+        bitmap_hint_freed(page_index);
+    }
+}
+
+/**
+ * @brief Bitmap backend for free_pages(), and the free path of the high memory zone.
+ *
+ * @param addr  Physical address of the first page.
+ * @param count Number of pages to free.
+ */
+static void bitmap_free_pages(void* addr, uint32_t count) {
+    uint32_t first = page_index_of((uint32_t)addr);
+    if (first >= total_pages) return;
+    const page_range_t* range = range_of_index(first);
+    if (count > range->first_page + range->pages - first) count = range->first_page + range->pages - first;
+
+    bitmap_fill(first, count, 0);
+    bitmap_hint_freed(first);
+}
+
+#ifndef PMM_BUDDY
+
+/**
+ * @brief Bitmap backend for alloc_pages().
+ *
+ * Candidate runs start at the first-free hint and are aligned so that the
+ * physical address of the first page is a multiple of `alignment` pages.
+ * Only the direct mapped zone is searched.
+ * When a candidate run contains a used page, the search resumes at the next
+ * free page after it, so fully used words are skipped a word at a time.
+ * A run never continues past the end of its page range, where the next
+ * page index belongs to a frame elsewhere.
+ *
+ * @param count     Number of pages to allocate.
+ * @param alignment Required alignment of the run in pages (a power of two; 0 or 1 for none).
+ * @return Physical address of the first page, or NULL if no suitable run is free.
+ */
+static void* bitmap_alloc_pages(uint32_t count, uint32_t alignment) {
+    if (count == 0 || count > low_pages) return 0;
+    if (alignment == 0) alignment = 1;
+    if (alignment & (alignment - 1)) return 0; // Alignment must be a power of two
+
+    uint32_t start = bitmap_hint * BITMAP_BITS_PER_WORD;
+
+    while (start < low_pages) {
+        const page_range_t* range = range_of_index(start);
+        uint32_t range_end = range->first_page + range->pages;
+
+        // Round the candidate up so its physical frame number is a multiple of alignment
+        uint32_t frame = range->frame + (start - range->first_page);
+        uint32_t first = start + (((frame + alignment - 1) & ~(alignment - 1)) - frame);
+        if (first < start || first >= range_end || range_end - first < count) {
+            start = range_end; // No aligned run fits in the rest of this range
+            continue;
+        }
+
+        uint32_t used = bitmap_find(first, first + count, 1);
+        if (used == first + count) {
+            bitmap_fill(first, count, 1);
+            return (void*)page_address(first);
+        }
+
+        // Resume at the first free page after the one that broke the run
+        start = bitmap_find(used + 1, low_pages, 0);
+    }
+    return 0; // Out of memory (or no run with this alignment)
+}
+#endif
+
+#if defined(PMM_BUDDY) && defined(PMM_CHECK)
+/**
+ * @brief Mirrors a buddy allocator operation into the page bitmap and checks it.
+ *
+ * An allocation must cover pages the bitmap sees as free, and a free must
+ * cover pages it sees as used. Every violation is counted in
+ * pmm_check_failures.
+ *
+ * @param addr  Physical address of the first page (NULL is ignored).
+ * @param count Number of pages.
+ * @param used  1 for an allocation, 0 for a free.
+ */
+static void pmm_check(void* addr, uint32_t count, int used) {
+    if (!addr) return;
+
+    uint32_t first = page_index_of((uint32_t)addr);
+    if (first >= total_pages) return;
+    const page_range_t* range = range_of_index(first);
+    if (count > range->first_page + range->pages - first) count = range->first_page + range->pages - first;
+
+    // Look for a page already in the state this operation is about to put it in
+    if (bitmap_find(first, first + count, used) != first + count) {
+        pmm_check_failures++;
+    }
+    bitmap_fill(first, count, used);
+}
+#endif
+
+/**
+ * @brief Takes one frame from the global allocator backend.
+ */
+static void* pmm_alloc_frame() {
+#ifdef PMM_BUDDY
+    void* page = buddy_alloc(0);
+#ifdef PMM_CHECK
+    pmm_check(page, 1, 1);
+#endif
+    return page;
+#else
+    return bitmap_alloc_page();
+#endif
+}
+
+/**
+ * @brief Returns one frame to the global allocator backend.
+ */
+static void pmm_free_frame(void* addr) {
+#ifdef PMM_BUDDY
+#ifdef PMM_CHECK
+    pmm_check(addr, 1, 0);
+#endif
+    buddy_free_range(addr, 1);
+#else
+    bitmap_free_page(addr);
+#endif
+}
+
+/**
+ * @brief Records one allocation (or a failed one) in an allocator's counters.
+ *
+ * @param c      Counters to update.
+ * @param amount Pages or bytes allocated, or 0 if the allocation failed.
+ */
+static void counters_alloc(alloc_counters_t* c, uint32_t amount) {
+    if (!amount) {
+        c->failed_allocs++;
+        return;
+    }
+    c->allocs++;
+    c->in_use += amount;
+    if (c->in_use > c->high_water) c->high_water = c->in_use;
+}
+
+/**
+ * @brief Records one free in an allocator's counters.
+ *
+ * @param c      Counters to update.
+ * @param amount Pages or bytes freed.
+ */
+static void counters_free(alloc_counters_t* c, uint32_t amount) {
+    c->frees++;
+    c->in_use -= amount;
+}
+
+/**
+ * @brief Adds one call's duration to a log2 latency histogram.
+ *
+ * @param h     Histogram to update.
+ * @param start rdtsc() value taken when the call started.
+ */
+static void latency_record(latency_histogram_t* h, uint64_t start) {
+    uint32_t cycles = (uint32_t)(rdtsc() - start);
+    uint32_t bucket = 0;
+
+    if (cycles >> LATENCY_MIN_SHIFT) {
+        bucket = bit_scan_reverse(cycles) - LATENCY_MIN_SHIFT;
+        if (bucket >= LATENCY_BUCKETS) bucket = LATENCY_BUCKETS - 1;
+    }
+    h->buckets[bucket]++;
+}
+
+/**
+ * @brief Allocates a single 4KB physical page.
+ *
+ * Served from the calling CPU's page magazine. When the magazine is empty
+ * it is refilled with PAGE_MAGAZINE_BATCH frames from the global allocator,
+ * so the global bitmap or buddy lists are only touched once per batch.
+ * 
+ * @return Pointer to the start of the allocated physical page, or NULL if none available.
+ */
+void* alloc_page() {
+    uint64_t start = rdtsc();
+    uint32_t flags = irq_save(); // Keep interrupt handlers on this CPU out of the magazine
+    page_magazine_t* mag = &this_cpu()->page_cache;
+
+    if (mag->count == 0) {
+        spin_lock(&pmm_lock);
+        while (mag->count < PAGE_MAGAZINE_BATCH) {
+            void* frame = pmm_alloc_frame();
+            if (!frame) break;
+            mag->frames[mag->count++] = frame;
+        }
+        spin_unlock(&pmm_lock);
+    }
+
+    void* page = mag->count ? mag->frames[--mag->count] : NULL;
+    if (!page) {
+        spin_lock(&pmm_lock);
+        if (zeroed_count) page = (void*)zeroed_pool[--zeroed_count]; // The pre-zeroed frames are the last reserve
+        spin_unlock(&pmm_lock);
+    }
+
+    spin_lock(&stats_lock);
+    counters_alloc(&page_counters, page ? 1 : 0);
+    latency_record(&page_latency, start);
+    spin_unlock(&stats_lock);
+    irq_restore(flags);
+    TRACE_EVENT(TRACE_ALLOC_PAGE, page, __builtin_return_address(0));
+    return page;
+}
+
+/**
+ * @brief Frees a previously allocated page.
+ *
+ * The frame goes onto the calling CPU's page magazine. A full magazine
+ * first drains PAGE_MAGAZINE_BATCH frames back to the global allocator.
+ * High memory frames go straight back to the bitmap instead. NULL and addresses the allocator does not track are ignored, so they
+ * are never handed out again.
+ * 
+ * @param addr Physical address of the page to free.
+ */
+void free_page(void* addr) {
+    TRACE_EVENT(TRACE_FREE_PAGE, addr, __builtin_return_address(0));
+    if (!addr) return;
+    if (page_index_of((uint32_t)addr) >= total_pages) {
+        klog(LOG_WARN, "free_page: %p is not a tracked frame", addr);
+        return;
+    }
+    if (is_highmem((uint32_t)addr)) {
+        // Never cached: the magazine feeds alloc_page(), whose frames must be direct mapped
+        uint32_t flags = spin_lock_irqsave(&pmm_lock);
+        bitmap_free_page(addr);
+        spin_unlock(&pmm_lock);
+
+        spin_lock(&stats_lock);
+        counters_free(&page_counters, 1);
+        spin_unlock_irqrestore(&stats_lock, flags);
+        return;
+    }
+
+    uint32_t flags = irq_save();
+    page_magazine_t* mag = &this_cpu()->page_cache;
+
+    if (mag->count == PAGE_MAGAZINE_SIZE) {
+        // Return the oldest frames so the most recently freed (cache-warm) ones stay local
+        spin_lock(&pmm_lock);
+        for (uint32_t i = 0; i < PAGE_MAGAZINE_BATCH; i++) {
+            pmm_free_frame(mag->frames[i]);
+        }
+        spin_unlock(&pmm_lock);
+        for (uint32_t i = PAGE_MAGAZINE_BATCH; i < PAGE_MAGAZINE_SIZE; i++) {
+            mag->frames[i - PAGE_MAGAZINE_BATCH] = mag->frames[i];
+        }
+        mag->count -= PAGE_MAGAZINE_BATCH;
+    }
+
+    mag->frames[mag->count++] = addr;
+    spin_lock(&stats_lock);
+    counters_free(&page_counters, 1);
+    spin_unlock(&stats_lock);
+    irq_restore(flags);
+}
+
+/**
+ * @brief Allocates a single 4KB physical page from the high memory zone.
+ *
+ * High memory frames are outside the direct map, so this is for pages
+ * only ever used through a mapping of their own (user pages, demand-zero
+ * pages) or through kmap(). None are handed out before setup_paging()
+ * has made the kmap() slots. Failures are not counted: callers fall back
+ * to alloc_page().
+ *
+ * @return Physical address of the page, or NULL if high memory is absent or full.
+ */
+void* alloc_highmem_page() {
+    if (!high_pages || !kmap_ptes) return NULL;
+
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+    void* page = highmem_alloc_frame();
+    spin_unlock(&pmm_lock);
+
+    spin_lock(&stats_lock);
+    if (page) counters_alloc(&page_counters, 1);
+    spin_unlock_irqrestore(&stats_lock, flags);
+    TRACE_EVENT(TRACE_ALLOC_PAGE, page, __builtin_return_address(0));
+    return page;
+}
+
+/**
+ * @brief Maps a physical page into kernel space for a short access.
+ *
+ * Pages in the direct map are returned through it. Any other page goes to
+ * the calling CPU's slot at KMAP_START, with interrupts disabled until the
+ * matching kunmap() so nothing else on this CPU can reuse the slot. The
+ * slot is only ever used by its own CPU, so unmapping it needs no TLB
+ * shootdown.
+ *
+ * @param paddr Physical address of the page.
+ * @return Kernel virtual address of the page.
+ */
+void* kmap(uint32_t paddr) {
+    paddr &= ~(PAGE_SIZE - 1);
+    if (paddr < direct_map_limit) return phys_to_virt(paddr);
+
+    uint32_t flags = irq_save();
+    cpu_local_t* cpu = this_cpu();
+    cpu->kmap_irq_flags = flags;
+    kmap_ptes[cpu->id] = paddr | PAGE_PRESENT | PAGE_WRITABLE; // Not present before, so nothing is cached
+    return (void*)(KMAP_START + cpu->id * PAGE_SIZE);
+}
+
+/**
+ * @brief Ends a mapping made by kmap().
+ *
+ * @param vaddr Address kmap() returned.
+ */
+void kunmap(void* vaddr) {
+    if ((uint32_t)vaddr < KMAP_START || (uint32_t)vaddr >= PAGE_TABLES_VADDR) return; // Direct map
+
+    cpu_local_t* cpu = this_cpu();
+    kmap_ptes[cpu->id] = 0;
+    invlpg(KMAP_START + cpu->id * PAGE_SIZE);
+    irq_restore(cpu->kmap_irq_flags);
+}
+
+/**
+ * @brief Returns every frame cached in the calling CPU's page magazine to the global allocator.
+ *
+ * Called when a contiguous allocation fails, since cached frames may be
+ * what breaks up an otherwise free run. The other CPUs' magazines are
+ * theirs alone and are left as they are.
+ */
+void drain_page_magazines() {
+    uint32_t flags = irq_save();
+    page_magazine_t* mag = &this_cpu()->page_cache;
+    spin_lock(&pmm_lock);
+    while (mag->count) {
+        pmm_free_frame(mag->frames[--mag->count]);
+    }
+    spin_unlock(&pmm_lock);
+    irq_restore(flags);
+}
+
+/**
+ * @brief Takes a contiguous run of frames from the global allocator backend.
+ *
+ * With the buddy backend the request is rounded up to a power-of-two
+ * block (at least `alignment` pages) and the unused tail is freed again.
+ */
+static void* pmm_alloc_run(uint32_t count, uint32_t alignment) {
+#ifdef PMM_BUDDY
+    if (count == 0 || (alignment & (alignment - 1))) return NULL;
+
+    uint32_t order = 0;
+    while ((1u << order) < count || (1u << order) < alignment) {
+        if (++order > BUDDY_MAX_ORDER) return NULL; // Larger than the biggest buddy block
+    }
+
+    uint8_t* block = (uint8_t*)buddy_alloc(order);
+    if (!block) return NULL;
+
+    // Give back the part of the block past the requested run
+    if ((1u << order) > count) {
+        buddy_free_range(block + count * PAGE_SIZE, (1u << order) - count);
+    }
+#ifdef PMM_CHECK
+    pmm_check(block, count, 1);
+#endif
+    return block;
+#else
+    return bitmap_alloc_pages(count, alignment);
+#endif
+}
+
+/**
+ * @brief Returns a contiguous run of frames to the global allocator backend.
+ */
+static void pmm_free_run(void* addr, uint32_t count) {
+    if (is_highmem((uint32_t)addr)) {
+        bitmap_free_pages(addr, count); // High memory is always kept in the bitmap
+        return;
+    }
+#ifdef PMM_BUDDY
+#ifdef PMM_CHECK
+    pmm_check(addr, count, 0);
+#endif
+    buddy_free_range(addr, count);
+#else
+    bitmap_free_pages(addr, count);
+#endif
+}
+
+/**
+ * @brief Allocates `count` physically contiguous 4KB pages.
+ *
+ * Contiguous runs come straight from the global allocator. If no run is
+ * found, the per-CPU page magazines are drained and the search is retried.
+ *
+ * @param count     Number of pages to allocate.
+ * @param alignment Required alignment of the first page, in pages (a power of two; 0 or 1 for none).
+ * @return Physical address of the first page, or NULL if no suitable run is free.
+ */
+void* alloc_pages(uint32_t count, uint32_t alignment) {
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+    void* run = pmm_alloc_run(count, alignment);
+    spin_unlock_irqrestore(&pmm_lock, flags);
+
+    if (!run) {
+        // Frames parked in this CPU's magazine may be splitting a free run; retry without them
+        drain_page_magazines();
+        flags = spin_lock_irqsave(&pmm_lock);
+        run = pmm_alloc_run(count, alignment);
+        spin_unlock_irqrestore(&pmm_lock, flags);
+    }
+
+    flags = spin_lock_irqsave(&stats_lock);
+    counters_alloc(&page_counters, run ? count : 0);
+    spin_unlock_irqrestore(&stats_lock, flags);
+
+    if (!run) klog(LOG_WARN, "alloc_pages: no free run of %u pages aligned to %u", count, alignment);
+    return run;
+}
+
+/**
+ * @brief Frees `count` contiguous pages previously returned by alloc_pages().
+ *
+ * The pages go straight back to the global allocator.
+ *
+ * @param addr  Physical address of the first page.
+ * @param count Number of pages to free.
+ */
+void free_pages(void* addr, uint32_t count) {
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+    pmm_free_run(addr, count);
+    spin_unlock(&pmm_lock);
+
+    spin_lock(&stats_lock);
+    counters_free(&page_counters, count);
+    spin_unlock_irqrestore(&stats_lock, flags);
+}
+
+/**
+ * @brief Returns whether the page at `paddr` holds something init_physical_allocator() reserved for good.
+ *
+ * That is the first MiB, the kernel image, the multiboot information and
+ * the allocator metadata.
+ */
+static int is_boot_reserved(uint32_t paddr) {
+    uint32_t end = paddr + PAGE_SIZE;
+    return paddr < LOW_MEMORY_END ||
+           (paddr < virt_to_phys(&kernel_end) && virt_to_phys(&kernel_start) < end) ||
+           (paddr < multiboot_info_end && multiboot_info_start < end) ||
+           (paddr < metadata_phys_end && metadata_phys_start < end);
+}
+
+/**
+ * @brief Hands the ACPI reclaimable regions of the memory map to the page allocator.
+ *
+ * Those regions hold the ACPI tables, so this may only run once nothing
+ * reads them any more: after init_smp() has parsed the MADT. Every page
+ * touching a region was kept used since boot, so each one is freed
+ * exactly once, here; a page still marked free in the bitmap is skipped.
+ * Pages init_physical_allocator() reserved for other reasons (the first
+ * MiB, the kernel image, the multiboot information, the allocator
+ * metadata) stay reserved.
+ *
+ * @return Number of pages reclaimed.
+ */
+uint32_t reclaim_acpi_memory() {
+    uint32_t reclaimed = 0;
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+
+    for (uint32_t i = 0; i < memory_region_count; i++) {
+        if (memory_regions[i].type != MULTIBOOT_MEMORY_ACPI_RECLAIMABLE) continue;
+
+        // Every page it touches, as init_physical_allocator() reserved them
+        uint64_t first_frame = memory_regions[i].base / PAGE_SIZE;
+        uint64_t end_frame = (region_end(&memory_regions[i]) + PAGE_SIZE - 1) / PAGE_SIZE;
+
+        // Free the part inside each page range (the region may straddle DIRECT_MAP_SIZE)
+        for (uint32_t j = 0; j < page_range_count; j++) {
+            const page_range_t* range = &page_ranges[j];
+            uint64_t range_end = (uint64_t)range->frame + range->pages;
+            uint64_t from = first_frame > range->frame ? first_frame : range->frame;
+            uint64_t to = end_frame < range_end ? end_frame : range_end;
+
+            for (uint64_t frame = from; frame < to; frame++) {
+                uint32_t paddr = (uint32_t)(frame * PAGE_SIZE);
+                if (!BITMAP_TEST(page_bitmap, range->first_page + (uint32_t)(frame - range->frame))) continue;
+                if (is_boot_reserved(paddr)) continue;
+
+                pmm_free_run((void*)paddr, 1);
+                reclaimed++;
+            }
+        }
+        memory_regions[i].type = MULTIBOOT_MEMORY_AVAILABLE; // Reclaimed once only
+    }
+    spin_unlock_irqrestore(&pmm_lock, flags);
+
+    if (reclaimed) klog(LOG_INFO, "memory: reclaimed %u KiB of ACPI tables", reclaimed * (PAGE_SIZE / 1024));
+    return reclaimed;
+}
+
+/**
+ * @brief Returns the reference count slot of a physical page.
+ *
+ * @param paddr Physical address of the page.
+ * @return Pointer into page_refcounts, or NULL if the page is not tracked by the
+ *         allocator (or is the zero page, which is shared for good).
+ */
+static uint16_t* page_refcount(uint32_t paddr) {
+    if (paddr == zero_page) return NULL;
+
+    uint32_t page_index = page_index_of(paddr);
+    return page_index < total_pages ? &page_refcounts[page_index] : NULL;
+}
+
+/**
+ * @brief Records one more mapping of a shared page.
+ *
+ * A count of 0 means the page has a single owner, so the first share makes it 2.
+ * The count saturates at PAGE_REF_PINNED instead of wrapping around:
+ * from then on the page is never freed.
+ */
+static void page_ref_share(uint32_t paddr) {
+    uint16_t* ref = page_refcount(paddr);
+    if (!ref) return;
+
+    uint32_t flags = spin_lock_irqsave(&pmm_lock); // The other owners may be dropping theirs on other CPUs
+    if (*ref != PAGE_REF_PINNED) *ref = *ref ? *ref + 1 : 2;
+    spin_unlock_irqrestore(&pmm_lock, flags);
+}
+
+/**
+ * @brief Drops one mapping of a page.
+ *
+ * A pinned page (PAGE_REF_PINNED) keeps its count, since the number of
+ * its mappings is no longer known.
+ *
+ * @param paddr Physical address of the page.
+ * @return 1 if that was the last mapping and the page can be freed, 0 if it is still shared.
+ */
+static int page_ref_drop(uint32_t paddr) {
+    if (paddr == zero_page) return 0; // Never freed
+
+    uint16_t* ref = page_refcount(paddr);
+    if (!ref) return 1;
+
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+    int last = *ref <= 1;
+    if (!last && *ref != PAGE_REF_PINNED) {
+        (*ref)--;
+        if (*ref == 1) *ref = 0; // Back to a single owner
+    }
+    spin_unlock_irqrestore(&pmm_lock, flags);
+    return last;
+}
+
+/**
+ * @brief Returns whether a page directory is the one currently loaded in CR3.
+ *
+ * TLB entries only need invalidating for the active directory.
+ */
+static int is_active_directory(uint32_t* pd) {
+    return paging_enabled && (read_cr3() & ~0xFFF) == (uint32_t)pd;
+}
+
+/**
+ * @brief Returns a pointer through which the entries of a page directory can be edited.
+ *
+ * The active directory is reached through its own recursive entry, any
+ * other directory through the direct map.
+ *
+ * @param pd Physical address of the page directory.
+ * @return Virtual address of the directory's 1024 entries.
+ */
+static uint32_t* pd_entries(uint32_t* pd) {
+    if (is_active_directory(pd)) return (uint32_t*)PAGE_DIRECTORY_VADDR;
+    return (uint32_t*)phys_to_virt((uint32_t)pd);
+}
+
+/**
+ * @brief Returns a pointer to the page table linked at a page directory entry.
+ *
+ * The entry must be present and not a 4MB page.
+ *
+ * @param pd       Physical address of the page directory.
+ * @param entries  Entries of the directory, as returned by pd_entries(pd).
+ * @param pd_index Page directory index.
+ */
+static uint32_t* pt_entries(uint32_t* pd, uint32_t* entries, uint32_t pd_index) {
+    if (is_active_directory(pd)) return (uint32_t*)(PAGE_TABLES_VADDR + pd_index * PAGE_SIZE);
+    return (uint32_t*)phys_to_virt(entries[pd_index] & ~0xFFF);
+}
+
+/**
+ * @brief Returns the flags to map `vaddr` with: kernel mappings are made global.
+ *
+ * Global translations survive CR3 reloads, so switching address spaces
+ * keeps the kernel's TLB entries. User mappings must never be global.
+ */
+static uint32_t mapping_flags(uint32_t vaddr, uint32_t flags) {
+    if (global_pages_enabled && vaddr >= KERNEL_SPACE_START && !(flags & PAGE_USER)) flags |= PAGE_GLOBAL;
+    return flags;
+}
+
+/**
+ * @brief Flushes the TLB after a bulk change to the mappings of `vaddr`'s half of the address space.
+ *
+ * Kernel mappings are global, so a CR3 reload alone would leave them cached.
+ */
+static void flush_tlb_for(uint32_t vaddr) {
+    if (vaddr >= KERNEL_SPACE_START) {
+        flush_tlb_global();
+    } else {
+        flush_tlb();
+    }
+}
+
+/**
+ * @brief Clears a frame through the direct map.
+ */
+static void zero_frame(uint32_t frame) {
+    memset(phys_to_virt(frame), 0, PAGE_SIZE);
+}
+
+/**
+ * @brief Allocates a single 4KB physical page filled with zeros.
+ *
+ * Taken from the pool of frames refill_zeroed_pages() clears while the
+ * system is idle, so callers on the mapping and page fault paths do not
+ * pay for the clearing. When the pool is empty the page comes from
+ * alloc_page() and is cleared on the spot.
+ *
+ * @return Physical address of the page, or NULL if none available.
+ */
+void* alloc_zeroed_page() {
+    uint64_t start = rdtsc();
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+    void* page = zeroed_count ? (void*)zeroed_pool[--zeroed_count] : NULL;
+    spin_unlock(&pmm_lock);
+    if (page) {
+        spin_lock(&stats_lock);
+        counters_alloc(&page_counters, 1);
+        latency_record(&page_latency, start);
+        spin_unlock(&stats_lock);
+    }
+    irq_restore(flags);
+    if (page) return page;
+
+    page = alloc_page();
+    if (page) zero_frame((uint32_t)page);
+    return page;
+}
+
+/**
+ * @brief Tops up the pre-zeroed page pool; meant to run while the system is idle.
+ *
+ * Frames come straight from the global allocator (not the per-CPU
+ * magazines) and stay out of the allocation counters until handed out.
+ * Clears at most ZEROED_POOL_BATCH frames per call so input is not held up.
+ *
+ * @return 1 if the pool is still not full (more work to do), 0 otherwise.
+ */
+int refill_zeroed_pages() {
+    for (uint32_t i = 0; i < ZEROED_POOL_BATCH; i++) {
+        uint32_t flags = spin_lock_irqsave(&pmm_lock);
+        uint32_t frame = zeroed_count < ZEROED_POOL_SIZE ? (uint32_t)pmm_alloc_frame() : 0;
+        spin_unlock_irqrestore(&pmm_lock, flags);
+        if (!frame) return 0; // Full, or no free memory to spare
+
+        zero_frame(frame);
+
+        flags = spin_lock_irqsave(&pmm_lock);
+        int full = zeroed_count == ZEROED_POOL_SIZE; // Filled up meanwhile
+        if (full) {
+            pmm_free_frame((void*)frame);
+        } else {
+            zeroed_pool[zeroed_count++] = frame;
+        }
+        spin_unlock_irqrestore(&pmm_lock, flags);
+        if (full) return 0;
+    }
+    return zeroed_count < ZEROED_POOL_SIZE;
+}
+
+/**
+ * @brief Replaces a 4MB page directory entry with a page table mapping the same memory.
+ *
+ * The new page table holds 1024 entries with the large page's flags, so the
+ * translations stay identical and no TLB flush is needed. The table is filled
+ * through the direct map before it is linked in, since the memory it maps
+ * may be in use.
+ *
+ * @param pd       Physical address of the page directory.
+ * @param entries  Entries of the directory, as returned by pd_entries(pd).
+ * @param pd_index Index of the large page entry.
+ * @return 1 on success, 0 if the page table could not be allocated.
+ */
+static int split_large_page(uint32_t* pd, uint32_t* entries, uint32_t pd_index) {
+    uint32_t frame = (uint32_t)alloc_page();
+    if (!frame) return 0;
+
+    uint32_t base = entries[pd_index] & ~(LARGE_PAGE_SIZE - 1);
+    uint32_t flags = entries[pd_index] & 0xFFF & ~PAGE_LARGE;
+
+    uint32_t* page_table = (uint32_t*)phys_to_virt(frame);
+    for (uint32_t i = 0; i < 1024; i++) {
+        page_table[i] = (base + i * PAGE_SIZE) | flags;
+    }
+
+    entries[pd_index] = frame | (flags & ~PAGE_GLOBAL); // G is reserved in directory entries that link a table
+    if (is_active_directory(pd)) {
+        invlpg((uint32_t)pt_entries(pd, entries, pd_index)); // The window showed the 4MB page itself
+        tlb_shootdown();                                     // On every CPU running with this directory
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Returns the page table behind a page directory entry.
+ *
+ * A 4MB page at the entry is split into an equivalent page table. A missing
+ * table is taken from alloc_zeroed_page() when `create` is set. `flags` (PAGE_USER,
+ * PAGE_WRITABLE) are added to the directory entry so it never restricts the
+ * mappings made through it.
+ *
+ * The table of the active directory is returned through the recursive
+ * mapping, any other through the direct map. The self-map entry is never
+ * handed out.
+ *
+ * @param pd       Physical address of the page directory.
+ * @param pd_index Page directory index (top 10 bits of the virtual address).
+ * @param flags    Flags of the mapping about to be made.
+ * @param create   1 to allocate a missing page table, 0 to return NULL instead.
+ * @return Pointer to the page table, or NULL if it is missing or could not be allocated.
+ */
+static uint32_t* get_page_table(uint32_t* pd, uint32_t pd_index, uint32_t flags, int create) {
+    if (pd_index >= RECURSIVE_PD_INDEX) return NULL; // Reserved for the recursive mapping
+
+    uint32_t* entries = pd_entries(pd);
+
+    // Check if the page table exists
+    if (entries[pd_index] & PAGE_LARGE) {
+        // A 4MB page covers this address; break it up so one 4KB entry can change
+        if (!split_large_page(pd, entries, pd_index)) return NULL; // Out of memory
+    } else if (!(entries[pd_index] & PAGE_PRESENT)) {
+        if (!create) return NULL;
+
+        // Allocate a new (already zeroed) page table and map it into the page directory
+        uint32_t frame = (uint32_t)alloc_zeroed_page();
+        if (!frame) return NULL; // Out of memory
+        entries[pd_index] = frame | PAGE_PRESENT | PAGE_WRITABLE;
+        TRACE_EVENT(TRACE_PAGE_TABLE, pd_index, frame);
+
+        // The window may still cache a table that was linked at this entry before
+        if (is_active_directory(pd)) {
+            invlpg((uint32_t)pt_entries(pd, entries, pd_index));
+            tlb_shootdown();
+        }
+    }
+
+    entries[pd_index] |= flags & (PAGE_USER | PAGE_WRITABLE);
+    return pt_entries(pd, entries, pd_index);
+}
+
+/**
+ * @brief Maps a virtual address to a physical address in a given page directory.
+ *
+ * This function ensures that the specified virtual address is mapped to the
+ * given physical address within the provided page directory. If the corresponding
+ * page table does not exist, it will be dynamically allocated and initialized.
+ * Replacing a live mapping in the active page directory invalidates its TLB entry.
+ * Page tables are edited through the recursive mapping once paging is enabled.
+ *
+ * @param pd     Physical address of the page directory.
+ * @param vaddr  Virtual address to map.
+ * @param paddr  Physical address to map to.
+ * @param flags  Page flags (e.g., PAGE_WRITABLE, PAGE_USER).
+ * @return 1 on success, 0 if a new page table could not be allocated.
+ */
+int map_page_with_directory(uint32_t* pd, uint32_t vaddr, uint32_t paddr, uint32_t flags) {
+    TRACE_EVENT(TRACE_MAP_PAGE, vaddr, paddr);
+    uint32_t pt_index = (vaddr >> 12) & 0x3FF;    // Next 10 bits: Page Table index
+
+    uint32_t* page_table = get_page_table(pd, vaddr >> 22, flags, 1);
+    if (!page_table) return 0; // Out of memory
+
+    // Map the virtual address to the physical address in the page table
+    uint32_t old = page_table[pt_index];
+    page_table[pt_index] = (paddr & ~0xFFF) | mapping_flags(vaddr, flags) | PAGE_PRESENT;
+
+    // Changing a live mapping must drop the translation the CPUs may have cached
+    if ((old & PAGE_PRESENT) && is_active_directory(pd)) {
+        invlpg(vaddr);
+        tlb_shootdown();
+    }
+    return 1;
+}
+
+/**
+ * @brief Maps a single 4MB page in a given page directory.
+ *
+ * Requires 4MB page support, which init_physical_allocator() enables when the kernel
+ * is built with PAGING_PSE and the CPU reports PSE. A page table previously
+ * installed at this entry is freed, and the TLB is flushed if the entry was
+ * present.
+ *
+ * @param pd     Pointer to the page directory.
+ * @param vaddr  Virtual address to map (4MB aligned).
+ * @param paddr  Physical address to map to (4MB aligned).
+ * @param flags  Page flags (e.g., PAGE_WRITABLE, PAGE_USER).
+ * @return 1 on success, 0 if 4MB pages are unavailable, an address is misaligned,
+ *         or vaddr falls in the page table window.
+ */
+int map_large_page(uint32_t* pd, uint32_t vaddr, uint32_t paddr, uint32_t flags) {
+    if (!large_pages_enabled) return 0;
+    if ((vaddr | paddr) & (LARGE_PAGE_SIZE - 1)) return 0;
+
+    uint32_t pd_index = vaddr >> 22;
+    if (pd_index >= RECURSIVE_PD_INDEX) return 0; // Reserved for the recursive mapping
+
+    uint32_t* entries = pd_entries(pd);
+    uint32_t old = entries[pd_index];
+
+    entries[pd_index] = paddr | mapping_flags(vaddr, flags) | PAGE_LARGE | PAGE_PRESENT;
+
+    if (old & PAGE_PRESENT) {
+        if (is_active_directory(pd)) {
+            flush_tlb_for(vaddr); // Up to 1024 old translations may be cached
+            tlb_shootdown();
+        }
+        if (!(old & PAGE_LARGE)) free_page((void*)(old & ~0xFFF)); // The page table is no longer referenced
+    }
+    return 1;
+}
+
+/**
+ * @brief Maps a physically contiguous range, using 4MB pages where possible.
+ *
+ * Every part of the range where both addresses are 4MB aligned and at least
+ * 4MB remain is mapped with one large page; the unaligned edges (or the
+ * whole range if 4MB pages are unavailable) use 4KB pages.
+ *
+ * @param pd     Pointer to the page directory.
+ * @param vaddr  Virtual start address (4KB aligned).
+ * @param paddr  Physical start address (4KB aligned).
+ * @param len    Length of the range in bytes (rounded up to whole pages).
+ * @param flags  Page flags (e.g., PAGE_WRITABLE, PAGE_USER).
+ * @return 1 on success, 0 if a page table could not be allocated.
+ */
+int map_large_range(uint32_t* pd, uint32_t vaddr, uint32_t paddr, uint32_t len, uint32_t flags) {
+    uint32_t pages = (len + PAGE_SIZE - 1) / PAGE_SIZE;
+
+    while (pages) {
+        if (large_pages_enabled && pages >= 1024 &&
+            !((vaddr | paddr) & (LARGE_PAGE_SIZE - 1))) {
+            map_large_page(pd, vaddr, paddr, flags);
+            vaddr += LARGE_PAGE_SIZE;
+            paddr += LARGE_PAGE_SIZE;
+            pages -= 1024;
+        } else {
+            // Map 4KB pages up to the next 4MB boundary in one batch
+            uint32_t count = 1024 - ((vaddr >> 12) & 0x3FF);
+            if (count > pages) count = pages;
+
+            if (!map_range(pd, vaddr, paddr, count * PAGE_SIZE, flags)) return 0;
+            vaddr += count * PAGE_SIZE;
+            paddr += count * PAGE_SIZE;
+            pages -= count;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Removes the mapping of a virtual address from a given page directory.
+ *
+ * The TLB entry for the address is invalidated. The page table itself is
+ * left in place, and the physical page is not freed.
+ *
+ * @param pd    Pointer to the page directory.
+ * @param vaddr Virtual address to unmap.
+ * @return Physical address the page was mapped to, or 0 if it was not mapped.
+ */
+uint32_t unmap_page_with_directory(uint32_t* pd, uint32_t vaddr) {
+    uint32_t pt_index = (vaddr >> 12) & 0x3FF;
+
+    uint32_t* page_table = get_page_table(pd, vaddr >> 22, 0, 0);
+    if (!page_table) return 0;
+
+    uint32_t entry = page_table[pt_index];
+    if (!(entry & PAGE_PRESENT)) return 0;
+
+    page_table[pt_index] = 0;
+    if (is_active_directory(pd)) {
+        invlpg(vaddr); // Drop the stale translation, here and on the other CPUs
+        tlb_shootdown();
+    }
+
+    return entry & ~0xFFF;
+}
+
+/**
+ * @brief Maps a physically contiguous range of 4KB pages.
+ *
+ * Each page table is looked up (or created) once per 1024 entries instead
+ * of once per page. If the range replaces live mappings in the active page
+ * directory, their TLB entries are dropped with INVLPG for ranges of up to
+ * TLB_FLUSH_THRESHOLD pages, and with a single full flush otherwise (which
+ * for kernel addresses also drops global entries); the other CPUs are
+ * then flushed once with tlb_shootdown(). Kernel mappings are made global
+ * when the CPU supports it.
+ *
+ * @param pd     Pointer to the page directory.
+ * @param vaddr  Virtual start address (4KB aligned).
+ * @param paddr  Physical start address (4KB aligned).
+ * @param len    Length in bytes (rounded up to whole pages).
+ * @param flags  Page flags (e.g., PAGE_WRITABLE, PAGE_USER).
+ * @return 1 on success, 0 if a page table could not be allocated (pages before it stay mapped).
+ */
+int map_range(uint32_t* pd, uint32_t vaddr, uint32_t paddr, uint32_t len, uint32_t flags) {
+    uint32_t pages = (len + PAGE_SIZE - 1) / PAGE_SIZE;
+    int active = is_active_directory(pd);
+    int per_page = pages <= TLB_FLUSH_THRESHOLD; // Small ranges invalidate page by page
+    int flush = 0;                               // Large ranges remember to reload CR3 at the end
+    int remote = 0;                              // The other CPUs must flush too
+    int ok = 1;
+    uint32_t start = vaddr;
+
+    while (pages) {
+        uint32_t pt_index = (vaddr >> 12) & 0x3FF;
+        uint32_t count = 1024 - pt_index;       // Entries left in this page table
+        if (count > pages) count = pages;
+
+        uint32_t* page_table = get_page_table(pd, vaddr >> 22, flags, 1);
+        if (!page_table) {
+            ok = 0; // Out of memory
+            break;
+        }
+
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t old = page_table[pt_index + i];
+            page_table[pt_index + i] = ((paddr + i * PAGE_SIZE) & ~0xFFF) | mapping_flags(vaddr, flags) | PAGE_PRESENT;
+
+            if ((old & PAGE_PRESENT) && active) {
+                if (per_page) invlpg(vaddr + i * PAGE_SIZE);
+                else flush = 1;
+                remote = 1;
+            }
+        }
+
+        vaddr += count * PAGE_SIZE;
+        paddr += count * PAGE_SIZE;
+        pages -= count;
+    }
+
+    if (flush) flush_tlb_for(start);
+    if (remote) tlb_shootdown(); // Once for the whole range
+    return ok;
+}
+
+/**
+ * @brief Frees frames unmapped by unmap_range() once every CPU has dropped its translations.
+ *
+ * @param frames Physical addresses of the frames.
+ * @param count  Number of frames.
+ * @param vaddr  Start of the range, for flush_tlb_for().
+ * @param flush  The local TLB still needs a full flush.
+ * @param remote Translations of the active directory were dropped, so the other CPUs must flush as well.
+ */
+static void free_unmapped_frames(uint32_t* frames, uint32_t count, uint32_t vaddr, int flush, int remote) {
+    if (flush) flush_tlb_for(vaddr);
+    if (remote) tlb_shootdown();
+    for (uint32_t i = 0; i < count; i++) free_page((void*)frames[i]);
+}
 
-static uint32_t heap_current = KERNEL_HEAP_START; // Current end of the heap; used by kmalloc to allocate new memory blocks
-static BlockHeader* free_list = NULL; // Head pointer for the free list of memory blocks (used by kmalloc/kfree)
+/**
+ * @brief Unmaps a range of 4KB pages.
+ *
+ * Each page table is visited once per 1024 entries. Page tables of user
+ * space (below page directory entry 768) that end up empty are unlinked
+ * and returned to free_page(); kernel page tables are kept, since other
+ * page directories share them. TLB entries of the active page directory
+ * are dropped as in map_range(). Frames are only freed once no CPU can
+ * still reach them through a stale translation, UNMAP_FREE_BATCH at a time.
+ *
+ * @param pd     Pointer to the page directory.
+ * @param vaddr  Virtual start address (4KB aligned).
+ * @param len    Length in bytes (rounded up to whole pages).
+ * @param flags  UNMAP_FREE_FRAMES to also free the physical pages that were mapped
+ *               (a copy-on-write shared page is only freed with its last mapping).
+ */
+void unmap_range(uint32_t* pd, uint32_t vaddr, uint32_t len, uint32_t flags) {
+    uint32_t pages = (len + PAGE_SIZE - 1) / PAGE_SIZE;
+    int active = is_active_directory(pd);
+    int per_page = pages <= TLB_FLUSH_THRESHOLD;
+    int flush = 0;
+    int remote = 0;
+    uint32_t start = vaddr;
+    uint32_t frames[UNMAP_FREE_BATCH]; // Unmapped frames waiting for the TLB flushes
+    uint32_t frame_count = 0;
+
+    while (pages) {
+        uint32_t pd_index = vaddr >> 22;
+        uint32_t pt_index = (vaddr >> 12) & 0x3FF;
+        uint32_t count = 1024 - pt_index;
+        if (count > pages) count = pages;
+
+        uint32_t* page_table = get_page_table(pd, pd_index, 0, 0);
+        if (page_table) {
+            for (uint32_t i = 0; i < count; i++) {
+                uint32_t old = page_table[pt_index + i];
+                if (!(old & PAGE_PRESENT)) continue;
+
+                page_table[pt_index + i] = 0;
+                if (active) {
+                    if (per_page) invlpg(vaddr + i * PAGE_SIZE);
+                    else flush = 1;
+                    remote = 1;
+                }
+
+                if ((flags & UNMAP_FREE_FRAMES) && page_ref_drop(old & ~0xFFF)) {
+                    frames[frame_count++] = old & ~0xFFF;
+                    if (frame_count == UNMAP_FREE_BATCH) {
+                        free_unmapped_frames(frames, frame_count, start, flush, remote);
+                        frame_count = 0;
+                        flush = 0;
+                        remote = 0;
+                    }
+                }
+            }
+
+            // Release a user page table once nothing is mapped through it
+            if (pd_index < 768) {
+                uint32_t used = 0;
+                for (uint32_t i = 0; i < 1024 && !used; i++) used = page_table[i] & PAGE_PRESENT;
+                if (!used) {
+                    uint32_t* entries = pd_entries(pd);
+                    uint32_t frame = entries[pd_index] & ~0xFFF;
+                    entries[pd_index] = 0;
+                    free_page((void*)frame);
+                    if (active) flush = 1; // Cached paging-structure entries may still point at it
+                }
+            }
+        }
+
+        vaddr += count * PAGE_SIZE;
+        pages -= count;
+    }
 
-// Array to store information about memory regions that are usable
-MemoryRegion usable_memory_regions[MAX_MEMORY_REGIONS];
+    free_unmapped_frames(frames, frame_count, start, flush, remote);
+}
 
 /**
- * @brief Initializes the physical memory allocator.
- * 
- * Calculates usable memory from the multiboot memory map, sets up a bitmap
- * to track allocated/free pages, and marks pages as free or reserved.
- * Pages used by the bitmap itself are marked as used to prevent overwrite.
+ * @brief Makes physical memory the page allocator does not own reachable (device registers, firmware tables).
+ *
+ * A range inside the direct map asked for with the default caching is
+ * simply returned through it. Anything else is mapped into the MMIO
+ * window with the given flags, for good: the window space is never
+ * given back, so this is meant for mappings that last as long as the
+ * kernel (each call takes new space, even for the same range).
+ *
+ * @param paddr Physical address.
+ * @param len   Bytes needed from paddr.
+ * @param flags PAGE_WRITABLE, PAGE_CACHE_DISABLE and PAGE_WRITE_THROUGH as the range needs.
+ * @return Virtual address of paddr, or NULL if the MMIO window is full or a page table could not be allocated.
  */
-void init_physical_allocator() {
-    memory_start = 0xFFFFFFFF;
-    uint64_t memory_end = 0;
+void* map_physical(uint32_t paddr, uint32_t len, uint32_t flags) {
+    uint32_t end = paddr + len;
+    if (end < paddr) return NULL; // Wraps around
+    if (!(flags & (PAGE_CACHE_DISABLE | PAGE_WRITE_THROUGH)) && end <= direct_map_limit) return phys_to_virt(paddr);
 
-    // Determine memory bounds from usable regions
-    for (uint32_t i = 0; i < usable_region_count; i++) {
-        if ((uint32_t)usable_memory_regions[i].base < memory_start)
-            memory_start = (uint32_t)usable_memory_regions[i].base;
+    uint32_t offset = paddr & (PAGE_SIZE - 1);
+    uint32_t size = (offset + len + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    flags &= PAGE_WRITABLE | PAGE_CACHE_DISABLE | PAGE_WRITE_THROUGH;
 
-        uint64_t end = usable_memory_regions[i].base + usable_memory_regions[i].length;
-        if (end > memory_end)
-            memory_end = end;
+    void* mapped = NULL;
+    uint32_t irq_flags = spin_lock_irqsave(&paging_lock);
+    uint32_t vaddr = mmio_next;
+    if (size <= KERNEL_MMIO_END - vaddr && map_range(page_directory, vaddr, paddr - offset, size, flags)) {
+        mmio_next += size;
+        mapped = (void*)(vaddr + offset);
     }
+    spin_unlock_irqrestore(&paging_lock, irq_flags);
 
-    // Calculate total number of pages and bitmap size
-    total_pages = (memory_end - memory_start) / PAGE_SIZE;
-    bitmap_size_bytes = (total_pages + 7) / 8;
+    if (!mapped) klog(LOG_WARN, "map_physical: cannot map %u bytes at %p", len, (void*)paddr);
+    return mapped;
+}
 
-    // Place bitmap just after the kernel in memory, aligned to page boundary
-    page_bitmap = (uint8_t*)(((uint32_t)&kernel_end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1));
+/**
+ * @brief Reserves a demand-zero range of virtual memory.
+ *
+ * No memory is allocated up front. The first read of a page maps the shared
+ * zero page read-only (copy-on-write if the range is writable); the first
+ * write maps a freshly zeroed page.
+ *
+ * @param pd     Physical address of the page directory (page_directory for kernel space).
+ * @param vaddr  Start of the range (rounded down to a page).
+ * @param len    Length in bytes (rounded up to whole pages).
+ * @param flags  Flags the pages are mapped with (PAGE_WRITABLE, PAGE_USER).
+ * @return 1 on success, 0 if the range overlaps another one or no slot is free.
+ */
+int reserve_region(uint32_t* pd, uint32_t vaddr, uint32_t len, uint32_t flags) {
+    uint32_t start = vaddr & ~(PAGE_SIZE - 1);
+    uint32_t end = (vaddr + len + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    if (end <= start) return 0;
+    if (start < KERNEL_SPACE_START && end > KERNEL_SPACE_START) return 0; // Must not straddle the kernel half
+    if (end > KERNEL_HEAP_START && start < KERNEL_HEAP_END) return 0;      // The heap window is managed by ksbrk()
+    if (end > KERNEL_VIRTUAL_BASE && start < KERNEL_VIRTUAL_BASE + DIRECT_MAP_SIZE) return 0; // Kernel image and direct map
 
-    // Initially mark all pages as used
-    for (uint32_t i = 0; i < total_pages; i++) {
-        BITMAP_SET(page_bitmap, i);
+    demand_region_t* free_slot = NULL;
+    for (uint32_t i = 0; i < MAX_DEMAND_REGIONS; i++) {
+        demand_region_t* region = &demand_regions[i];
+        if (region->end == region->start) {
+            if (!free_slot) free_slot = region;
+        } else if (region->pd == pd && start < region->end && region->start < end) {
+            return 0; // Overlap
+        }
     }
+    if (!free_slot) return 0;
 
-    // Mark usable pages as free
-    for (uint32_t i = 0; i < usable_region_count; i++) {
-        uint64_t start = usable_memory_regions[i].base;
-        uint64_t end = start + usable_memory_regions[i].length;
+    free_slot->pd = pd;
+    free_slot->start = start;
+    free_slot->end = end;
+    free_slot->flags = flags & (PAGE_WRITABLE | PAGE_USER);
+    return 1;
+}
 
-        for (uint64_t addr = start; addr < end; addr += PAGE_SIZE) {
-            uint32_t page_index = ((uint32_t)addr - memory_start) / PAGE_SIZE;
-            if (page_index < total_pages) {
-                BITMAP_CLEAR(page_bitmap, page_index);
-            }
-        }
+/**
+ * @brief Releases a range reserved with reserve_region(), freeing the pages it got.
+ *
+ * @param pd    Page directory passed to reserve_region().
+ * @param vaddr Start of the range.
+ */
+void release_region(uint32_t* pd, uint32_t vaddr) {
+    for (uint32_t i = 0; i < MAX_DEMAND_REGIONS; i++) {
+        demand_region_t* region = &demand_regions[i];
+        if (region->pd != pd || region->end == region->start || region->start != (vaddr & ~(PAGE_SIZE - 1))) continue;
+
+        unmap_range(pd, region->start, region->end - region->start, UNMAP_FREE_FRAMES);
+        region->pd = NULL;
+        region->end = region->start;
+        return;
     }
+}
 
-    // Mark pages used by the bitmap itself as used
-    uint32_t bitmap_start = (uint32_t)page_bitmap;
-    uint32_t bitmap_end = bitmap_start + bitmap_size_bytes;
+/**
+ * @brief Finds the demand-zero range covering an address of the active address space.
+ *
+ * Kernel addresses are looked up among the ranges of page_directory, user
+ * addresses among those of the directory loaded in CR3.
+ *
+ * @return The range, or NULL if the address is not reserved.
+ */
+static demand_region_t* find_demand_region(uint32_t vaddr) {
+    if (vaddr >= heap_region.start && vaddr < heap_region.end) return &heap_region;
 
-    for (uint32_t addr = bitmap_start; addr < bitmap_end; addr += PAGE_SIZE) {
-        uint32_t page_index = (addr - memory_start) / PAGE_SIZE;
-        if (page_index < total_pages) {
-            BITMAP_SET(page_bitmap, page_index);
-        }
+    uint32_t* pd = vaddr >= KERNEL_SPACE_START ? page_directory : (uint32_t*)(read_cr3() & ~0xFFF);
+    for (uint32_t i = 0; i < MAX_DEMAND_REGIONS; i++) {
+        demand_region_t* region = &demand_regions[i];
+        if (region->pd == pd && vaddr >= region->start && vaddr < region->end) return region;
     }
+    return NULL;
 }
 
 /**
- * @brief Allocates a single 4KB physical page.
- * 
- * @return Pointer to the start of the allocated physical page, or NULL if none available.
+ * @brief Copies a kernel page directory entry into the active directory if it lacks it.
+ *
+ * Kernel page tables created after a directory was made (by the heap, say)
+ * only exist in page_directory; other directories pick them up here, on
+ * their first fault in that part of kernel space.
+ *
+ * @param vaddr Faulting kernel address.
+ * @return 1 if an entry was copied, 0 if the active directory was already up to date.
  */
-void* alloc_page() {
-    for (uint32_t i = 0; i < total_pages; i++) {
-        if (!BITMAP_TEST(page_bitmap, i)) {
-            BITMAP_SET(page_bitmap, i);
-            return (void*)(memory_start + i * PAGE_SIZE);
+static int sync_kernel_entry(uint32_t vaddr) {
+    uint32_t pd_index = vaddr >> 22;
+    if (vaddr < KERNEL_SPACE_START || pd_index >= RECURSIVE_PD_INDEX) return 0;
+    if (is_active_directory(page_directory)) return 0;
+
+    uint32_t* active = (uint32_t*)PAGE_DIRECTORY_VADDR;
+    uint32_t kernel_entry = pd_entries(page_directory)[pd_index];
+    if (!(kernel_entry & PAGE_PRESENT) || active[pd_index] == kernel_entry) return 0;
+
+    active[pd_index] = kernel_entry;
+    invlpg(PAGE_TABLES_VADDR + pd_index * PAGE_SIZE);
+    return 1;
+}
+
+/**
+ * @brief Backs a page of a demand-zero range after a not-present fault.
+ *
+ * Reads map the shared zero page read-only, marked PAGE_COW in a writable
+ * range so a later write gets a private copy. Writes map a new zeroed page,
+ * from high memory when there is some (it is cleared through kmap()).
+ *
+ * @param vaddr Faulting address.
+ * @param write Non-zero if the access was a write.
+ * @return 1 if the page is now mapped, 0 if the address is not reserved or memory ran out.
+ */
+static int handle_demand_fault(uint32_t vaddr, int write) {
+    demand_region_t* region = find_demand_region(vaddr);
+    if (!region) return 0;
+    if (write && !(region->flags & PAGE_WRITABLE)) return 0;
+
+    uint32_t* pd = vaddr >= KERNEL_SPACE_START ? page_directory : (uint32_t*)(read_cr3() & ~0xFFF);
+    uint32_t page = vaddr & ~(PAGE_SIZE - 1);
+
+    // Another CPU may have backed the page since this one faulted
+    uint32_t pde = ((uint32_t*)PAGE_DIRECTORY_VADDR)[page >> 22];
+    if ((pde & PAGE_PRESENT) && !(pde & PAGE_LARGE)) {
+        uint32_t pte = ((uint32_t*)PAGE_TABLES_VADDR)[page >> 12];
+        if ((pte & PAGE_PRESENT) && (!write || (pte & PAGE_WRITABLE))) {
+            invlpg(page);
+            return 1;
         }
     }
-    return 0; // Out of memory
+
+    if (!write) {
+        uint32_t flags = region->flags & ~PAGE_WRITABLE;
+        if (region->flags & PAGE_WRITABLE) flags |= PAGE_COW;
+        if (!map_range(pd, page, zero_page, PAGE_SIZE, flags)) return 0;
+        sync_kernel_entry(page);
+        return 1;
+    }
+
+    // The page is only used through this mapping, so high memory will do
+    uint32_t frame = (uint32_t)alloc_highmem_page();
+    if (frame) {
+        void* mapped = kmap(frame);
+        memset(mapped, 0, PAGE_SIZE);
+        kunmap(mapped);
+    } else {
+        frame = (uint32_t)alloc_zeroed_page();
+        if (!frame) return 0; // Out of memory
+    }
+    if (!map_range(pd, page, frame, PAGE_SIZE, region->flags)) {
+        free_page((void*)frame);
+        return 0;
+    }
+    sync_kernel_entry(page);
+    return 1;
 }
 
 /**
- * @brief Frees a previously allocated page.
- * 
- * @param addr Physical address of the page to free.
+ * @brief Page fault (#PF) handler.
+ *
+ * Write faults on present pages go to handle_cow_fault(). Not-present faults
+ * first pick up kernel page tables missing from the active directory, then
+ * back demand-zero pages. Faults are resolved one at a time under
+ * paging_lock, so two CPUs touching the same page do not both back it.
+ * Any other fault is reported and halts the system.
+ *
+ * @param frame Saved register state; err_code holds the PF_* bits.
  */
-void free_page(void* addr) {
-    uint32_t page_index = ((uint32_t)addr - memory_start) / PAGE_SIZE;
-    if (page_index < total_pages) {
-        BITMAP_CLEAR(page_bitmap, page_index);
+static void page_fault_handler(interrupt_frame_t* frame) {
+    uint32_t vaddr = read_cr2();
+    TRACE_EVENT(TRACE_PAGE_FAULT, vaddr, frame->err_code);
+
+    int resolved = 0;
+    spin_lock(&paging_lock); // Interrupts are off: the fault came through an interrupt gate
+    if (frame->err_code & PF_PRESENT) {
+        resolved = (frame->err_code & PF_WRITE) && handle_cow_fault(vaddr);
+    } else {
+        resolved = sync_kernel_entry(vaddr) || handle_demand_fault(vaddr, frame->err_code & PF_WRITE);
     }
+    spin_unlock(&paging_lock);
+    if (resolved) return;
+
+    klog(LOG_ERROR, "Page fault at %p (error %p) at %p", (void*)vaddr, (void*)frame->err_code, (void*)frame->eip);
+
+    while (1) asm volatile("cli\n\thlt");
 }
 
 /**
- * @brief Maps a virtual address to a physical address in a given page directory.
+ * @brief Inserts a range into memory_regions, keeping the table sorted and merged.
  *
- * This function ensures that the specified virtual address is mapped to the
- * given physical address within the provided page directory. If the corresponding
- * page table does not exist, it will be dynamically allocated and initialized.
+ * The range is merged with every region of the same type it overlaps or
+ * touches. When the table is full, the region with the highest address is
+ * given up (it is the least likely to be in the direct map) and its size
+ * counted in dropped_region_bytes.
  *
- * @param pd     Pointer to the page directory.
- * @param vaddr  Virtual address to map.
- * @param paddr  Physical address to map to.
- * @param flags  Page flags (e.g., PAGE_WRITABLE, PAGE_USER).
+ * @param base   Start address.
+ * @param length Length in bytes.
+ * @param type   MULTIBOOT_MEMORY_AVAILABLE or MULTIBOOT_MEMORY_ACPI_RECLAIMABLE.
  */
-void map_page_with_directory(uint32_t* pd, uint32_t vaddr, uint32_t paddr, uint32_t flags) {
-    uint32_t pd_index = vaddr >> 22;             // Top 10 bits: Page Directory index
-    uint32_t pt_index = (vaddr >> 12) & 0x3FF;    // Next 10 bits: Page Table index
+static void add_memory_region(uint64_t base, uint64_t length, uint32_t type) {
+    uint64_t end = base + length;
+    if (length == 0) return;
 
-    uint32_t* page_table;
+    // The range goes before the first region that starts above it
+    uint32_t i = 0;
+    while (i < memory_region_count && memory_regions[i].base <= base) i++;
 
-    // Check if the page table exists
-    if (pd[pd_index] & PAGE_PRESENT) {
-        // Get the address of the existing page table
-        page_table = (uint32_t*)(pd[pd_index] & ~0xFFF);
+    MemoryRegion* region;
+    if (i > 0 && memory_regions[i - 1].type == type && region_end(&memory_regions[i - 1]) >= base) {
+        region = &memory_regions[--i]; // Continues (or overlaps) the previous region
+        if (end > region_end(region)) region->length = end - region->base;
+    } else if (i < memory_region_count && memory_regions[i].type == type && memory_regions[i].base <= end) {
+        region = &memory_regions[i]; // Reaches the next region
+        uint64_t next_end = region_end(region);
+        region->base = base;
+        region->length = (end > next_end ? end : next_end) - base;
     } else {
-        // Allocate a new page table
-        page_table = (uint32_t*)alloc_page();
-        for (int i = 0; i < 1024; i++) page_table[i] = 0;
-
-        // Map the new page table into the page directory
-        pd[pd_index] = ((uint32_t)page_table & ~0xFFF) | flags | PAGE_PRESENT;
+        if (memory_region_count == MAX_MEMORY_REGIONS) {
+            if (i == MAX_MEMORY_REGIONS) {
+                dropped_region_bytes += length;
+                return;
+            }
+            dropped_region_bytes += memory_regions[--memory_region_count].length;
+        }
+        memmove(&memory_regions[i + 1], &memory_regions[i], (memory_region_count - i) * sizeof(MemoryRegion));
+        region = &memory_regions[i];
+        region->base = base;
+        region->length = length;
+        region->type = type;
+        memory_region_count++;
     }
 
-    // Map the virtual address to the physical address in the page table
-    page_table[pt_index] = (paddr & ~0xFFF) | flags | PAGE_PRESENT;
+    // Absorb the following regions the grown region now reaches
+    while (i + 1 < memory_region_count && memory_regions[i + 1].type == type &&
+           memory_regions[i + 1].base <= region_end(region)) {
+        uint64_t next_end = region_end(&memory_regions[i + 1]);
+        if (next_end > region_end(region)) region->length = next_end - region->base;
+
+        memmove(&memory_regions[i + 1], &memory_regions[i + 2], (memory_region_count - i - 2) * sizeof(MemoryRegion));
+        memory_region_count--;
+    }
 }
 
 /**
@@ -144,166 +1952,403 @@ void map_page_with_directory(uint32_t* pd, uint32_t vaddr, uint32_t paddr, uint3
  *
  * This function iterates through the Multiboot tags starting from the
  * given multiboot_info pointer, locates the memory map tag (type 6),
- * and extracts usable memory regions from the memory map entries.
+ * and extracts the usable and ACPI reclaimable regions from the memory
+ * map entries. A copy of the ACPI RSDP (tags 14 and 15) is handed to
+ * acpi_set_rsdp().
  *
  * @param multiboot_info Pointer to the start of the Multiboot information structure.
  *                       The first 8 bytes (total_size and reserved) are skipped,
  *                       and parsing starts from the first tag.
  *
- * This function populates the global usable_memory_regions array and increments
- * usable_region_count for each available memory region found.
+ * This function populates the global memory_regions array, sorted by base
+ * address, with overlapping or adjacent entries of the same type merged
+ * into one region, whatever order the firmware listed them in.
  */
 void parse_memory_map(uint8_t* multiboot_info) {
+    // Remember where the structure is so the allocator keeps it (total_size is its first field)
+    multiboot_info_start = virt_to_phys(multiboot_info);
+    multiboot_info_end = multiboot_info_start + *(uint32_t*)multiboot_info;
+
     multiboot_tag* tag = (multiboot_tag*)(multiboot_info + 8); // Skips the first 8 bytes (which include total_size and reserved) to get to the first tag.
 
     while (tag->type != 0) { // Loop through tags until type 0 (end tag).
-        if (tag->type == 6) { // Type 6 means this is the memory map tag.
+        if (tag->type == MULTIBOOT_TAG_MMAP) { // Type 6 means this is the memory map tag.
             uint32_t entry_size = *((uint32_t*)((uint8_t*)tag + 8)); // Extract the size of each memory map entry.
             memory_map_entry* entry = (memory_map_entry*)((uint8_t*)tag + 16); // Set pointer to first entry.
             
             while ((uint8_t*)entry < ((uint8_t*)tag + tag->size)) { // Loop through all memory map entries in this tag.                
-                // Store available memory regions
-                if (entry->type == 1 && usable_region_count < MAX_MEMORY_REGIONS) {
-                    usable_memory_regions[usable_region_count].base = entry->addr;
-                    usable_memory_regions[usable_region_count].length = entry->len;
-                    usable_region_count++;
+                // Store available memory regions, and the ACPI tables to reclaim later
+                if (entry->type == MULTIBOOT_MEMORY_AVAILABLE || entry->type == MULTIBOOT_MEMORY_ACPI_RECLAIMABLE) {
+                    add_memory_region(entry->addr, entry->len, entry->type);
                 }
 
                 entry = (memory_map_entry*)((uint8_t*)entry + entry_size); // Move to the next memory map entry based on size.
             }
         }
 
+        if (tag->type == MULTIBOOT_TAG_ACPI_OLD || tag->type == MULTIBOOT_TAG_ACPI_NEW) {
+            acpi_set_rsdp((uint8_t*)tag + 8); // GRUB's copy of the RSDP, for acpi_parse_madt()
+        }
+
         tag = (multiboot_tag*)((uint8_t*)tag + ((tag->size + 7) & ~7)); // Move to the next tag. Tags must be aligned to 8 bytes, so this rounds up the size.
     }
 }
 
 /**
- * @brief Sets up basic paging for the system by initializing the page directory,
- * identity mapping the first 4MB of physical memory with writable pages,
- * loading the page directory base register (CR3), and enabling paging by
- * setting the PG bit in the CR0 control register.
+ * @brief Takes over the boot page directory as the kernel page directory.
  *
- * This function assumes that the page_directory pointer is already
- * allocated and points to a zeroed 4KB-aligned page directory.
- * The identity mapping maps virtual addresses 0x00000000 to 0x003FFFFF
- * directly to the same physical addresses, which is typically required
- * during early kernel initialization.
+ * boot.asm enabled paging with the first BOOT_MAP_SIZE of physical memory
+ * mapped twice: at 0 (for the trampoline) and at KERNEL_VIRTUAL_BASE,
+ * where the kernel is linked. init_physical_allocator() has since extended
+ * the higher mapping into the direct map. This drops the identity mapping,
+ * so user space (page directory entries 0-767) starts out empty, and
+ * points the last directory entry at the directory itself, so page tables
+ * stay reachable at PAGE_TABLES_VADDR.
+ *
+ * Kernel mappings carry PAGE_GLOBAL when the CPU supports it, so they
+ * survive address space switches without being flushed from the TLB.
+ *
+ * CR0.WP is set so read-only (copy-on-write) pages also fault on kernel
+ * writes, and the page fault handler is installed; init_idt() must have run.
  */
 void setup_paging() {
-    for (int i = 0; i < 1024; i++) page_directory[i] = 0;
+    page_directory = (uint32_t*)virt_to_phys(boot_page_directory);
+
+    // Recursive entry, then drop the identity mapping the trampoline ran from
+    boot_page_directory[RECURSIVE_PD_INDEX] = (uint32_t)page_directory | PAGE_PRESENT | PAGE_WRITABLE;
+    memset(boot_page_directory, 0, (KERNEL_SPACE_START >> 22) * sizeof(uint32_t));
+    flush_tlb_global(); // The identity mapping shares the boot page tables, whose entries may be global
+    paging_enabled = 1;
+
+    // Shared zero page for reads of untouched demand-zero pages
+    if (!zero_page) zero_page = (uint32_t)alloc_zeroed_page();
 
-    // Identity map first 4MB
-    for (uint32_t i = 0; i < 0x400000; i += PAGE_SIZE) {
-        //map_page(i, i, PAGE_WRITABLE);
-        map_page_with_directory(page_directory, i, i, PAGE_WRITABLE);
+    // Page table of the kmap() slots, made before any other directory so they all share it
+    uint32_t kmap_pd_index = KMAP_START >> 22;
+    if (!kmap_ptes && get_page_table(page_directory, kmap_pd_index, PAGE_WRITABLE, 1)) {
+        uint32_t table = pd_entries(page_directory)[kmap_pd_index] & ~0xFFF;
+        kmap_ptes = (uint32_t*)phys_to_virt(table) + ((KMAP_START >> 12) & 0x3FF);
     }
 
-    // Load CR3
-    asm volatile("mov %0, %%cr3" :: "r"(page_directory));
+    write_cr0(read_cr0() | CR0_WP); // Make read-only pages binding for the kernel too
 
-    // Enable paging (set PG bit in CR0)
-    uint32_t cr0;
-    asm volatile("mov %%cr0, %0" : "=r"(cr0));
-    cr0 |= 0x80000000; // Set PG bit
-    asm volatile("mov %0, %%cr0" :: "r"(cr0));
+    // Demand-zero and copy-on-write pages are filled in by the page fault handler
+    register_interrupt_handler(EXCEPTION_PAGE_FAULT, page_fault_handler);
+
+    klog(LOG_INFO, "paging: kernel at %x, %u MiB direct map with %s pages%s", (uint32_t)&kernel_start,
+         memory_end >> 20, large_pages_enabled ? "4MB" : "4KB",
+         global_pages_enabled ? ", global" : "");
 }
 
 /**
- * @brief Allocates a block of memory from the kernel heap.
+ * @brief Moves the kernel heap break by `increment` bytes.
+ *
+ * Growing the heap only extends the heap's demand-zero range, so pages are
+ * taken from alloc_page() by the page fault handler when they are first
+ * touched and a large allocation costs nothing until it is used. Shrinking
+ * it unmaps and frees the pages above the new break once at least
+ * HEAP_TRIM_THRESHOLD bytes of them are unused, so a block freed and
+ * reallocated at the top does not remap pages each time. heap_lock must
+ * be held.
+ *
+ * @param increment Number of bytes to grow (positive) or shrink (negative) the heap by.
+ * @return The previous break, or NULL if the heap window is exhausted.
+ */
+static void* heap_sbrk(int32_t increment) {
+    uint32_t old_break = heap_current;
+    uint32_t new_break = old_break + (uint32_t)increment;
+
+    if (increment > 0) {
+        if (new_break > KERNEL_HEAP_END || new_break < old_break) return NULL; // Heap window exhausted
+
+        // Reserve every page up to the new break; they are backed on first touch
+        if (heap_mapped_end < new_break) {
+            heap_mapped_end = (new_break + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+            heap_region.end = heap_mapped_end;
+        }
+    } else if (increment < 0) {
+        if (new_break < KERNEL_HEAP_START || new_break > old_break) return NULL;
+
+        // Give whole pages above the break back once enough of them have piled up
+        uint32_t keep_end = (new_break + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+        if (heap_mapped_end - keep_end >= HEAP_TRIM_THRESHOLD) {
+            heap_region.end = keep_end;
+            unmap_range(page_directory, keep_end, heap_mapped_end - keep_end, UNMAP_FREE_FRAMES);
+            heap_mapped_end = keep_end;
+        }
+    }
+
+    heap_current = new_break;
+    return (void*)old_break;
+}
+
+/**
+ * @brief Moves the kernel heap break by `increment` bytes.
+ *
+ * Growing the heap only extends the heap's demand-zero range, so pages
+ * are backed when first touched; shrinking it gives whole pages back once
+ * HEAP_TRIM_THRESHOLD bytes of them are unused (see heap_sbrk()). Paging
+ * must already be enabled.
  *
- * This function implements a simple heap allocator using a free list of previously
- * freed blocks. It first attempts to find a suitable free block from the free list.
- * If none are large enough, it allocates a new block from the heap.
+ * @param increment Number of bytes to grow (positive) or shrink (negative) the heap by.
+ * @return The previous break, or NULL if the heap window is exhausted.
+ */
+void* ksbrk(int32_t increment) {
+    uint32_t flags = spin_lock_irqsave(&heap_lock);
+    void* old_break = heap_sbrk(increment);
+    spin_unlock_irqrestore(&heap_lock, flags);
+    return old_break;
+}
+
+/**
+ * @brief Returns the address just past the end of a heap block (header + payload).
+ */
+static inline uint32_t block_end(BlockHeader* block) {
+    return (uint32_t)(block + 1) + block->size;
+}
+
+/**
+ * @brief Allocates a block from the heap free list, growing the heap if needed.
  *
- * The memory returned is aligned to 8 bytes. Metadata (BlockHeader) is stored just
- * before the returned memory pointer.
+ * The free list is kept in address order. The first block that is large
+ * enough is used (the smallest one when built with HEAP_BEST_FIT). A block
+ * with enough room left over is split, and the remainder stays on the free
+ * list. If no free block is large enough, the heap is grown with ksbrk()
+ * and a new block is carved from the fresh space. heap_lock must be held.
  *
  * @param size Number of bytes to allocate.
- * @return Pointer to allocated memory, or NULL if out of memory.
+ * @return Pointer just after the block's BlockHeader, or NULL if out of memory.
  */
-void* kmalloc(uint32_t size) {
+static void* heap_alloc_locked(uint32_t size) {
     size = ALIGN8(size);  // Align size to 8 bytes for better memory alignment
 
     BlockHeader* prev = NULL;
     BlockHeader* curr = free_list;
+    BlockHeader* fit = NULL;       // Block chosen for this request
+    BlockHeader* fit_prev = NULL;  // Block before it in the free list
+    uint32_t walked = 0;           // Free blocks looked at, for TRACE_HEAP_WALK
 
     // Search for a suitable free block in the free list
     while (curr) {
+        walked++;
         if (curr->size >= size) {
-            // Found a block big enough
-            if (prev) {
-                prev->next = curr->next;  // Remove block from the middle of the list
-            } else {
-                free_list = curr->next;   // Remove block from the head of the list
+#ifdef HEAP_BEST_FIT
+            // Keep the smallest block that fits; an exact fit cannot be beaten
+            if (!fit || curr->size < fit->size) {
+                fit = curr;
+                fit_prev = prev;
+                if (curr->size == size) break;
             }
-
-            return (void*)(curr + 1);     // Return pointer just after the header
+#else
+            // First fit: take the lowest-addressed block that is big enough
+            fit = curr;
+            fit_prev = prev;
+            break;
+#endif
         }
 
         prev = curr;
         curr = curr->next;
     }
+    TRACE_EVENT(TRACE_HEAP_WALK, size, walked);
+
+    if (fit) {
+        BlockHeader* next = fit->next;
+
+        // Split off the tail if it can hold a header and a minimum payload
+        if (fit->size >= size + sizeof(BlockHeader) + HEAP_MIN_SPLIT) {
+            BlockHeader* rest = (BlockHeader*)((uint8_t*)(fit + 1) + size);
+            rest->size = fit->size - size - sizeof(BlockHeader);
+            rest->next = next;
+            next = rest;           // The remainder takes the block's place in the list
+            fit->size = size;
+        }
+
+        if (fit_prev) {
+            fit_prev->next = next;  // Remove block from the middle of the list
+        } else {
+            free_list = next;       // Remove block from the head of the list
+        }
+
+        return (void*)(fit + 1);    // Return pointer just after the header
+    }
 
-    // No suitable free block found, allocate new memory from heap
+    // No suitable free block found, grow the heap
+    if (size > KERNEL_HEAP_MAX_SIZE) return NULL; // Can never fit in the heap window
     uint32_t total_size = sizeof(BlockHeader) + size;
-    if (heap_current + total_size > KERNEL_HEAP_END) {
+    BlockHeader* block = (BlockHeader*)heap_sbrk((int32_t)total_size);
+    if (!block) {
         return NULL;  // Out of heap memory
     }
 
     // Set up new block
-    BlockHeader* block = (BlockHeader*)heap_current;
     block->size = size;
-    heap_current += total_size;
 
     return (void*)(block + 1);  // Return pointer after the header
 }
 
+/**
+ * @brief Allocates a block from the heap under heap_lock (see heap_alloc_locked()).
+ */
+static void* heap_alloc(uint32_t size) {
+    uint32_t flags = spin_lock_irqsave(&heap_lock);
+    void* ptr = heap_alloc_locked(size);
+    spin_unlock_irqrestore(&heap_lock, flags);
+    return ptr;
+}
+
+/**
+ * @brief Returns the number of bytes actually reserved for a kmalloc() allocation.
+ *
+ * @param ptr Pointer returned by kmalloc().
+ * @return Heap block payload size or slab object size.
+ */
+uint32_t kmalloc_usable_size(void* ptr) {
+    if ((uint32_t)ptr < KERNEL_HEAP_START || (uint32_t)ptr >= KERNEL_HEAP_END) {
+        return slab_object_size(ptr);
+    }
+    return (((BlockHeader*)ptr) - 1)->size;
+}
+
+/**
+ * @brief Allocates a block of memory from the kernel heap.
+ *
+ * Requests of up to SLAB_MAX_SIZE bytes are served from the power-of-two
+ * slab caches once init_slab_allocator() has run. Larger requests (and
+ * small ones if no slab page can be allocated) use the heap.
+ *
+ * The heap allocator uses an address-ordered free list of previously freed
+ * blocks. It first attempts to find a suitable
+ * free block from the free list (first fit by default, best fit when built
+ * with HEAP_BEST_FIT). A block with enough room left over is split, and the
+ * remainder stays on the free list. If no free block is large enough, it
+ * grows the heap with ksbrk() and carves a new block from the fresh space.
+ *
+ * The memory returned is aligned to 8 bytes. Heap blocks carry their metadata
+ * (BlockHeader) just before the returned memory pointer; slab objects have none.
+ *
+ * @param size Number of bytes to allocate.
+ * @return Pointer to allocated memory, or NULL if out of memory.
+ */
+void* kmalloc(uint32_t size) {
+    uint64_t start = rdtsc();
+    void* ptr = NULL;
+
+    // Small requests come from the size-class slab caches
+    kmem_cache_t* cache = kmalloc_cache_for(size);
+    if (cache) ptr = kmem_cache_alloc(cache);
+    if (!ptr) ptr = heap_alloc(size);
+
+    uint32_t usable = ptr ? kmalloc_usable_size(ptr) : 0;
+    uint32_t flags = spin_lock_irqsave(&stats_lock);
+    counters_alloc(&heap_counters, usable);
+    latency_record(&kmalloc_latency, start);
+    spin_unlock_irqrestore(&stats_lock, flags);
+
+    TRACE_EVENT(TRACE_KMALLOC, size, ptr);
+    return ptr;
+}
+
 /**
  * @brief Frees a previously allocated block of memory.
  * 
- * Adds the block pointed to by ptr back to the free list for reuse in future allocations.
+ * Pointers outside the heap window belong to a slab cache and are returned
+ * to it. Heap blocks are inserted into the address-ordered free list and
+ * merged with the free blocks directly before and after it. A free block
+ * that ends at the top of the heap is returned to the heap instead.
  * The pointer must have been returned by a prior call to kmalloc().
- * 
- * This function does not merge adjacent free blocks (no coalescing).
  *
  * @param ptr Pointer to the memory block to free. If NULL, the function does nothing.
  */
 void kfree(void* ptr) {
     if (!ptr) return;  // Ignore NULL pointers
+    TRACE_EVENT(TRACE_KFREE, ptr, __builtin_return_address(0));
+
+    uint32_t usable = kmalloc_usable_size(ptr);
+    uint32_t flags = spin_lock_irqsave(&stats_lock);
+    counters_free(&heap_counters, usable);
+    spin_unlock_irqrestore(&stats_lock, flags);
+
+    // Anything outside the heap window came from a slab cache
+    if ((uint32_t)ptr < KERNEL_HEAP_START || (uint32_t)ptr >= KERNEL_HEAP_END) {
+        slab_free(ptr);
+        return;
+    }
 
     // Retrieve the block header located just before the user pointer
     BlockHeader* block = ((BlockHeader*)ptr) - 1;
+    flags = spin_lock_irqsave(&heap_lock);
+
+    // Find the free blocks on either side of this address
+    BlockHeader* before_prev = NULL; // Predecessor of prev, needed if the merged block is trimmed
+    BlockHeader* prev = NULL;
+    BlockHeader* curr = free_list;
+    while (curr && curr < block) {
+        before_prev = prev;
+        prev = curr;
+        curr = curr->next;
+    }
+
+    // Merge with the following block if they touch
+    if (curr && block_end(block) == (uint32_t)curr) {
+        block->size += sizeof(BlockHeader) + curr->size;
+        curr = curr->next;
+    }
+    block->next = curr;
 
-    // Insert the freed block at the front of the free list
-    block->next = free_list;
-    free_list = block;
+    // Merge with the preceding block if they touch, otherwise link in after it
+    if (prev && block_end(prev) == (uint32_t)block) {
+        prev->size += sizeof(BlockHeader) + block->size;
+        prev->next = block->next;
+        block = prev;
+        prev = before_prev;
+    } else if (prev) {
+        prev->next = block;
+    } else {
+        free_list = block;
+    }
+
+    // A free block at the top of the heap goes back to the unallocated area
+    if (!block->next && block_end(block) == heap_current) {
+        if (prev) {
+            prev->next = NULL;
+        } else {
+            free_list = NULL;
+        }
+        heap_sbrk(-(int32_t)(heap_current - (uint32_t)block));
+    }
+    spin_unlock_irqrestore(&heap_lock, flags);
 }
 
 /**
  * @brief Creates a new page directory for a user-space process.
  * 
  * Allocates and initializes a new page directory, zeroing out all entries.
- * Copies the kernel's higher-half mappings (typically entries 768–1023) from
- * the current kernel page directory to allow the user process to access kernel
- * space in a controlled manner.
+ * Copies the kernel's higher-half mappings (entries 768–1022) from the kernel
+ * page directory to allow the user process to access kernel space in a
+ * controlled manner, and points the last entry at the new directory itself
+ * so its page tables stay reachable once it is loaded.
  * 
  * This is typically used when setting up memory for user processes.
  *
  * @return Pointer to the newly created page directory, or NULL if allocation fails.
  */
 uint32_t* create_user_page_directory() {
-    // Allocate a page-aligned physical page for the new page directory
-    uint32_t* new_pd = (uint32_t*)alloc_page(); 
+    // Allocate a page-aligned physical page for the new page directory, all entries 0 (not present)
+    uint32_t* new_pd = (uint32_t*)alloc_zeroed_page();
     if (!new_pd) return NULL;
 
-    // Initialize all 1024 entries to 0 (not present)
-    for (int i = 0; i < 1024; i++) new_pd[i] = 0;
+    uint32_t* kernel_entries = pd_entries(page_directory);
+    uint32_t* entries = (uint32_t*)phys_to_virt((uint32_t)new_pd);
 
-    // Copy kernel space mappings (usually the upper 1GB) into new page directory
-    for (int i = 768; i < 1024; i++) {
-        new_pd[i] = page_directory[i];  // Copy kernel mappings from current PD
+    // Copy kernel space mappings (the direct map, heap and kernel windows) into new page directory
+    for (int i = 768; i < RECURSIVE_PD_INDEX; i++) {
+        entries[i] = kernel_entries[i];  // Copy kernel mappings from the kernel PD
     }
 
+    // The new directory maps itself
+    entries[RECURSIVE_PD_INDEX] = (uint32_t)new_pd | PAGE_PRESENT | PAGE_WRITABLE;
+
     return new_pd;
 }
 
@@ -325,3 +2370,248 @@ void map_user_page(uint32_t* user_pd, uint32_t vaddr, uint32_t paddr) {
     // Map the given virtual address to the physical address with user and writable permissions
     map_page_with_directory(user_pd, vaddr, paddr, PAGE_USER | PAGE_WRITABLE);
 }
+
+/**
+ * @brief Creates a copy-on-write clone of a user address space.
+ *
+ * The new page directory shares the kernel mappings like
+ * create_user_page_directory(). Every user page table is copied, and the
+ * user pages behind it are shared rather than copied: writable ones are
+ * made read-only and marked PAGE_COW in both directories, and each shared
+ * page gains a reference in page_refcounts. The first write to such a page
+ * faults into handle_cow_fault(), which gives the writer its own copy.
+ * Directory entries without PAGE_USER (kernel mappings, 4MB pages) are
+ * shared as they are. Demand-zero ranges of the directory are reserved in
+ * the clone too.
+ *
+ * @param pd Physical address of the page directory to clone.
+ * @return Physical address of the new page directory, or NULL if memory ran out.
+ */
+uint32_t* clone_address_space(uint32_t* pd) {
+    uint32_t* child = create_user_page_directory();
+    if (!child) return NULL;
+
+    uint32_t* entries = pd_entries(pd);
+    uint32_t* child_entries = (uint32_t*)phys_to_virt((uint32_t)child);
+    int protected = 0; // Parent entries lost PAGE_WRITABLE
+    int ok = 1;
+
+    for (uint32_t pd_index = 0; pd_index < 768; pd_index++) {
+        uint32_t pde = entries[pd_index];
+        if (!(pde & PAGE_PRESENT)) continue;
+
+        if ((pde & PAGE_LARGE) || !(pde & PAGE_USER)) {
+            child_entries[pd_index] = pde; // Kernel mapping, shared as is
+            continue;
+        }
+
+        uint32_t frame = (uint32_t)alloc_page();
+        if (!frame) {
+            ok = 0; // Out of memory
+            break;
+        }
+
+        uint32_t* parent_table = pt_entries(pd, entries, pd_index);
+        uint32_t* table = (uint32_t*)phys_to_virt(frame);
+
+        for (uint32_t i = 0; i < 1024; i++) {
+            uint32_t pte = parent_table[i];
+
+            // Share user pages the allocator tracks; anything else is copied as is
+            if ((pte & (PAGE_PRESENT | PAGE_USER)) == (PAGE_PRESENT | PAGE_USER) && page_refcount(pte & ~0xFFF)) {
+                if (pte & PAGE_WRITABLE) {
+                    pte = (pte & ~PAGE_WRITABLE) | PAGE_COW;
+                    parent_table[i] = pte;
+                    protected = 1;
+                }
+                page_ref_share(pte & ~0xFFF);
+            }
+            table[i] = pte;
+        }
+
+        child_entries[pd_index] = frame | (pde & 0xFFF);
+    }
+
+    // The parent's cached translations may still allow writes
+    if (protected && is_active_directory(pd)) flush_tlb();
+
+    // The child inherits the parent's demand-zero ranges
+    for (uint32_t i = 0; i < MAX_DEMAND_REGIONS && ok; i++) {
+        demand_region_t* region = &demand_regions[i];
+        if (region->pd == pd && region->end > region->start) {
+            ok = reserve_region(child, region->start, region->end - region->start, region->flags);
+        }
+    }
+
+    if (!ok) {
+        destroy_address_space(child);
+        return NULL;
+    }
+    return child;
+}
+
+/**
+ * @brief Frees a user address space.
+ *
+ * Drops one reference to every user page mapped in the directory, freeing
+ * pages whose last mapping this was, then frees the user page tables and
+ * the directory itself. Kernel mappings are left alone since they are
+ * shared. The directory must not be loaded in CR3.
+ *
+ * @param pd Physical address of the page directory.
+ */
+void destroy_address_space(uint32_t* pd) {
+    if (!pd || pd == page_directory || is_active_directory(pd)) return;
+
+    // Forget the directory's demand-zero ranges; their pages are freed below
+    for (uint32_t i = 0; i < MAX_DEMAND_REGIONS; i++) {
+        if (demand_regions[i].pd != pd) continue;
+        demand_regions[i].pd = NULL;
+        demand_regions[i].end = demand_regions[i].start;
+    }
+
+    uint32_t* entries = pd_entries(pd);
+
+    for (uint32_t pd_index = 0; pd_index < 768; pd_index++) {
+        uint32_t pde = entries[pd_index];
+        if (!(pde & PAGE_PRESENT) || (pde & PAGE_LARGE) || !(pde & PAGE_USER)) continue;
+
+        uint32_t* table = pt_entries(pd, entries, pd_index);
+        for (uint32_t i = 0; i < 1024; i++) {
+            uint32_t pte = table[i];
+            if ((pte & (PAGE_PRESENT | PAGE_USER)) != (PAGE_PRESENT | PAGE_USER)) continue;
+            if (!page_refcount(pte & ~0xFFF)) continue; // Not allocator memory
+
+            if (page_ref_drop(pte & ~0xFFF)) free_page((void*)(pte & ~0xFFF));
+        }
+
+        entries[pd_index] = 0;
+        free_page((void*)(pde & ~0xFFF));
+    }
+
+    free_page(pd);
+}
+
+/**
+ * @brief Resolves a write fault on a copy-on-write page of the active address space.
+ *
+ * If the page is still shared (or is the zero page), its contents are copied into a new page
+ * (from high memory when there is some), which replaces it in the faulting
+ * directory, and the shared page loses
+ * a reference. If the faulting directory was its last user, the page is
+ * simply made writable again. To be called from the page fault handler
+ * for write faults on present pages, with paging_lock held. A page another
+ * CPU already made writable counts as resolved.
+ *
+ * @param vaddr Faulting virtual address (CR2).
+ * @return 1 if the fault was a copy-on-write fault and has been resolved,
+ *         0 if it was not (or no page was available for the copy).
+ */
+int handle_cow_fault(uint32_t vaddr) {
+    if (!paging_enabled) return 0;
+
+    uint32_t pde = ((uint32_t*)PAGE_DIRECTORY_VADDR)[vaddr >> 22];
+    if (!(pde & PAGE_PRESENT) || (pde & PAGE_LARGE)) return 0;
+
+    uint32_t* pte = (uint32_t*)(PAGE_TABLES_VADDR + (vaddr >> 12) * 4);
+    if ((*pte & (PAGE_PRESENT | PAGE_WRITABLE)) == (PAGE_PRESENT | PAGE_WRITABLE)) {
+        invlpg(vaddr); // Another CPU broke the share first; this one still cached the read-only entry
+        return 1;
+    }
+    if ((*pte & (PAGE_PRESENT | PAGE_COW)) != (PAGE_PRESENT | PAGE_COW)) return 0;
+
+    uint32_t page = vaddr & ~0xFFF;
+    uint32_t frame = *pte & ~0xFFF;
+    uint32_t flags = (*pte & 0xFFF & ~PAGE_COW) | PAGE_WRITABLE;
+
+    uint32_t unshared = 0; // Shared frame whose other owners went away while it was copied
+    uint16_t* ref = page_refcount(frame);
+    if (frame == zero_page || (ref && *ref > 1)) {
+        // Still shared: give this address space its own copy, in high memory when there is some
+        uint32_t copy = (uint32_t)alloc_highmem_page();
+        if (!copy) copy = (uint32_t)alloc_page();
+        if (!copy) return 0; // Out of memory
+
+        void* mapped = kmap(copy);
+        memcpy(mapped, (void*)page, PAGE_SIZE);
+        kunmap(mapped);
+
+        if (page_ref_drop(frame)) unshared = frame;
+        frame = copy;
+    }
+
+    *pte = frame | flags;
+    invlpg(page);
+    tlb_shootdown(); // Other CPUs on this directory must stop reading the shared page
+    if (unshared) free_page((void*)unshared);
+    return 1;
+}
+
+/**
+ * @brief Counts the free pages recorded in bitmap words [from, to).
+ */
+static uint32_t bitmap_count_free(uint32_t from, uint32_t to) {
+    uint32_t free = 0;
+    for (uint32_t w = from; w < to; w++) {
+        uint32_t word = ~page_bitmap[w];
+        // Parallel bit count of the free (now set) bits
+        word = word - ((word >> 1) & 0x55555555);
+        word = (word & 0x33333333) + ((word >> 2) & 0x33333333);
+        free += (((word + (word >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+    }
+    return free;
+}
+
+/**
+ * @brief Fills in a snapshot of the allocator statistics.
+ *
+ * Counters and histograms are maintained on every call; the free page
+ * count and the heap free-list figures are computed here by walking the
+ * bitmap (or asking the buddy allocator) and the free list.
+ *
+ * @param stats Structure to fill in.
+ */
+void get_memory_stats(memory_stats_t* stats) {
+    uint32_t flags = spin_lock_irqsave(&heap_lock); // Every lock, in order, for a consistent snapshot
+    spin_lock(&pmm_lock);
+    spin_lock(&stats_lock);
+
+    stats->pages = page_counters;
+    stats->page_latency = page_latency;
+    stats->heap = heap_counters;
+    stats->kmalloc_latency = kmalloc_latency;
+
+    stats->total_pages = low_pages + high_pages;
+    stats->high_pages = high_pages;
+    stats->free_high_pages = bitmap_count_free(high_first_word, bitmap_size_words);
+#ifdef PMM_BUDDY
+    stats->free_pages = buddy_free_pages() + stats->free_high_pages;
+#else
+    stats->free_pages = bitmap_count_free(0, bitmap_size_words);
+#endif
+    stats->zeroed_pages = zeroed_count;
+    stats->cached_pages = 0;
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        stats->cached_pages += cpu_locals[cpu].page_cache.count;
+    }
+#ifdef PMM_CHECK
+    stats->check_failures = pmm_check_failures;
+#else
+    stats->check_failures = 0;
+#endif
+
+    stats->heap_break = heap_current;
+    stats->heap_mapped_bytes = heap_mapped_end - KERNEL_HEAP_START;
+    stats->free_blocks = 0;
+    stats->free_bytes = 0;
+    stats->largest_free_block = 0;
+    for (BlockHeader* b = free_list; b; b = b->next) {
+        stats->free_blocks++;
+        stats->free_bytes += b->size;
+        if (b->size > stats->largest_free_block) stats->largest_free_block = b->size;
+    }
+
+    spin_unlock(&stats_lock);
+    spin_unlock(&pmm_lock);
+    spin_unlock_irqrestore(&heap_lock, flags);
+}
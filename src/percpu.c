@@ -0,0 +1,67 @@
+#include "percpu.h"
+
+// One area per possible CPU, indexed by this_cpu_id()
+cpu_local_t cpu_locals[MAX_CPUS];
+
+// Operand of the LGDT instruction
+typedef struct {
+    uint16_t limit;  // Size of the table in bytes minus 1
+    uint32_t base;   // Linear address of the table
+} __attribute__((packed)) gdt_ptr_t;
+
+/**
+ * @brief Encodes a segment descriptor.
+ *
+ * @param base   Linear base address.
+ * @param limit  Segment limit (in bytes, or in 4 KiB units when `flags` has the granularity bit).
+ * @param access Access byte (present, ring, type).
+ * @param flags  Granularity and size bits (high nibble of byte 6).
+ */
+static uint64_t gdt_descriptor(uint32_t base, uint32_t limit, uint8_t access, uint8_t flags) {
+    uint64_t d = limit & 0xFFFF;
+    d |= (uint64_t)(base & 0xFFFFFF) << 16;
+    d |= (uint64_t)access << 40;
+    d |= (uint64_t)((limit >> 16) & 0xF) << 48;
+    d |= (uint64_t)(flags & 0xF) << 52;
+    d |= (uint64_t)(base >> 24) << 56;
+    return d;
+}
+
+/**
+ * @brief Loads the GDT, TSS and GS segment of per-CPU area `id` on the calling CPU.
+ *
+ * Must run on each CPU before anything uses this_cpu(): first thing in
+ * kernel_main() on the bootstrap CPU, and in ap_main() on the others.
+ *
+ * @param id        Index into cpu_locals.
+ * @param stack_top Top of the stack the CPU is running on.
+ */
+void cpu_init(uint32_t id, uint32_t stack_top) {
+    cpu_local_t* cpu = &cpu_locals[id];
+    cpu->id = id;
+    cpu->stack_top = stack_top;
+
+    cpu->tss.ss0 = GDT_KERNEL_DATA;
+    cpu->tss.esp0 = stack_top;
+    cpu->tss.iomap_base = sizeof(tss_t);
+
+    cpu->gdt[0] = 0;
+    cpu->gdt[GDT_KERNEL_CODE / 8] = gdt_descriptor(0, 0xFFFFF, 0x9A, 0xC); // Same as boot.asm's
+    cpu->gdt[GDT_KERNEL_DATA / 8] = gdt_descriptor(0, 0xFFFFF, 0x92, 0xC);
+    cpu->gdt[GDT_PERCPU / 8] = gdt_descriptor((uint32_t)cpu, sizeof(cpu_local_t) - 1, 0x92, 0x4); // Byte granular
+    cpu->gdt[GDT_TSS / 8] = gdt_descriptor((uint32_t)&cpu->tss, sizeof(tss_t) - 1, 0x89, 0x0);   // Available 32-bit TSS
+
+    gdt_ptr_t gdt_ptr = { sizeof(cpu->gdt) - 1, (uint32_t)cpu->gdt };
+    asm volatile(
+        "lgdt %0\n\t"
+        "ljmp %1, $1f\n\t"       // Reload CS from the new table
+        "1:\n\t"
+        "mov %2, %%ds\n\t"
+        "mov %2, %%es\n\t"
+        "mov %2, %%fs\n\t"
+        "mov %2, %%ss\n\t"
+        "mov %3, %%gs\n\t"
+        "ltr %4"
+        :: "m"(gdt_ptr), "i"(GDT_KERNEL_CODE), "r"(GDT_KERNEL_DATA), "r"(GDT_PERCPU), "r"((uint16_t)GDT_TSS)
+        : "memory");
+}
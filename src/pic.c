@@ -0,0 +1,107 @@
+#include "pic.h"
+#include "io.h"
+
+static uint16_t irq_mask = 0xFFFF; // Current mask of both PICs (bit set = line disabled)
+
+/**
+ * @brief Writes the cached mask of the PIC that owns an IRQ line.
+ */
+static void pic_write_mask(uint8_t irq) {
+    if (irq < 8) {
+        outb(PIC1_DATA, irq_mask & 0xFF);
+    } else {
+        outb(PIC2_DATA, irq_mask >> 8);
+    }
+}
+
+/**
+ * @brief Remaps the two 8259 PICs to vectors IRQ_BASE..IRQ_BASE+15 and masks every line.
+ *
+ * By default the master PIC raises vectors 8-15, which collide with CPU
+ * exceptions. Lines are unmasked one by one with pic_unmask() once their
+ * handler is installed.
+ */
+void pic_remap() {
+    // ICW1: start initialization, ICW4 follows
+    outb(PIC1_COMMAND, 0x11);
+    io_wait();
+    outb(PIC2_COMMAND, 0x11);
+    io_wait();
+
+    // ICW2: vector offsets
+    outb(PIC1_DATA, IRQ_BASE);
+    io_wait();
+    outb(PIC2_DATA, IRQ_BASE + 8);
+    io_wait();
+
+    // ICW3: the slave sits on the master's cascade line, and knows its identity
+    outb(PIC1_DATA, 1 << IRQ_CASCADE);
+    io_wait();
+    outb(PIC2_DATA, IRQ_CASCADE);
+    io_wait();
+
+    // ICW4: 8086 mode
+    outb(PIC1_DATA, 0x01);
+    io_wait();
+    outb(PIC2_DATA, 0x01);
+    io_wait();
+
+    // Mask everything except the cascade line, so slave IRQs only need their own bit cleared
+    irq_mask = 0xFFFF & ~(1 << IRQ_CASCADE);
+    outb(PIC1_DATA, irq_mask & 0xFF);
+    outb(PIC2_DATA, irq_mask >> 8);
+}
+
+/**
+ * @brief Enables delivery of an IRQ line.
+ *
+ * @param irq IRQ number (0-15).
+ */
+void pic_unmask(uint8_t irq) {
+    irq_mask &= ~(1 << irq);
+    pic_write_mask(irq);
+}
+
+/**
+ * @brief Disables delivery of an IRQ line.
+ *
+ * @param irq IRQ number (0-15).
+ */
+void pic_mask(uint8_t irq) {
+    irq_mask |= 1 << irq;
+    pic_write_mask(irq);
+}
+
+/**
+ * @brief Acknowledges an IRQ so the PIC can deliver the next one.
+ *
+ * @param irq IRQ number (0-15).
+ */
+void pic_send_eoi(uint8_t irq) {
+    if (irq >= 8) outb(PIC2_COMMAND, PIC_EOI);
+    outb(PIC1_COMMAND, PIC_EOI);
+}
+
+/**
+ * @brief Returns whether an IRQ 7 or 15 is spurious (not actually in service).
+ *
+ * A spurious IRQ must not be acknowledged on its own PIC; a spurious IRQ 15
+ * still needs an EOI on the master, since the cascade line was raised.
+ *
+ * @param irq IRQ number (0-15).
+ * @return 1 if the interrupt is spurious, 0 otherwise.
+ */
+int pic_is_spurious(uint8_t irq) {
+    if (irq == 7) {
+        outb(PIC1_COMMAND, PIC_READ_ISR);
+        return !(inb(PIC1_COMMAND) & 0x80);
+    }
+    if (irq == 15) {
+        outb(PIC2_COMMAND, PIC_READ_ISR);
+        if (!(inb(PIC2_COMMAND) & 0x80)) {
+            outb(PIC1_COMMAND, PIC_EOI);
+            return 1;
+        }
+    }
+    return 0;
+}
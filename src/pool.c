@@ -0,0 +1,246 @@
+#include "pool.h"
+#include "memory.h"
+
+// Header at the start of every pool chunk
+struct pool_chunk {
+    pool_chunk_t* next;  // Next older chunk of the same pool
+};
+
+// Header at the start of every arena block; the allocations follow it
+struct arena_block {
+    arena_block_t* next; // Next older block of the same arena
+    uint32_t pages;      // Size of this block in pages
+};
+
+/**
+ * @brief Sets up an empty pool of fixed-size objects.
+ *
+ * No memory is taken until the first pool_alloc(). Objects carry no
+ * header; a free object holds the free-list link in its first word.
+ *
+ * @param pool        Pool to set up.
+ * @param size        Object size in bytes.
+ * @param align       Object alignment in bytes (a power of two; 0 for 8 bytes).
+ * @param chunk_pages Pages taken from alloc_pages() each time the pool grows (0 for POOL_DEFAULT_PAGES).
+ * @return 1 on success, 0 if the alignment is not a power of two or no object fits in a chunk.
+ */
+int pool_init(pool_t* pool, uint32_t size, uint32_t align, uint32_t chunk_pages) {
+    if (align == 0) align = 8;
+    if (align & (align - 1)) return 0; // Alignment must be a power of two
+    if (size < sizeof(void*)) size = sizeof(void*); // Room for the free-list link
+    if (chunk_pages == 0) chunk_pages = POOL_DEFAULT_PAGES;
+
+    pool->object_size = (size + align - 1) & ~(align - 1);
+    pool->chunk_pages = chunk_pages;
+    pool->first_offset = (sizeof(pool_chunk_t) + align - 1) & ~(align - 1);
+    pool->free_list = NULL;
+    pool->fresh = NULL;
+    pool->fresh_end = NULL;
+    pool->chunks = NULL;
+    pool->in_use = 0;
+    pool->capacity = 0;
+    pool->lock = (spinlock_t){ 0, 0 };
+
+    return pool->object_size && pool->first_offset + pool->object_size <= chunk_pages * PAGE_SIZE;
+}
+
+/**
+ * @brief Adds a chunk to a pool; its objects are handed out from `fresh` one at a time.
+ *
+ * @return 1 on success, 0 if no run of pages is free.
+ */
+static int pool_grow(pool_t* pool) {
+    void* pages = alloc_pages(pool->chunk_pages, 0);
+    if (!pages) return 0;
+    pool_chunk_t* chunk = (pool_chunk_t*)phys_to_virt((uint32_t)pages); // Chunks are used through the direct map
+
+    uint32_t objects = (pool->chunk_pages * PAGE_SIZE - pool->first_offset) / pool->object_size;
+    chunk->next = pool->chunks;
+    pool->chunks = chunk;
+    pool->fresh = (uint8_t*)chunk + pool->first_offset;
+    pool->fresh_end = pool->fresh + objects * pool->object_size;
+    pool->capacity += objects;
+    return 1;
+}
+
+/**
+ * @brief Allocates one object from a pool in O(1).
+ *
+ * Takes the most recently freed object, else the next unused object of
+ * the newest chunk, else a new chunk.
+ *
+ * @param pool Pool to allocate from.
+ * @return Pointer to the object, or NULL if a new chunk could not be allocated.
+ */
+void* pool_alloc(pool_t* pool) {
+    uint32_t flags = spin_lock_irqsave(&pool->lock); // Pools may be shared with interrupt handlers
+    void* obj = pool->free_list;
+
+    if (obj) {
+        pool->free_list = *(void**)obj;
+    } else {
+        // Fresh objects are not threaded onto the free list up front, so growing stays O(1)
+        if (pool->fresh == pool->fresh_end && !pool_grow(pool)) {
+            spin_unlock_irqrestore(&pool->lock, flags);
+            return NULL; // Out of memory
+        }
+        obj = pool->fresh;
+        pool->fresh += pool->object_size;
+    }
+
+    pool->in_use++;
+    spin_unlock_irqrestore(&pool->lock, flags);
+    return obj;
+}
+
+/**
+ * @brief Returns an object to its pool in O(1).
+ *
+ * @param pool Pool the object was allocated from.
+ * @param obj  Object to free (NULL does nothing).
+ */
+void pool_free(pool_t* pool, void* obj) {
+    if (!obj) return;
+
+    uint32_t flags = spin_lock_irqsave(&pool->lock);
+    *(void**)obj = pool->free_list;
+    pool->free_list = obj;
+    pool->in_use--;
+    spin_unlock_irqrestore(&pool->lock, flags);
+}
+
+/**
+ * @brief Frees every chunk of a pool, and with them every object still allocated.
+ *
+ * The pool stays set up and can be allocated from again.
+ *
+ * @param pool Pool to empty.
+ */
+void pool_destroy(pool_t* pool) {
+    uint32_t flags = spin_lock_irqsave(&pool->lock);
+    pool_chunk_t* chunk = pool->chunks;
+    pool->chunks = NULL;
+    pool->free_list = NULL;
+    pool->fresh = NULL;
+    pool->fresh_end = NULL;
+    pool->in_use = 0;
+    pool->capacity = 0;
+    spin_unlock_irqrestore(&pool->lock, flags);
+
+    while (chunk) {
+        pool_chunk_t* next = chunk->next;
+        free_pages((void*)virt_to_phys(chunk), pool->chunk_pages);
+        chunk = next;
+    }
+}
+
+/**
+ * @brief Sets up an empty arena.
+ *
+ * A zero-initialized arena_t is also ready to use, with ARENA_DEFAULT_PAGES blocks.
+ *
+ * @param arena       Arena to set up.
+ * @param block_pages Pages taken from alloc_pages() each time the arena grows (0 for ARENA_DEFAULT_PAGES).
+ */
+void arena_init(arena_t* arena, uint32_t block_pages) {
+    arena->blocks = NULL;
+    arena->next = NULL;
+    arena->end = NULL;
+    arena->block_pages = block_pages;
+}
+
+/**
+ * @brief Returns the size of the arena's regular blocks in pages.
+ */
+static uint32_t arena_block_pages(const arena_t* arena) {
+    return arena->block_pages ? arena->block_pages : ARENA_DEFAULT_PAGES;
+}
+
+/**
+ * @brief Makes a new block the one allocations come from.
+ *
+ * @param size Bytes the block must have room for.
+ * @return 1 on success, 0 if no run of pages is free.
+ */
+static int arena_grow(arena_t* arena, uint32_t size) {
+    uint32_t pages = arena_block_pages(arena);
+    uint32_t needed = (size + sizeof(arena_block_t) + PAGE_SIZE - 1) / PAGE_SIZE;
+    if (needed > pages) pages = needed; // An oversized request gets a block of its own
+
+    void* run = alloc_pages(pages, 0);
+    if (!run) return 0;
+    arena_block_t* block = (arena_block_t*)phys_to_virt((uint32_t)run);
+
+    block->next = arena->blocks;
+    block->pages = pages;
+    arena->blocks = block;
+    arena->next = (uint8_t*)(block + 1);
+    arena->end = (uint8_t*)block + pages * PAGE_SIZE;
+    return 1;
+}
+
+/**
+ * @brief Allocates `size` bytes from an arena in O(1), aligned to 8 bytes.
+ *
+ * The memory stays valid until the next arena_reset() or arena_destroy();
+ * it cannot be freed on its own. A request larger than a block gets a
+ * block of its own.
+ *
+ * @param arena Arena to allocate from.
+ * @param size  Number of bytes.
+ * @return Pointer to the memory, or NULL if a new block could not be allocated.
+ */
+void* arena_alloc(arena_t* arena, uint32_t size) {
+    if (size > KERNEL_HEAP_MAX_SIZE) return NULL; // Keeps the size arithmetic below from overflowing
+    size = ALIGN8(size);
+
+    if (size > (uint32_t)(arena->end - arena->next) && !arena_grow(arena, size)) return NULL; // Out of memory
+
+    void* ptr = arena->next;
+    arena->next += size;
+    return ptr;
+}
+
+/**
+ * @brief Frees everything allocated from an arena at once.
+ *
+ * One block is kept for the next round of allocations; any others are
+ * given back with free_pages().
+ *
+ * @param arena Arena to reset.
+ */
+void arena_reset(arena_t* arena) {
+    arena_block_t* keep = NULL;
+    arena_block_t* block = arena->blocks;
+
+    while (block) {
+        arena_block_t* next = block->next;
+        if (!keep && block->pages == arena_block_pages(arena)) {
+            keep = block; // Oversized blocks are never kept
+        } else {
+            free_pages((void*)virt_to_phys(block), block->pages);
+        }
+        block = next;
+    }
+
+    arena->blocks = keep;
+    if (keep) {
+        keep->next = NULL;
+        arena->next = (uint8_t*)(keep + 1);
+        arena->end = (uint8_t*)keep + keep->pages * PAGE_SIZE;
+    } else {
+        arena->next = NULL;
+        arena->end = NULL;
+    }
+}
+
+/**
+ * @brief Frees every block of an arena.
+ *
+ * @param arena Arena to free; it can be allocated from again afterwards.
+ */
+void arena_destroy(arena_t* arena) {
+    arena_reset(arena);
+    if (arena->blocks) free_pages((void*)virt_to_phys(arena->blocks), arena->blocks->pages);
+    arena_init(arena, arena->block_pages);
+}
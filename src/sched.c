@@ -0,0 +1,694 @@
+#include "sched.h"
+#include "percpu.h"
+#include "cpu.h"
+#include "memory.h"
+#include "pool.h"
+#include "timer.h"
+#include "io.h"
+#include "idt.h"
+#include "lapic.h"
+#include "smp.h"
+#include "string.h"
+#include "kprintf.h"
+#include "trace.h"
+
+static task_t* sleepers = NULL;                   // TASK_SLEEPING tasks, earliest wake_tick first
+static spinlock_t sleep_lock;                     // Guards sleepers
+static task_t* all_tasks = NULL;                  // Every task not yet freed, in creation order
+static task_t* all_tasks_tail = NULL;
+static spinlock_t tasks_lock;                     // Guards all_tasks and next_task_id
+static pool_t task_pool;                          // Task structures
+static uint32_t next_task_id = 0;
+static uint32_t switch_count = 0;
+static int running = 0;                           // Set by init_scheduler()
+
+/**
+ * @brief Appends a task to the tail of its priority's deque; the queue must be locked.
+ */
+static void run_queue_push(run_queue_t* rq, task_t* task) {
+    uint32_t prio = task->priority;
+
+    task->next = NULL;
+    task->prev = rq->tails[prio];
+    if (rq->tails[prio]) {
+        rq->tails[prio]->next = task;
+    } else {
+        rq->heads[prio] = task;
+    }
+    rq->tails[prio] = task;
+    rq->bitmap |= 1u << prio;
+    rq->count++;
+    task->on_rq = 1;
+}
+
+/**
+ * @brief Removes a task from anywhere in its deque; the queue must be locked.
+ */
+static void run_queue_unlink(run_queue_t* rq, task_t* task) {
+    uint32_t prio = task->priority;
+
+    if (task->prev) {
+        task->prev->next = task->next;
+    } else {
+        rq->heads[prio] = task->next;
+    }
+    if (task->next) {
+        task->next->prev = task->prev;
+    } else {
+        rq->tails[prio] = task->prev;
+    }
+    if (!rq->heads[prio]) rq->bitmap &= ~(1u << prio);
+
+    task->next = NULL;
+    task->prev = NULL;
+    task->on_rq = 0;
+    rq->count--;
+}
+
+/**
+ * @brief Takes the oldest task of the highest non-empty priority in O(1); the queue must be locked.
+ *
+ * @return The task, or NULL if no task is queued.
+ */
+static task_t* run_queue_pop(run_queue_t* rq) {
+    if (!rq->bitmap) return NULL;
+
+    uint32_t prio = __builtin_ctz(rq->bitmap); // Lowest set bit = highest priority (BSF)
+    task_t* task = rq->heads[prio];
+    run_queue_unlink(rq, task);
+    return task;
+}
+
+/**
+ * @brief Takes a task queued on another CPU, for a CPU whose own queue is empty.
+ *
+ * Victims are tried in CPU order starting after the thief. From a victim
+ * the highest priority is taken, newest task first, skipping a task that
+ * is still on its way off a CPU (on_cpu).
+ *
+ * @param thief Per-CPU area of the calling CPU.
+ * @return The task, now belonging to the thief, or NULL if no CPU had one to spare.
+ */
+static task_t* steal_task(cpu_local_t* thief) {
+    for (uint32_t i = 1; i < MAX_CPUS; i++) {
+        cpu_local_t* victim = &cpu_locals[(thief->id + i) % MAX_CPUS];
+        run_queue_t* rq = &victim->run_queue;
+        if (!victim->online || !rq->bitmap) continue; // Unlocked peek; checked again below
+
+        task_t* task = NULL;
+        spin_lock(&rq->lock);
+        for (uint32_t bitmap = rq->bitmap; bitmap && !task; bitmap &= bitmap - 1) {
+            task_t* t = rq->tails[__builtin_ctz(bitmap)];
+            while (t && t->on_cpu) t = t->prev;
+            task = t;
+        }
+        if (task) {
+            run_queue_unlink(rq, task);
+            task->cpu = thief->id;
+        }
+        spin_unlock(&rq->lock);
+
+        if (task) return task;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Returns whether this CPU's queue, or one it could steal from, holds a task.
+ */
+static int work_available(cpu_local_t* cpu) {
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        if (cpu_locals[i].online && cpu_locals[i].run_queue.bitmap) return 1;
+    }
+    return cpu->run_queue.bitmap != 0;
+}
+
+/**
+ * @brief Frees a task that has exited, once nothing runs on its stack any more.
+ */
+static void task_reap(task_t* dead) {
+    uint32_t flags = spin_lock_irqsave(&tasks_lock);
+    task_t** link = &all_tasks;
+    task_t* prev = NULL;
+    while (*link != dead) {
+        prev = *link;
+        link = &(*link)->all_next;
+    }
+    *link = dead->all_next;
+    if (all_tasks_tail == dead) all_tasks_tail = prev;
+    spin_unlock_irqrestore(&tasks_lock, flags);
+
+    free_pages((void*)virt_to_phys(dead->stack), TASK_STACK_PAGES);
+    pool_free(&task_pool, dead);
+}
+
+/**
+ * @brief Releases the task switched away from, now that its stack is saved.
+ *
+ * From here on another CPU may run (or steal) it; one that exited is
+ * freed, which it could not do itself while running on that stack. This
+ * runs right after every switch, on the next task's stack.
+ */
+static void finish_switch() {
+    cpu_local_t* cpu = this_cpu(); // The task that switched may have been resumed elsewhere
+    task_t* prev = cpu->prev;
+    if (!prev) return;
+    cpu->prev = NULL;
+
+    if (prev->state == TASK_DEAD) {
+        task_reap(prev);
+    } else {
+        __atomic_store_n(&prev->on_cpu, 0, __ATOMIC_RELEASE);
+    }
+}
+
+/**
+ * @brief Switches to the next task to run; interrupts must be disabled.
+ *
+ * The running task goes back on this CPU's run queue if it is still
+ * runnable (and a waker has not put it there already). The next task is
+ * taken from that queue, else stolen from another CPU, else the idle
+ * thread runs. Returns when the calling task is switched back to, which
+ * may be on another CPU (never for a dead one).
+ */
+static void schedule() {
+    cpu_local_t* cpu = this_cpu();
+    run_queue_t* rq = &cpu->run_queue;
+    task_t* prev = cpu->current;
+
+    spin_lock(&rq->lock);
+    cpu->need_resched = 0;
+    if (prev->state == TASK_RUNNABLE && prev != cpu->idle && !prev->on_rq) run_queue_push(rq, prev);
+    task_t* next = run_queue_pop(rq);
+    spin_unlock(&rq->lock);
+
+    if (!next) next = steal_task(cpu);
+    if (!next) next = cpu->idle; // Nothing else to do
+
+    next->slice = SCHED_TIME_SLICE;
+    if (next == prev) return;
+
+    next->on_cpu = 1; // Tasks on this queue last ran here, so none is still on another CPU
+    next->cpu = cpu->id;
+    next->switches++;
+    __atomic_add_fetch(&switch_count, 1, __ATOMIC_RELAXED);
+    cpu->current = next;
+    cpu->prev = prev;
+
+    TRACE_EVENT(TRACE_TASK_SWITCH, prev->id, next->id);
+    context_switch(&prev->esp, next->esp);
+    finish_switch();
+}
+
+/**
+ * @brief Switches tasks now if a switch is due and allowed; interrupts must be disabled.
+ *
+ * @param flags EFLAGS from the caller's irq_save(). With interrupts off
+ *              there (an interrupt handler or critical section), the
+ *              switch is left to the next sched_irq_exit() or preempt_enable().
+ */
+static void preempt_check(uint32_t flags) {
+    cpu_local_t* cpu = this_cpu();
+    if (running && cpu->need_resched && !cpu->preempt_count && (flags & EFLAGS_IF)) schedule();
+}
+
+/**
+ * @brief Pokes one idle CPU other than `self`, so it steals the work just queued here.
+ */
+static void kick_idle_cpu(cpu_local_t* self) {
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        cpu_local_t* cpu = &cpu_locals[i];
+        if (cpu == self || !cpu->online || cpu->current != cpu->idle) continue;
+        smp_send_reschedule(i);
+        return;
+    }
+}
+
+/**
+ * @brief Makes a task runnable on the run queue of the CPU it last ran on; interrupts must be disabled.
+ *
+ * That CPU is asked to give up its running task if the woken one has a
+ * higher priority. A task queued on the calling CPU may be stolen, so an
+ * idle CPU is poked as well.
+ */
+static void task_wake(task_t* task) {
+    cpu_local_t* target = &cpu_locals[task->cpu]; // Stable: a task that is not runnable cannot be stolen
+    run_queue_t* rq = &target->run_queue;
+
+    spin_lock(&rq->lock);
+    task->state = TASK_RUNNABLE;
+    if (!task->on_rq) run_queue_push(rq, task); // Not if it was woken before it even got off its CPU
+    int preempt = task->priority < target->current->priority;
+    spin_unlock(&rq->lock);
+
+    cpu_local_t* cpu = this_cpu();
+    if (target == cpu) {
+        if (preempt) cpu->need_resched = 1;
+        kick_idle_cpu(cpu);
+    } else if (preempt) {
+        target->need_resched = 1;
+        smp_send_reschedule(target->id);
+    }
+}
+
+/**
+ * @brief Reschedule IPI handler: another CPU queued a task this one should run or steal.
+ *
+ * isr_dispatch() calls sched_irq_exit() right after.
+ */
+static void reschedule_ipi(interrupt_frame_t* frame) {
+    (void)frame;
+    this_cpu()->need_resched = 1;
+}
+
+/**
+ * @brief First code a new thread runs: context_switch() returns here instead of into schedule().
+ */
+static void task_start() {
+    finish_switch();
+    irq_enable(); // The switch here was made with interrupts off
+
+    task_t* task = current_task();
+    task->entry(task->arg);
+    task_exit();
+}
+
+/**
+ * @brief Adds a task to the list of every task and gives it the next id.
+ */
+static void task_link(task_t* task) {
+    uint32_t flags = spin_lock_irqsave(&tasks_lock);
+    task->id = next_task_id++;
+    task->all_next = NULL;
+    if (all_tasks_tail) {
+        all_tasks_tail->all_next = task;
+    } else {
+        all_tasks = task;
+    }
+    all_tasks_tail = task;
+    spin_unlock_irqrestore(&tasks_lock, flags);
+}
+
+/**
+ * @brief Allocates a task structure for the context already running on this CPU (no stack of its own).
+ */
+static task_t* task_adopt(const char* name, uint32_t priority) {
+    task_t* task = (task_t*)pool_alloc(&task_pool);
+    if (!task) return NULL;
+
+    memset(task, 0, sizeof(task_t));
+    task->state = TASK_RUNNABLE;
+    task->priority = priority;
+    task->slice = SCHED_TIME_SLICE;
+    task->cpu = this_cpu_id();
+    task->on_cpu = 1;
+    memcpy(task->name, name, strlen(name) + 1);
+    task_link(task);
+    return task;
+}
+
+/**
+ * @brief Allocates a task and its stack, laid out so the first switch to it enters task_start().
+ *
+ * @return The task (not on any run queue yet), or NULL if memory ran out.
+ */
+static task_t* task_alloc(const char* name, task_entry_t entry, void* arg, uint32_t priority) {
+    task_t* task = (task_t*)pool_alloc(&task_pool);
+    if (!task) return NULL;
+
+    void* stack = alloc_pages(TASK_STACK_PAGES, 0);
+    if (!stack) {
+        pool_free(&task_pool, task);
+        return NULL;
+    }
+
+    memset(task, 0, sizeof(task_t));
+    task->stack = (uint8_t*)phys_to_virt((uint32_t)stack);
+    task->state = TASK_RUNNABLE;
+    task->priority = priority;
+    task->cpu = this_cpu_id();
+    task->entry = entry;
+    task->arg = arg;
+
+    uint32_t len = strlen(name);
+    if (len > TASK_NAME_LEN - 1) len = TASK_NAME_LEN - 1;
+    memcpy(task->name, name, len);
+
+    // What context_switch() pops: EDI, ESI, EBX, EBP, then the address it returns to
+    uint32_t* sp = (uint32_t*)(task->stack + TASK_STACK_PAGES * PAGE_SIZE);
+    *--sp = 0;                     // Return address of task_start(), which never returns
+    *--sp = (uint32_t)task_start;
+    for (int i = 0; i < 4; i++) *--sp = 0;
+    task->esp = (uint32_t)sp;
+
+    task_link(task);
+    return task;
+}
+
+/**
+ * @brief Loop of the idle threads: runs the idle tasks, and halts once none has work left.
+ *
+ * Each CPU has one. It has the lowest priority and never waits on a run
+ * queue, so it only runs while the CPU has nothing else to do, and gives
+ * way as soon as a task is queued here, or on another CPU it can steal from.
+ */
+static void idle_thread(void* arg) {
+    (void)arg;
+    cpu_local_t* cpu = this_cpu(); // Idle threads are never queued, so never move
+
+    while (1) {
+        if (run_idle_tasks()) continue; // More to do
+
+        // Check and halt with interrupts off, so a wake-up cannot slip in between
+        __asm__ volatile ("cli" ::: "memory");
+        if (!work_available(cpu)) __asm__ volatile ("sti\n\thlt" ::: "memory"); // STI only takes effect after HLT has started
+        irq_enable();
+        if (work_available(cpu)) sched_yield();
+    }
+}
+
+/**
+ * @brief Starts scheduling: the code calling this becomes the boot task, and the idle thread is created.
+ *
+ * Nothing is preempted until the timer runs (init_timer()). The idle
+ * thread runs the idle tasks registered with register_idle_task() and
+ * halts when none has work left. Each CPU has its own run queues; the
+ * APs join with sched_start_cpu(). pic_remap(), init_idt() and
+ * init_physical_allocator() must have run.
+ *
+ * @return 1 on success, 0 if the idle thread could not be created.
+ */
+int init_scheduler() {
+    if (!pool_init(&task_pool, sizeof(task_t), 0, 0)) return 0;
+
+    // The boot task keeps running on the stack boot.asm set up
+    cpu_local_t* cpu = this_cpu();
+    cpu->current = task_adopt("kernel", SCHED_PRIO_DEFAULT);
+    if (!cpu->current) return 0;
+    cpu->idle = task_alloc("idle0", idle_thread, NULL, SCHED_PRIO_IDLE);
+    if (!cpu->idle) return 0;
+
+    register_interrupt_handler(IPI_RESCHEDULE_VECTOR, reschedule_ipi);
+    cpu->online = 1;
+    running = 1;
+    klog(LOG_INFO, "sched: %u priorities, %u-tick slices, %u KiB stacks",
+         SCHED_PRIORITIES, SCHED_TIME_SLICE, TASK_STACK_PAGES * PAGE_SIZE / 1024);
+    return 1;
+}
+
+/**
+ * @brief Turns the calling AP's boot context into its idle thread and starts taking work.
+ *
+ * Called by ap_main() once the CPU's GDT, IDT and local APIC are set up.
+ * The CPU is marked online and runs tasks from its own run queue, or
+ * stolen from the others, from then on.
+ */
+void sched_start_cpu() {
+    cpu_local_t* cpu = this_cpu();
+    char name[TASK_NAME_LEN];
+    ksnprintf(name, sizeof(name), "idle%u", cpu->id);
+
+    task_t* idle = running ? task_adopt(name, SCHED_PRIO_IDLE) : NULL;
+    if (!idle) {
+        while (1) __asm__ volatile ("cli\n\thlt"); // Never comes online; init_smp() gives up on it
+    }
+
+    cpu->current = idle;
+    cpu->idle = idle;
+    __atomic_store_n(&cpu->online, 1, __ATOMIC_RELEASE);
+
+    irq_enable();
+    idle_thread(NULL);
+    while (1) {} // Not reached
+}
+
+/**
+ * @brief Returns whether init_scheduler() has run, so blocking waits can sleep instead of halting.
+ */
+int sched_running() {
+    return running;
+}
+
+/**
+ * @brief Returns the task running on this CPU.
+ */
+task_t* current_task() {
+    uint32_t flags = irq_save(); // Not preempted (and moved) between finding the CPU and reading it
+    task_t* task = this_cpu()->current;
+    irq_restore(flags);
+    return task;
+}
+
+/**
+ * @brief Creates a kernel thread and puts it on its run queue.
+ *
+ * The thread starts with interrupts enabled in `entry(arg)`, and exits
+ * when entry returns or calls task_exit(). It is queued on the calling
+ * CPU; an idle CPU is poked so it can steal it.
+ *
+ * @param name     Name shown by "ps" (truncated to TASK_NAME_LEN - 1 characters).
+ * @param entry    Function the thread runs.
+ * @param arg      Argument passed to entry.
+ * @param priority Priority (0 highest, up to SCHED_PRIO_IDLE - 1).
+ * @return The new task, or NULL if its task structure or stack could not be allocated.
+ */
+task_t* task_create(const char* name, task_entry_t entry, void* arg, uint32_t priority) {
+    if (!running) return NULL;
+    if (priority >= SCHED_PRIO_IDLE) priority = SCHED_PRIO_IDLE - 1; // The idle priority is the idle threads' alone
+
+    task_t* task = task_alloc(name, entry, arg, priority);
+    if (!task) return NULL;
+
+    uint32_t flags = irq_save();
+    task->cpu = this_cpu_id();
+    task_wake(task);
+    preempt_check(flags);
+    irq_restore(flags);
+    return task;
+}
+
+/**
+ * @brief Ends the calling thread; its stack is freed once another task runs.
+ *
+ * Must not be called by the boot task.
+ */
+void task_exit() {
+    irq_save(); // Never restored: this task does not run again
+    current_task()->state = TASK_DEAD;
+    schedule();
+    while (1) {} // Not reached
+}
+
+/**
+ * @brief Gives the CPU to the next runnable task of the same or higher priority, if any.
+ */
+void sched_yield() {
+    if (!running) return;
+
+    uint32_t flags = irq_save();
+    schedule();
+    irq_restore(flags);
+}
+
+/**
+ * @brief Blocks the calling task for `ticks` timer ticks (at least).
+ *
+ * @param ticks Ticks to sleep (0 just yields).
+ */
+void sched_sleep(uint32_t ticks) {
+    if (!running || !ticks) {
+        sched_yield();
+        return;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&sleep_lock);
+    task_t* task = this_cpu()->current;
+    task->state = TASK_SLEEPING;
+    task->wake_tick = timer_ticks() + ticks;
+
+    // Keep the list sorted, so sched_tick() only looks at its head
+    task_t** link = &sleepers;
+    while (*link && (int32_t)((*link)->wake_tick - task->wake_tick) <= 0) link = &(*link)->next;
+    task->next = *link;
+    *link = task;
+    spin_unlock(&sleep_lock);
+
+    schedule();
+    irq_restore(flags);
+}
+
+/**
+ * @brief Takes a wait queue's lock, so the condition waited for can be checked without missing a wake-up.
+ *
+ * @param queue Queue about to be waited on.
+ * @return EFLAGS for wait_queue_unlock(); interrupts are disabled until then.
+ */
+uint32_t wait_queue_lock(wait_queue_t* queue) {
+    return spin_lock_irqsave(&queue->lock);
+}
+
+/**
+ * @brief Releases a wait queue's lock taken with wait_queue_lock().
+ *
+ * @param queue Queue waited on.
+ * @param flags Value returned by wait_queue_lock().
+ */
+void wait_queue_unlock(wait_queue_t* queue, uint32_t flags) {
+    spin_unlock_irqrestore(&queue->lock, flags);
+}
+
+/**
+ * @brief Blocks the calling task on a wait queue until wait_queue_wake().
+ *
+ * Must be called with the queue locked by wait_queue_lock(), after
+ * checking the condition waited for, so a wake-up from another CPU
+ * cannot be missed in between. The lock is dropped while the task sleeps
+ * and held again when this returns. Callers loop until the condition
+ * holds.
+ *
+ * @param queue Queue to wait on.
+ */
+void wait_queue_sleep(wait_queue_t* queue) {
+    task_t* task = this_cpu()->current;
+
+    task->state = TASK_BLOCKED;
+    task->next = NULL;
+    if (queue->tail) {
+        queue->tail->next = task;
+    } else {
+        queue->head = task;
+    }
+    queue->tail = task;
+    spin_unlock(&queue->lock); // A waker may requeue the task from here on; on_rq and on_cpu cover that
+
+    schedule();
+    spin_lock(&queue->lock);
+}
+
+/**
+ * @brief Makes every task waiting on a queue runnable.
+ *
+ * Safe in interrupt handlers. The condition must be made true before the
+ * call. A woken task goes back to the run queue of the CPU it slept on,
+ * and preempts the task running there if its priority is higher.
+ *
+ * @param queue Queue to wake.
+ */
+void wait_queue_wake(wait_queue_t* queue) {
+    uint32_t flags = spin_lock_irqsave(&queue->lock);
+    task_t* task = queue->head;
+    queue->head = NULL;
+    queue->tail = NULL;
+
+    while (task) {
+        task_t* next = task->next; // task_wake() reuses the link
+        task_wake(task);
+        task = next;
+    }
+    spin_unlock(&queue->lock);
+
+    preempt_check(flags);
+    irq_restore(flags);
+}
+
+/**
+ * @brief Keeps the running task on the CPU until the matching preempt_enable().
+ *
+ * Interrupts still run. Calls nest. The task must not sleep meanwhile.
+ */
+void preempt_disable() {
+    uint32_t flags = irq_save(); // Count on the CPU the task is running on
+    this_cpu()->preempt_count++;
+    irq_restore(flags);
+}
+
+/**
+ * @brief Ends a preempt_disable() section, switching tasks if a switch was deferred.
+ */
+void preempt_enable() {
+    uint32_t flags = irq_save();
+    if (--this_cpu()->preempt_count == 0) preempt_check(flags);
+    irq_restore(flags);
+}
+
+/**
+ * @brief Wakes the sleepers whose time has come; interrupts must be disabled.
+ */
+static void wake_sleepers() {
+    uint32_t now = timer_ticks();
+    // Unlocked peek, since most ticks wake nobody. Another CPU may empty the list under
+    // sleep_lock meanwhile, so the head is read once (task memory stays mapped either way).
+    task_t* head = __atomic_load_n(&sleepers, __ATOMIC_ACQUIRE);
+    if (!head || (int32_t)(now - head->wake_tick) < 0) return;
+
+    spin_lock(&sleep_lock);
+    while (sleepers && (int32_t)(now - sleepers->wake_tick) >= 0) {
+        task_t* sleeper = sleepers;
+        sleepers = sleeper->next;
+        task_wake(sleeper);
+    }
+    spin_unlock(&sleep_lock);
+}
+
+/**
+ * @brief Accounts a timer tick: wakes sleepers whose time has come and ends expired time slices.
+ *
+ * Called by the timer interrupt handler of each CPU (the PIT on the
+ * bootstrap CPU, the local APIC timer on the others).
+ */
+void sched_tick() {
+    if (!running) return;
+
+    cpu_local_t* cpu = this_cpu();
+    task_t* task = cpu->current;
+    task->ticks++;
+
+    wake_sleepers();
+
+    if (task->slice && --task->slice == 0) cpu->need_resched = 1; // Round robin within the priority
+}
+
+/**
+ * @brief Switches tasks on the way out of an interrupt if one became due.
+ *
+ * Called by isr_dispatch() after a hardware interrupt has been acknowledged,
+ * so a task that never returns through the interrupt (a new thread)
+ * cannot leave the PIC waiting for an EOI.
+ */
+void sched_irq_exit() {
+    cpu_local_t* cpu = this_cpu();
+    if (running && cpu->need_resched && !cpu->preempt_count) schedule();
+}
+
+/**
+ * @brief Fills `out` with a snapshot of the tasks, oldest first (the "ps" command).
+ *
+ * @param out Array to fill.
+ * @param max Entries in out.
+ * @return Number of entries filled.
+ */
+uint32_t sched_get_tasks(task_info_t* out, uint32_t max) {
+    uint32_t count = 0;
+    uint32_t flags = spin_lock_irqsave(&tasks_lock);
+
+    for (task_t* task = all_tasks; task && count < max; task = task->all_next) {
+        task_info_t* info = &out[count++];
+        info->id = task->id;
+        info->state = task->state;
+        info->priority = task->priority;
+        info->ticks = task->ticks;
+        info->switches = task->switches;
+        info->cpu = task->cpu;
+        memcpy(info->name, task->name, TASK_NAME_LEN);
+    }
+
+    spin_unlock_irqrestore(&tasks_lock, flags);
+    return count;
+}
+
+/**
+ * @brief Returns the number of context switches since init_scheduler().
+ */
+uint32_t sched_switch_count() {
+    return switch_count;
+}
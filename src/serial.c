@@ -0,0 +1,168 @@
+#include "serial.h"
+#include "io.h"
+#include "cpu.h"
+#include "spinlock.h"
+#include "idt.h"
+#include "pic.h"
+
+static int serial_present = 0; // Set by init_serial() once the UART passed its loopback test
+
+// Transmit ring, only touched under tx_lock with interrupts off: writers move tx_head, the UART side moves tx_tail
+static spinlock_t tx_lock;
+static char tx_buffer[SERIAL_TX_BUFFER_SIZE];
+static volatile uint32_t tx_head = 0; // Count of bytes queued
+static volatile uint32_t tx_tail = 0; // Count of bytes handed to the UART
+static volatile int tx_active = 0;    // The transmit interrupt is enabled and will send the rest
+
+/**
+ * @brief Hands up to one FIFO load of queued bytes to the UART if it is ready.
+ *
+ * Must be called with tx_lock held (and so interrupts disabled).
+ */
+static void uart_fill_fifo() {
+    if (!(inb(COM1_PORT + UART_LSR) & UART_LSR_THRE)) return; // The FIFO is still sending
+
+    for (uint32_t i = 0; i < SERIAL_FIFO_SIZE && tx_tail != tx_head; i++) {
+        outb(COM1_PORT + UART_DATA, tx_buffer[tx_tail & (SERIAL_TX_BUFFER_SIZE - 1)]);
+        tx_tail++;
+    }
+}
+
+/**
+ * @brief IRQ 4 handler: queues received bytes as console input, refills the
+ *        transmit FIFO, and stops the transmit interrupt once the ring is empty.
+ */
+static void serial_irq(interrupt_frame_t* frame) {
+    (void)frame;
+
+    inb(COM1_PORT + UART_IIR); // Acknowledges a transmit-empty interrupt
+
+    // Reading the data register acknowledges a receive interrupt
+    while (inb(COM1_PORT + UART_LSR) & UART_LSR_DR) console_input(inb(COM1_PORT + UART_DATA));
+
+    spin_lock(&tx_lock);
+    if (tx_active) {
+        uart_fill_fifo();
+
+        if (tx_tail == tx_head) {
+            outb(COM1_PORT + UART_IER, UART_IER_RDA);
+            tx_active = 0;
+        }
+    }
+    spin_unlock(&tx_lock);
+}
+
+/**
+ * @brief Initializes COM1: baud rate, 8N1 framing and the FIFOs.
+ *
+ * The port is tested in loopback mode first; if nothing answers, every
+ * serial call becomes a no-op. The interrupt handler is installed and
+ * IRQ 4 unmasked, so pic_remap() and init_idt() must have run.
+ *
+ * @param baud Baud rate (SERIAL_CLOCK divided by a whole number, e.g. 115200, 38400, 9600).
+ * @return 1 if a UART was found, 0 otherwise.
+ */
+int init_serial(uint32_t baud) {
+    uint32_t divisor = baud ? SERIAL_CLOCK / baud : 1;
+    if (!divisor) divisor = 1;
+
+    outb(COM1_PORT + UART_IER, 0);                  // No interrupts while configuring
+    outb(COM1_PORT + UART_LCR, UART_LCR_DLAB);      // Expose the divisor latch
+    outb(COM1_PORT + UART_DATA, divisor & 0xFF);
+    outb(COM1_PORT + UART_IER, divisor >> 8);
+    outb(COM1_PORT + UART_LCR, UART_LCR_8N1);       // Also hides the divisor latch again
+    outb(COM1_PORT + UART_FCR, UART_FCR_INIT);
+
+    // Loopback self test: a byte sent must come straight back
+    outb(COM1_PORT + UART_MCR, UART_MCR_LOOP);
+    outb(COM1_PORT + UART_DATA, 0xAE);
+    if (inb(COM1_PORT + UART_DATA) != 0xAE) return 0;
+
+    outb(COM1_PORT + UART_MCR, UART_MCR_INIT);
+    serial_present = 1;
+
+    register_interrupt_handler(IRQ_BASE + IRQ_COM1, serial_irq);
+    outb(COM1_PORT + UART_IER, UART_IER_RDA);
+    pic_unmask(IRQ_COM1);
+    return 1;
+}
+
+/**
+ * @brief Appends a byte to the transmit ring; tx_lock must be held.
+ */
+static void tx_queue(char c) {
+    // Ring full (or interrupts were off, so nothing drained it): push one FIFO load out by hand
+    while (tx_head - tx_tail == SERIAL_TX_BUFFER_SIZE) {
+        while (!(inb(COM1_PORT + UART_LSR) & UART_LSR_THRE));
+        uart_fill_fifo();
+    }
+
+    tx_buffer[tx_head & (SERIAL_TX_BUFFER_SIZE - 1)] = c;
+    tx_head++;
+}
+
+/**
+ * @brief Starts the transmitter if it went idle; the interrupt takes over from there. tx_lock must be held.
+ */
+static void tx_start() {
+    if (!tx_active) {
+        uart_fill_fifo();
+        if (tx_tail != tx_head) {
+            tx_active = 1;
+            outb(COM1_PORT + UART_IER, UART_IER_RDA | UART_IER_THRE);
+        }
+    }
+}
+
+/**
+ * @brief Queues a byte for transmission.
+ *
+ * Bytes are sent from a ring buffer by the transmit interrupt, one FIFO
+ * load at a time. Only when the ring is full does the caller wait for the
+ * UART, and then for a whole FIFO load rather than for every byte.
+ *
+ * @param c Byte to send.
+ */
+void serial_putc(char c) {
+    if (!serial_present) return;
+
+    // Interrupts off: interrupt handlers may print too, and the transmit interrupt moves tx_tail
+    uint32_t flags = spin_lock_irqsave(&tx_lock);
+    tx_queue(c);
+    tx_start();
+    spin_unlock_irqrestore(&tx_lock, flags);
+}
+
+/**
+ * @brief Queues a null-terminated string for transmission, turning "\n" into "\r\n".
+ *
+ * The whole string is queued under one hold of the transmit lock, so
+ * strings printed by different CPUs do not interleave on the line.
+ *
+ * @param s String to send.
+ */
+void serial_print(const char* s) {
+    if (!serial_present) return;
+
+    uint32_t flags = spin_lock_irqsave(&tx_lock);
+    for (; *s; s++) {
+        if (*s == '\n') tx_queue('\r');
+        tx_queue(*s);
+    }
+    tx_start();
+    spin_unlock_irqrestore(&tx_lock, flags);
+}
+
+/**
+ * @brief Waits until every queued byte has been handed to the UART.
+ */
+void serial_flush() {
+    if (!serial_present) return;
+
+    while (tx_tail != tx_head) {
+        uint32_t flags = spin_lock_irqsave(&tx_lock);
+        while (!(inb(COM1_PORT + UART_LSR) & UART_LSR_THRE));
+        uart_fill_fifo();
+        spin_unlock_irqrestore(&tx_lock, flags);
+    }
+}
@@ -0,0 +1,279 @@
+#include "slab.h"
+#include "memory.h"
+#include "cpu.h"
+#include "string.h"
+
+// Header at the start of every slab page
+struct Slab {
+    kmem_cache_t* cache;  // Cache this slab belongs to
+    Slab* next;           // Next slab in the cache's partial list
+    Slab* prev;           // Previous slab in the cache's partial list
+    void* free_objects;   // Singly linked list of free objects, threaded through the objects themselves
+    uint32_t in_use;      // Number of objects currently allocated from this slab
+};
+
+static kmem_cache_t kmalloc_caches[KMALLOC_CACHE_COUNT]; // Size classes 8, 16, ..., 1024
+static int kmalloc_caches_ready = 0;                     // Set once init_slab_allocator() has run
+
+/**
+ * @brief Computes the slab layout for a cache.
+ *
+ * @return 1 on success, 0 if not even one object fits in a page.
+ */
+static int kmem_cache_setup(kmem_cache_t* cache, uint32_t size, uint32_t align) {
+    if (align == 0) align = 8;
+    if (align & (align - 1)) return 0; // Alignment must be a power of two
+    if (size < sizeof(void*)) size = sizeof(void*); // Room for the free-list link
+
+    cache->object_size = (size + align - 1) & ~(align - 1);
+    cache->first_offset = (sizeof(Slab) + align - 1) & ~(align - 1);
+    if (cache->first_offset >= PAGE_SIZE) return 0;
+    cache->objects_per_slab = (PAGE_SIZE - cache->first_offset) / cache->object_size;
+    cache->partial = NULL;
+    cache->empty = NULL;
+    cache->lock = (spinlock_t){ 0, 0 };
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        cache->magazines[cpu].count = 0;
+    }
+
+    return cache->objects_per_slab != 0;
+}
+
+/**
+ * @brief Sets up the static kmalloc size-class caches (8 to 1024 bytes).
+ *
+ * Until this is called, kmalloc() serves every request from the heap.
+ */
+void init_slab_allocator() {
+    for (uint32_t i = 0; i < KMALLOC_CACHE_COUNT; i++) {
+        uint32_t size = SLAB_MIN_SIZE << i;
+        // Align objects to their own size (up to a cache line) so small objects never straddle a line
+        kmem_cache_setup(&kmalloc_caches[i], size, size < SLAB_CACHE_LINE ? size : SLAB_CACHE_LINE);
+    }
+    kmalloc_caches_ready = 1;
+}
+
+/**
+ * @brief Creates a cache for objects of a fixed size.
+ *
+ * Each slab is one page from alloc_page() with a small slab header at the
+ * start; objects carry no per-object header.
+ *
+ * @param size  Object size in bytes.
+ * @param align Object alignment in bytes (a power of two; 0 for 8 bytes).
+ * @return Pointer to the new cache, or NULL if the object does not fit in a page
+ *         or the descriptor could not be allocated.
+ */
+kmem_cache_t* kmem_cache_create(uint32_t size, uint32_t align) {
+    kmem_cache_t* cache = (kmem_cache_t*)kmalloc(sizeof(kmem_cache_t));
+    if (!cache) return NULL;
+
+    if (!kmem_cache_setup(cache, size, align)) {
+        kfree(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+/**
+ * @brief Allocates a new slab page and threads all of its objects onto its free list.
+ */
+static Slab* slab_grow(kmem_cache_t* cache) {
+    void* page = alloc_page();
+    if (!page) return NULL;
+    Slab* slab = (Slab*)phys_to_virt((uint32_t)page); // Slabs are used through the direct map
+
+    slab->cache = cache;
+    slab->next = NULL;
+    slab->prev = NULL;
+    slab->in_use = 0;
+
+    // Link objects in address order so consecutive allocations are adjacent in memory
+    uint8_t* obj = (uint8_t*)slab + cache->first_offset;
+    slab->free_objects = obj;
+    for (uint32_t i = 1; i < cache->objects_per_slab; i++) {
+        *(void**)obj = obj + cache->object_size;
+        obj += cache->object_size;
+    }
+    *(void**)obj = NULL;
+
+    return slab;
+}
+
+/**
+ * @brief Removes a slab from its cache's partial list.
+ */
+static void slab_unlink(kmem_cache_t* cache, Slab* slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        cache->partial = slab->next;
+    }
+    if (slab->next) slab->next->prev = slab->prev;
+    slab->next = NULL;
+    slab->prev = NULL;
+}
+
+/**
+ * @brief Pushes a slab onto the head of its cache's partial list.
+ */
+static void slab_push(kmem_cache_t* cache, Slab* slab) {
+    slab->prev = NULL;
+    slab->next = cache->partial;
+    if (slab->next) slab->next->prev = slab;
+    cache->partial = slab;
+}
+
+/**
+ * @brief Takes one object from the cache's slabs, growing the cache if needed.
+ */
+static void* slab_alloc_object(kmem_cache_t* cache) {
+    Slab* slab = cache->partial;
+
+    if (!slab) {
+        // Reuse the spare empty slab before asking for a new page
+        slab = cache->empty;
+        cache->empty = NULL;
+        if (!slab) slab = slab_grow(cache);
+        if (!slab) return NULL; // Out of memory
+        slab_push(cache, slab);
+    }
+
+    void* obj = slab->free_objects;
+    slab->free_objects = *(void**)obj;
+    slab->in_use++;
+
+    // A full slab leaves the partial list until one of its objects is freed
+    if (!slab->free_objects) {
+        slab_unlink(cache, slab);
+    }
+
+    return obj;
+}
+
+/**
+ * @brief Puts one object back into its slab.
+ *
+ * A slab that becomes completely free is kept as the cache's spare slab,
+ * or given back with free_page() if the cache already has one.
+ */
+static void slab_free_object(kmem_cache_t* cache, void* obj) {
+    Slab* slab = (Slab*)((uint32_t)obj & ~(PAGE_SIZE - 1));
+    int was_full = (slab->free_objects == NULL);
+
+    *(void**)obj = slab->free_objects;
+    slab->free_objects = obj;
+    slab->in_use--;
+
+    if (slab->in_use == 0) {
+        if (!was_full) slab_unlink(cache, slab); // Single-object slabs were never on the partial list
+
+        if (!cache->empty) {
+            cache->empty = slab;
+        } else {
+            free_page((void*)virt_to_phys(slab));
+        }
+    } else if (was_full) {
+        slab_push(cache, slab);
+    }
+}
+
+/**
+ * @brief Allocates one object from a cache in O(1).
+ *
+ * Served from the calling CPU's magazine, which is refilled with
+ * SLAB_MAGAZINE_BATCH objects from the slabs when it runs empty; only
+ * the refill takes the cache lock.
+ *
+ * @param cache Cache to allocate from.
+ * @return Pointer to the object, or NULL if no page could be allocated for a new slab.
+ */
+void* kmem_cache_alloc(kmem_cache_t* cache) {
+    uint32_t flags = irq_save(); // Keep interrupt handlers on this CPU out of the magazine
+    slab_magazine_t* mag = &cache->magazines[this_cpu_id()];
+
+    if (mag->count == 0) {
+        spin_lock(&cache->lock);
+        while (mag->count < SLAB_MAGAZINE_BATCH) {
+            void* obj = slab_alloc_object(cache);
+            if (!obj) break;
+            mag->objects[mag->count++] = obj;
+        }
+        spin_unlock(&cache->lock);
+    }
+
+    void* obj = mag->count ? mag->objects[--mag->count] : NULL;
+    irq_restore(flags);
+    return obj;
+}
+
+/**
+ * @brief Returns an object to its cache in O(1).
+ *
+ * The object goes onto the calling CPU's magazine; a full magazine first
+ * returns SLAB_MAGAZINE_BATCH objects to their slabs.
+ *
+ * @param cache Cache the object was allocated from.
+ * @param obj   Object to free.
+ */
+void kmem_cache_free(kmem_cache_t* cache, void* obj) {
+    if (!obj) return;
+
+    uint32_t flags = irq_save();
+    slab_magazine_t* mag = &cache->magazines[this_cpu_id()];
+
+    if (mag->count == SLAB_MAGAZINE_SIZE) {
+        // Return the oldest objects so the most recently freed (cache-warm) ones stay local
+        spin_lock(&cache->lock);
+        for (uint32_t i = 0; i < SLAB_MAGAZINE_BATCH; i++) {
+            slab_free_object(cache, mag->objects[i]);
+        }
+        spin_unlock(&cache->lock);
+        memmove(&mag->objects[0], &mag->objects[SLAB_MAGAZINE_BATCH], (SLAB_MAGAZINE_SIZE - SLAB_MAGAZINE_BATCH) * sizeof(void*));
+        mag->count -= SLAB_MAGAZINE_BATCH;
+    }
+
+    mag->objects[mag->count++] = obj;
+    irq_restore(flags);
+}
+
+/**
+ * @brief Returns the kmalloc size-class cache serving `size` bytes.
+ *
+ * @param size Requested allocation size.
+ * @return The cache, or NULL if the size is above SLAB_MAX_SIZE or the
+ *         caches are not initialized yet.
+ */
+kmem_cache_t* kmalloc_cache_for(uint32_t size) {
+    if (!kmalloc_caches_ready || size > SLAB_MAX_SIZE) return NULL;
+    if (size <= SLAB_MIN_SIZE) return &kmalloc_caches[0];
+
+    // Index of the highest set bit of (size - 1) gives log2 of the next power of two minus one
+    uint32_t msb;
+    asm("bsr %1, %0" : "=r"(msb) : "rm"(size - 1));
+    return &kmalloc_caches[msb + 1 - SLAB_MIN_SHIFT];
+}
+
+/**
+ * @brief Frees an object allocated from any slab cache.
+ *
+ * The owning cache is found from the slab header at the start of the
+ * object's page; used by kfree() for small allocations.
+ *
+ * @param obj Object to free.
+ */
+void slab_free(void* obj) {
+    Slab* slab = (Slab*)((uint32_t)obj & ~(PAGE_SIZE - 1));
+    kmem_cache_free(slab->cache, obj);
+}
+
+/**
+ * @brief Returns the object size of the cache an object belongs to.
+ *
+ * @param obj Object allocated from any slab cache.
+ * @return Size of the object in bytes.
+ */
+uint32_t slab_object_size(void* obj) {
+    Slab* slab = (Slab*)((uint32_t)obj & ~(PAGE_SIZE - 1));
+    return slab->cache->object_size;
+}
@@ -0,0 +1,214 @@
+#include "smp.h"
+#include "percpu.h"
+#include "lapic.h"
+#include "acpi.h"
+#include "sched.h"
+#include "memory.h"
+#include "timer.h"
+#include "idt.h"
+#include "io.h"
+#include "cpu.h"
+#include "string.h"
+#include "kprintf.h"
+
+extern uint8_t ap_trampoline_start[]; // AP startup code (ap_boot.asm), copied to AP_TRAMPOLINE_ADDR
+extern uint8_t ap_trampoline_end[];
+extern uint8_t ap_boot_params[];      // ap_boot_params_t inside that code
+extern uint32_t* page_directory;      // Kernel page directory (memory.c), loaded by the APs too
+
+static uint32_t cpu_count = 1;         // CPUs online, the bootstrap CPU included
+static uint32_t lapic_timer_count = 0; // Local APIC timer counts per PIT tick, measured on the bootstrap CPU
+
+/**
+ * @brief Local APIC timer handler of the APs: their scheduler tick.
+ */
+static void lapic_timer_irq(interrupt_frame_t* frame) {
+    (void)frame;
+    sched_tick();
+}
+
+/**
+ * @brief TLB shootdown IPI handler.
+ */
+static void tlb_flush_ipi(interrupt_frame_t* frame) {
+    (void)frame;
+    smp_poll();
+}
+
+/**
+ * @brief Carries out a TLB flush another CPU asked this one for, if any.
+ *
+ * Called by the TLB shootdown IPI handler and by spin_lock() while it waits.
+ */
+void smp_poll() {
+    uint32_t flags = irq_save(); // Flush and acknowledge on the same CPU
+    cpu_local_t* cpu = this_cpu();
+    uint32_t wanted = __atomic_load_n(&cpu->tlb_flush_req, __ATOMIC_ACQUIRE);
+    if (wanted != cpu->tlb_flush_done) {
+        flush_tlb_global(); // Kernel mappings are global
+        __atomic_store_n(&cpu->tlb_flush_done, wanted, __ATOMIC_RELEASE);
+    }
+    irq_restore(flags);
+}
+
+/**
+ * @brief Flushes the TLB of every other online CPU and waits until they have.
+ *
+ * Called after kernel mappings were removed or changed, before the frames
+ * behind them are reused. Waits with interrupts disabled; the other CPUs
+ * answer from the IPI handler, or from smp_poll() while they spin for a lock.
+ */
+void tlb_shootdown() {
+    uint32_t flags = irq_save();
+    cpu_local_t* self = this_cpu();
+    uint32_t wanted[MAX_CPUS];
+    uint32_t targets = 0; // Bit i: CPU i was asked
+
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        cpu_local_t* cpu = &cpu_locals[i];
+        if (cpu == self || !cpu->online) continue;
+
+        wanted[i] = __atomic_add_fetch(&cpu->tlb_flush_req, 1, __ATOMIC_ACQ_REL);
+        lapic_send_ipi(cpu->apic_id, IPI_TLB_FLUSH_VECTOR);
+        targets |= 1u << i;
+    }
+
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        if (!(targets & (1u << i))) continue;
+        // Keep answering requests aimed at this CPU, or two CPUs shooting down at once would wait on each other
+        while ((int32_t)(__atomic_load_n(&cpu_locals[i].tlb_flush_done, __ATOMIC_ACQUIRE) - wanted[i]) < 0) {
+            asm volatile("pause");
+            smp_poll();
+        }
+    }
+    irq_restore(flags);
+}
+
+/**
+ * @brief Sends a reschedule interrupt, so a CPU looks at its run queue (and those of others) now.
+ *
+ * @param cpu Index of the CPU to interrupt.
+ */
+void smp_send_reschedule(uint32_t cpu) {
+    if (cpu >= MAX_CPUS || !cpu_locals[cpu].online) return;
+    lapic_send_ipi(cpu_locals[cpu].apic_id, IPI_RESCHEDULE_VECTOR);
+}
+
+/**
+ * @brief Returns the number of CPUs online.
+ */
+uint32_t smp_cpu_count() {
+    return cpu_count;
+}
+
+/**
+ * @brief Busy-waits for at least `ms` milliseconds, using the PIT ticks.
+ */
+static void delay_ms(uint32_t ms) {
+    uint32_t start = timer_ticks();
+    uint32_t ticks = ms_to_ticks(ms) + 1; // The first tick may come right away
+    while (timer_ticks() - start < ticks) asm volatile("pause");
+}
+
+/**
+ * @brief First C code of an AP, called by ap_boot.asm on the AP's boot stack with paging on.
+ *
+ * @param cpu Index of the AP's per-CPU area.
+ */
+static void ap_main(uint32_t cpu) {
+    cpu_init(cpu, cpu_locals[cpu].stack_top);
+    idt_load();
+    lapic_enable();
+    lapic_timer_start(lapic_timer_count);
+    sched_start_cpu(); // Becomes this CPU's idle thread
+}
+
+/**
+ * @brief Starts one AP with the INIT, STARTUP, STARTUP sequence and waits for it to come online.
+ *
+ * The trampoline must already be at AP_TRAMPOLINE_ADDR and identity mapped.
+ *
+ * @param cpu     Index of the per-CPU area the AP gets.
+ * @param apic_id Local APIC id of the AP.
+ * @return 1 if the AP came online, 0 if it did not (or its stack could not be allocated).
+ */
+static int start_ap(uint32_t cpu, uint32_t apic_id) {
+    void* stack = alloc_pages(TASK_STACK_PAGES, 0);
+    if (!stack) return 0;
+
+    cpu_local_t* local = &cpu_locals[cpu];
+    local->apic_id = apic_id;
+    local->stack_top = (uint32_t)phys_to_virt((uint32_t)stack) + TASK_STACK_PAGES * PAGE_SIZE;
+
+    ap_boot_params_t* params = (ap_boot_params_t*)phys_to_virt(AP_TRAMPOLINE_ADDR + (ap_boot_params - ap_trampoline_start));
+    params->cr0 = read_cr0();
+    params->cr3 = read_cr3();
+    params->cr4 = read_cr4();
+    params->stack = local->stack_top;
+    params->entry = (uint32_t)ap_main;
+    params->cpu = cpu;
+
+    lapic_send_ipi(apic_id, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT);
+    delay_ms(AP_INIT_DELAY_MS);
+
+    // A second STARTUP IPI only if the first one got lost; a running AP ignores it anyway
+    for (uint32_t attempt = 0; attempt < 2 && !local->online; attempt++) {
+        lapic_send_ipi(apic_id, LAPIC_ICR_STARTUP | LAPIC_ICR_ASSERT | (AP_TRAMPOLINE_ADDR >> 12));
+        for (uint32_t us = 0; us < AP_SIPI_DELAY_US; us++) io_wait(); // At least 1 microsecond each
+    }
+
+    uint32_t start = timer_ticks();
+    uint32_t timeout = ms_to_ticks(AP_STARTUP_TIMEOUT_MS);
+    while (!local->online && timer_ticks() - start < timeout) asm volatile("pause");
+    return local->online != 0;
+}
+
+/**
+ * @brief Starts the application processors listed in the ACPI MADT.
+ *
+ * Each AP gets a per-CPU area (GDT, TSS, magazines, run queue), a boot
+ * stack that becomes its idle thread, and a local APIC timer ticking at
+ * TIMER_HZ, then takes work from the run queues of the others. Without
+ * a MADT or a local APIC the system keeps running on the bootstrap CPU
+ * alone. init_scheduler() and init_timer() must have run, and interrupts
+ * must be enabled (the startup delays and the APIC timer calibration use
+ * the PIT).
+ *
+ * @return Number of CPUs online, the bootstrap CPU included.
+ */
+uint32_t init_smp() {
+    madt_info_t madt;
+    if (!acpi_parse_madt(&madt) || madt.cpu_count < 2) {
+        klog(LOG_INFO, "smp: single CPU");
+        return cpu_count;
+    }
+    if (!init_lapic(madt.lapic_address)) return cpu_count;
+
+    register_interrupt_handler(LAPIC_TIMER_VECTOR, lapic_timer_irq);
+    register_interrupt_handler(IPI_TLB_FLUSH_VECTOR, tlb_flush_ipi);
+    lapic_enable();
+    cpu_locals[0].apic_id = lapic_id();
+    lapic_timer_count = lapic_timer_calibrate();
+
+    // The APs switch paging on while running from the trampoline, so its page is identity mapped meanwhile
+    memcpy(phys_to_virt(AP_TRAMPOLINE_ADDR), ap_trampoline_start, ap_trampoline_end - ap_trampoline_start);
+    if (!map_page_with_directory(page_directory, AP_TRAMPOLINE_ADDR, AP_TRAMPOLINE_ADDR, PAGE_WRITABLE)) return cpu_count;
+
+    uint32_t next = 1; // Per-CPU area of the next AP; one that fails keeps its slot, in case it still wakes up
+    for (uint32_t i = 0; i < madt.cpu_count && next < MAX_CPUS; i++) {
+        uint32_t apic_id = madt.apic_ids[i];
+        if (apic_id == cpu_locals[0].apic_id) continue;
+
+        if (start_ap(next, apic_id)) {
+            cpu_count++;
+        } else {
+            klog(LOG_WARN, "smp: CPU with local APIC %u did not start", apic_id);
+        }
+        next++;
+    }
+
+    unmap_range(page_directory, AP_TRAMPOLINE_ADDR, PAGE_SIZE, 0);
+    klog(LOG_INFO, "smp: %u CPUs online (%u in the MADT), APIC timer at %u counts per tick",
+         cpu_count, madt.cpu_count, lapic_timer_count);
+    return cpu_count;
+}
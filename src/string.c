@@ -0,0 +1,320 @@
+#include "string.h"
+#include "cpu.h"
+#include "percpu.h"
+
+typedef uint32_t __attribute__((may_alias)) alias_word_t; // Word access to buffers of any type
+
+#ifdef STRING_SSE
+static int sse_enabled = 0; // Set by init_string_sse() once CR4.OSFXSR is on (the APs copy CR4 from the bootstrap CPU)
+#endif
+
+/**
+ * @brief Enables SSE (CR4.OSFXSR) and the SSE2 bulk paths of memset/memcpy/memmove.
+ *
+ * Only has an effect when built with STRING_SSE (`make STRING_SSE=1`) on
+ * a CPU with SSE2; otherwise the rep-string paths stay in use. The XMM
+ * registers are only used with interrupts disabled and never across a
+ * call, so no XMM state needs to be saved on interrupts or task switches.
+ *
+ * @return 1 if the SSE2 paths are in use, 0 otherwise.
+ */
+int init_string_sse() {
+#ifdef STRING_SSE
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if ((edx & (CPUID_EDX_FXSR | CPUID_EDX_SSE2)) != (CPUID_EDX_FXSR | CPUID_EDX_SSE2)) return 0;
+
+    write_cr0((read_cr0() & ~CR0_EM) | CR0_MP);
+    write_cr4(read_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT);
+    asm volatile("fninit");
+
+    sse_enabled = 1;
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+#ifdef STRING_SSE
+/**
+ * @brief Claims the XMM registers for one bulk operation.
+ *
+ * Interrupts stay off until sse_end(), so no handler can run in the
+ * middle; a page fault inside the block sees this CPU's sse_busy and
+ * falls back to the rep-string path.
+ *
+ * @param flags Receives the EFLAGS value to pass to sse_end().
+ * @return 1 if the SSE path may be used, 0 otherwise.
+ */
+static int sse_begin(uint32_t* flags) {
+    if (!sse_enabled) return 0;
+
+    *flags = irq_save();
+    cpu_local_t* cpu = this_cpu();
+    if (cpu->sse_busy) {
+        irq_restore(*flags);
+        return 0;
+    }
+    cpu->sse_busy = 1;
+    return 1;
+}
+
+static void sse_end(uint32_t flags) {
+    this_cpu()->sse_busy = 0;
+    irq_restore(flags);
+}
+
+/**
+ * @brief Stores a repeated 32-bit pattern with aligned 16-byte SSE2 stores.
+ *
+ * @param dst 16-byte aligned destination.
+ * @param n   Number of bytes, a non-zero multiple of 64.
+ */
+static void sse_fill(uint8_t* dst, uint32_t pattern, uint32_t n) {
+    asm volatile(
+        "movd %2, %%xmm0\n\t"
+        "pshufd $0, %%xmm0, %%xmm0\n\t"
+        "1:\n\t"
+        "movdqa %%xmm0, (%0)\n\t"
+        "movdqa %%xmm0, 16(%0)\n\t"
+        "movdqa %%xmm0, 32(%0)\n\t"
+        "movdqa %%xmm0, 48(%0)\n\t"
+        "add $64, %0\n\t"
+        "sub $64, %1\n\t"
+        "jnz 1b"
+        : "+r"(dst), "+r"(n) : "r"(pattern) : "memory", "cc");
+}
+
+/**
+ * @brief Copies forward in 64-byte blocks, each loaded completely before it is stored.
+ *
+ * @param dst 16-byte aligned destination (below `src` if the buffers overlap).
+ * @param n   Number of bytes, a non-zero multiple of 64.
+ */
+static void sse_copy(uint8_t* dst, const uint8_t* src, uint32_t n) {
+    asm volatile(
+        "1:\n\t"
+        "movdqu (%1), %%xmm0\n\t"
+        "movdqu 16(%1), %%xmm1\n\t"
+        "movdqu 32(%1), %%xmm2\n\t"
+        "movdqu 48(%1), %%xmm3\n\t"
+        "movdqa %%xmm0, (%0)\n\t"
+        "movdqa %%xmm1, 16(%0)\n\t"
+        "movdqa %%xmm2, 32(%0)\n\t"
+        "movdqa %%xmm3, 48(%0)\n\t"
+        "add $64, %0\n\t"
+        "add $64, %1\n\t"
+        "sub $64, %2\n\t"
+        "jnz 1b"
+        : "+r"(dst), "+r"(src), "+r"(n) :: "memory", "cc");
+}
+#endif
+
+/**
+ * @brief Stores `n` bytes of a repeated 32-bit pattern with REP STOSD, then REP STOSB for the tail.
+ */
+static void rep_fill(uint8_t* dst, uint32_t pattern, uint32_t n) {
+    uint32_t words = n / 4;
+    uint32_t bytes = n % 4;
+    asm volatile("rep stosl" : "+D"(dst), "+c"(words) : "a"(pattern) : "memory");
+    asm volatile("rep stosb" : "+D"(dst), "+c"(bytes) : "a"(pattern) : "memory");
+}
+
+/**
+ * @brief Stores `count` copies of a 16-bit value with REP STOSD, then REP STOSW for an odd cell.
+ */
+static void rep_fill16(uint8_t* dst, uint16_t value, uint32_t count) {
+    uint32_t words = count / 2;
+    uint32_t cells = count % 2;
+    asm volatile("rep stosl" : "+D"(dst), "+c"(words) : "a"(value | ((uint32_t)value << 16)) : "memory");
+    asm volatile("rep stosw" : "+D"(dst), "+c"(cells) : "a"(value) : "memory");
+}
+
+/**
+ * @brief Copies `n` bytes forward with REP MOVSD, then REP MOVSB for the tail.
+ */
+static void rep_copy(uint8_t* dst, const uint8_t* src, uint32_t n) {
+    uint32_t words = n / 4;
+    uint32_t bytes = n % 4;
+    asm volatile("rep movsl" : "+D"(dst), "+S"(src), "+c"(words) :: "memory");
+    asm volatile("rep movsb" : "+D"(dst), "+S"(src), "+c"(bytes) :: "memory");
+}
+
+/**
+ * @brief Fills `n` bytes at `dst` with the byte `value`.
+ *
+ * @return `dst`.
+ */
+void* memset(void* dst, int value, uint32_t n) {
+    uint8_t* d = dst;
+    uint32_t pattern = (uint8_t)value * 0x01010101u;
+
+#ifdef STRING_SSE
+    uint32_t flags;
+    if (n >= STRING_SSE_MIN && sse_begin(&flags)) {
+        uint32_t head = -(uint32_t)d & 15; // Bytes up to the first 16-byte boundary
+        rep_fill(d, pattern, head);
+        d += head;
+        n -= head;
+
+        uint32_t bulk = n & ~63u;
+        sse_fill(d, pattern, bulk);
+        sse_end(flags);
+        d += bulk;
+        n -= bulk;
+    }
+#endif
+
+    rep_fill(d, pattern, n);
+    return dst;
+}
+
+/**
+ * @brief Fills `count` 16-bit cells at `dst` with `value` (e.g. VGA character/attribute pairs).
+ *
+ * @return `dst`.
+ */
+void* memset16(void* dst, uint16_t value, uint32_t count) {
+    uint8_t* d = dst;
+
+#ifdef STRING_SSE
+    uint32_t flags;
+    if (count * 2 >= STRING_SSE_MIN && !((uint32_t)d & 1) && sse_begin(&flags)) {
+        uint32_t head = (-(uint32_t)d & 15) / 2; // Cells up to the first 16-byte boundary
+        rep_fill16(d, value, head);
+        d += head * 2;
+        count -= head;
+
+        uint32_t bulk = (count * 2) & ~63u;
+        sse_fill(d, value | ((uint32_t)value << 16), bulk);
+        sse_end(flags);
+        d += bulk;
+        count -= bulk / 2;
+    }
+#endif
+
+    rep_fill16(d, value, count);
+    return dst;
+}
+
+/**
+ * @brief Copies `n` bytes from `src` to `dst`. The buffers must not overlap.
+ *
+ * @return `dst`.
+ */
+void* memcpy(void* dst, const void* src, uint32_t n) {
+    uint8_t* d = dst;
+    const uint8_t* s = src;
+
+#ifdef STRING_SSE
+    uint32_t flags;
+    if (n >= STRING_SSE_MIN && sse_begin(&flags)) {
+        uint32_t head = -(uint32_t)d & 15; // Align the stores; the loads may stay unaligned
+        rep_copy(d, s, head);
+        d += head;
+        s += head;
+        n -= head;
+
+        uint32_t bulk = n & ~63u;
+        sse_copy(d, s, bulk);
+        sse_end(flags);
+        d += bulk;
+        s += bulk;
+        n -= bulk;
+    }
+#endif
+
+    rep_copy(d, s, n);
+    return dst;
+}
+
+/**
+ * @brief Copies `n` bytes from `src` to `dst`; the buffers may overlap.
+ *
+ * A destination below the source (or not overlapping it) is copied
+ * forward like memcpy(); otherwise the copy runs backward from the end
+ * with the direction flag set.
+ *
+ * @return `dst`.
+ */
+void* memmove(void* dst, const void* src, uint32_t n) {
+    uint8_t* d = dst;
+    const uint8_t* s = src;
+
+    if ((uint32_t)d - (uint32_t)s >= n) return memcpy(dst, src, n); // Forward copying never reads a byte already overwritten
+
+    // Tail bytes first, then whole words, moving down from the last byte
+    uint32_t words = n / 4;
+    uint32_t bytes = n % 4;
+    d += n - 1;
+    s += n - 1;
+    asm volatile(
+        "std\n\t"
+        "rep movsb\n\t"
+        "sub $3, %%esi\n\t"
+        "sub $3, %%edi\n\t"
+        "mov %3, %%ecx\n\t"
+        "rep movsl\n\t"
+        "cld"
+        : "+D"(d), "+S"(s), "+c"(bytes) : "r"(words) : "memory", "cc");
+    return dst;
+}
+
+/**
+ * @brief Compares `n` bytes of two buffers.
+ *
+ * @return Negative, zero or positive as `a` sorts before, equal to or after `b` (bytes compared unsigned).
+ */
+int memcmp(const void* a, const void* b, uint32_t n) {
+    const uint8_t* p = a;
+    const uint8_t* q = b;
+
+    // Skip equal words, then find the first differing byte
+    while (n >= 4 && *(const alias_word_t*)p == *(const alias_word_t*)q) {
+        p += 4;
+        q += 4;
+        n -= 4;
+    }
+    while (n && *p == *q) {
+        p++;
+        q++;
+        n--;
+    }
+    return n ? *p - *q : 0;
+}
+
+/**
+ * @brief Returns the length of a null-terminated string.
+ */
+uint32_t strlen(const char* s) {
+    uint32_t len = 0;
+    while (s[len]) len++;
+    return len;
+}
+
+/**
+ * @brief Compares two null-terminated strings in byte order.
+ *
+ * @return Negative, zero or positive as `a` sorts before, equal to or after `b`.
+ */
+int strcmp(const char* a, const char* b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return (uint8_t)*a - (uint8_t)*b;
+}
+
+/**
+ * @brief Compares at most `n` characters of two null-terminated strings.
+ *
+ * @return Negative, zero or positive as `a` sorts before, equal to or after `b`.
+ */
+int strncmp(const char* a, const char* b, uint32_t n) {
+    while (n && *a && *a == *b) {
+        a++;
+        b++;
+        n--;
+    }
+    return n ? (uint8_t)*a - (uint8_t)*b : 0;
+}
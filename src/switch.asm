@@ -0,0 +1,24 @@
+global context_switch   ;Called by the scheduler (sched.c) to move from one kernel stack to another.
+
+section .text           ;Marks the beginning of the code section.
+bits 32                 ;Assembles this file in 32-bit mode.
+
+;void context_switch(uint32_t* save_esp, uint32_t load_esp)
+;Only the callee-saved registers need saving: the caller (schedule() in C) already assumes EAX, ECX and EDX are clobbered.
+;EFLAGS is not saved either; every switch happens with interrupts disabled, and each task restores its own flags afterwards.
+context_switch:
+    mov eax, [esp + 4]  ;save_esp.
+    mov edx, [esp + 8]  ;load_esp.
+
+    push ebp            ;Save the outgoing task's callee-saved registers on its own stack.
+    push ebx
+    push esi
+    push edi
+    mov [eax], esp      ;Remember where they are (task_t.esp).
+
+    mov esp, edx        ;Switch to the incoming task's stack.
+    pop edi             ;Restore what it saved here, in reverse order.
+    pop esi
+    pop ebx
+    pop ebp
+    ret                 ;Return into the incoming task: after its own context_switch() call, or into task_start() for a new thread.
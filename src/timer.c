@@ -0,0 +1,55 @@
+#include "timer.h"
+#include "io.h"
+#include "idt.h"
+#include "pic.h"
+#include "sched.h"
+
+static volatile uint32_t ticks = 0; // Timer interrupts since init_timer()
+static uint32_t timer_hz = 0;       // Rate programmed by init_timer()
+
+/**
+ * @brief IRQ 0 handler: counts the tick and lets the scheduler account for it.
+ */
+static void timer_irq(interrupt_frame_t* frame) {
+    (void)frame;
+
+    ticks++;
+    sched_tick();
+}
+
+/**
+ * @brief Programs PIT channel 0 to interrupt `hz` times per second and unmasks IRQ 0.
+ *
+ * Each interrupt advances the tick count and calls sched_tick().
+ * pic_remap() and init_idt() must have run.
+ *
+ * @param hz Interrupt rate (19 to PIT_FREQUENCY).
+ */
+void init_timer(uint32_t hz) {
+    uint32_t divisor = PIT_FREQUENCY / hz;
+    if (divisor > 0xFFFF) divisor = 0xFFFF; // 16-bit counter
+    if (divisor < 1) divisor = 1;
+    timer_hz = PIT_FREQUENCY / divisor;
+
+    outb(PIT_COMMAND, PIT_MODE_RATE);
+    outb(PIT_CHANNEL0, divisor & 0xFF);
+    outb(PIT_CHANNEL0, divisor >> 8);
+
+    register_interrupt_handler(IRQ_BASE + IRQ_TIMER, timer_irq);
+    pic_unmask(IRQ_TIMER);
+}
+
+/**
+ * @brief Returns the number of timer interrupts since init_timer().
+ */
+uint32_t timer_ticks() {
+    return ticks;
+}
+
+/**
+ * @brief Converts milliseconds to timer ticks, rounding up.
+ */
+uint32_t ms_to_ticks(uint32_t ms) {
+    // Whole seconds first, so large values do not overflow (no 64-bit division here)
+    return ms / 1000 * timer_hz + ((ms % 1000) * timer_hz + 999) / 1000;
+}
@@ -0,0 +1,145 @@
+#include "trace.h"
+#include "cpu.h"
+#include "kprintf.h"
+#include "serial.h"
+
+_Static_assert(sizeof(trace_event_t) == TRACE_RECORD_SIZE, "trace_event_t must match the binary dump format");
+
+static trace_event_t trace_ring[TRACE_RING_ENTRIES]; // Event i is at trace_ring[i % TRACE_RING_ENTRIES]
+static uint32_t trace_head = 0;                      // Number of events recorded since the last trace_clear()
+static volatile int trace_paused = 0;                // Set while the ring is read, so the reader's own events are not recorded
+
+// Names printed by trace_dump(), indexed by event id
+static const char* const event_names[] = {
+    [TRACE_ALLOC_PAGE]  = "alloc_page",
+    [TRACE_FREE_PAGE]   = "free_page",
+    [TRACE_KMALLOC]     = "kmalloc",
+    [TRACE_KFREE]       = "kfree",
+    [TRACE_HEAP_WALK]   = "heap_walk",
+    [TRACE_MAP_PAGE]    = "map_page",
+    [TRACE_PAGE_TABLE]  = "page_table",
+    [TRACE_PAGE_FAULT]  = "page_fault",
+    [TRACE_SCROLL]      = "scroll",
+    [TRACE_FLUSH_BEGIN] = "flush_begin",
+    [TRACE_FLUSH_END]   = "flush_end",
+    [TRACE_TASK_SWITCH] = "task_switch",
+};
+
+#define EVENT_NAME_COUNT (sizeof(event_names) / sizeof(event_names[0]))
+
+/**
+ * @brief Appends an event to the trace ring, overwriting the oldest when full.
+ *
+ * Safe in interrupt handlers and on several CPUs at once. Normally called
+ * through TRACE_EVENT(). TSC values of different CPUs are only comparable
+ * where their counters run in step.
+ *
+ * @param event TRACE_* id.
+ * @param a, b  Event arguments.
+ */
+void trace_record(uint32_t event, uint32_t a, uint32_t b) {
+    if (trace_paused) return;
+
+    uint32_t flags = irq_save();
+    uint32_t seq = __atomic_fetch_add(&trace_head, 1, __ATOMIC_RELAXED); // Each CPU claims its own slot
+    trace_event_t* entry = &trace_ring[seq & (TRACE_RING_ENTRIES - 1)];
+    entry->tsc = rdtsc();
+    entry->event = event;
+    entry->reserved = 0;
+    entry->a = a;
+    entry->b = b;
+    irq_restore(flags);
+}
+
+/**
+ * @brief Discards every recorded event.
+ */
+void trace_clear() {
+    uint32_t flags = irq_save();
+    trace_head = 0;
+    irq_restore(flags);
+}
+
+/**
+ * @brief Returns the sequence number of the oldest event still in the ring.
+ */
+static uint32_t oldest_event() {
+    return trace_head > TRACE_RING_ENTRIES ? trace_head - TRACE_RING_ENTRIES : 0;
+}
+
+/**
+ * @brief Prints the recorded events, oldest first, with TSC deltas (the "trace" command).
+ *
+ * Each line gives the cycles since the previous event, the event name and
+ * its two arguments in hex. Recording stops while the ring is printed.
+ *
+ * @param max Most recent events to print (0 for all).
+ */
+void trace_dump(uint32_t max) {
+    trace_paused = 1;
+
+    uint32_t head = trace_head;
+    uint32_t seq = oldest_event();
+    if (max && head - seq > max) seq = head - max;
+
+    if (seq == head) {
+        kprintf("trace: no events recorded\n");
+    } else {
+        kprintf("trace: %u events (%u recorded, %u overwritten)\n", head - seq, head, oldest_event());
+    }
+
+    uint64_t last = seq != head ? trace_ring[seq & (TRACE_RING_ENTRIES - 1)].tsc : 0;
+    for (; seq != head; seq++) {
+        const trace_event_t* entry = &trace_ring[seq & (TRACE_RING_ENTRIES - 1)];
+        const char* name = entry->event < EVENT_NAME_COUNT && event_names[entry->event] ? event_names[entry->event] : "?";
+
+        kprintf("%10u +%10u %08x %08x %s\n", seq, (uint32_t)(entry->tsc - last), entry->a, entry->b, name);
+        last = entry->tsc;
+    }
+
+    trace_paused = 0;
+}
+
+/**
+ * @brief Writes a little-endian value of `size` bytes to the serial port.
+ */
+static void send_bytes(uint32_t value, uint32_t size) {
+    for (uint32_t i = 0; i < size; i++) {
+        serial_putc((char)(value >> (i * 8)));
+    }
+}
+
+/**
+ * @brief Sends the recorded events over the serial port in the binary dump format.
+ *
+ * The bytes are raw (no newline translation), so the port should not be
+ * mirroring console output at the same time. Recording stops meanwhile.
+ *
+ * @return Number of events sent.
+ */
+uint32_t trace_send() {
+    trace_paused = 1;
+
+    uint32_t head = trace_head;
+    uint32_t seq = oldest_event();
+    uint32_t count = head - seq;
+
+    send_bytes(TRACE_MAGIC, 4);
+    send_bytes(TRACE_VERSION, 2);
+    send_bytes(TRACE_RECORD_SIZE, 2);
+    send_bytes(count, 4);
+
+    for (; seq != head; seq++) {
+        const trace_event_t* entry = &trace_ring[seq & (TRACE_RING_ENTRIES - 1)];
+        send_bytes((uint32_t)entry->tsc, 4);
+        send_bytes((uint32_t)(entry->tsc >> 32), 4);
+        send_bytes(entry->event, 2);
+        send_bytes(entry->reserved, 2);
+        send_bytes(entry->a, 4);
+        send_bytes(entry->b, 4);
+    }
+    serial_flush();
+
+    trace_paused = 0;
+    return count;
+}
@@ -0,0 +1,53 @@
+#!/bin/sh
+# Compares benchmark results against a baseline, both in the format `make bench` writes
+# ("name min median p99 mean" per line, cycles per operation, '#' starts a comment).
+#
+# Usage: bench_compare.sh BASELINE RESULTS [TOLERANCE_PERCENT]
+#
+# A benchmark regresses when its median is more than TOLERANCE_PERCENT (default 10)
+# above the baseline median. Exits 1 if any benchmark regressed, 2 if a file is missing.
+
+baseline=$1
+results=$2
+tolerance=${3:-10}
+
+if [ ! -f "$baseline" ]; then
+    echo "bench-compare: no baseline $baseline (create one with make bench-baseline)" >&2
+    exit 2
+fi
+if [ ! -f "$results" ]; then
+    echo "bench-compare: no results $results" >&2
+    exit 2
+fi
+
+awk -v tol="$tolerance" '
+    FNR == NR {
+        if ($1 !~ /^#/ && NF >= 3) base[$1] = $3
+        next
+    }
+    $1 ~ /^#/ || NF < 3 { next }
+    {
+        name = $1
+        cur = $3
+        if (!(name in base)) {
+            printf "%-20s %10s %10d            new\n", name, "-", cur
+            next
+        }
+        old = base[name]
+        change = old ? (cur - old) * 100 / old : 0
+        status = "ok"
+        if (change > tol) {
+            status = "REGRESSION"
+            regressions++
+        } else if (change < -tol) {
+            status = "faster"
+        }
+        printf "%-20s %10d %10d %+8.1f%%  %s\n", name, old, cur, change, status
+    }
+    END {
+        if (regressions) {
+            printf "%d benchmark(s) regressed by more than %s%%\n", regressions, tol
+            exit 1
+        }
+    }
+' "$baseline" "$results"
@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+# Decodes the binary trace dump the "trace send" command writes to the serial port
+# (format described in include/trace.h) into one text line per event.
+#
+# Usage: trace_decode.py [--kernel build/kernel.bin] SERIAL_LOG
+#
+# The log may hold console text around the dump; the last dump in it is decoded.
+# Event names are read from include/trace.h. With --kernel, arguments that point
+# into the kernel image (callers) are printed as symbol+offset, using nm.
+
+import bisect
+import os
+import re
+import struct
+import subprocess
+import sys
+
+HEADER = struct.Struct("<IHHI")  # magic, version, record size, count
+RECORD = struct.Struct("<QHHII") # tsc, event, reserved, a, b
+
+TRACE_H = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "include", "trace.h")
+
+
+def read_defines(path):
+    defines = {}
+    with open(path) as f:
+        for line in f:
+            m = re.match(r"#define\s+(TRACE_\w+)\s+(0x[0-9A-Fa-f]+|\d+)", line)
+            if m:
+                defines[m.group(1)] = int(m.group(2), 0)
+    return defines
+
+
+def read_symbols(kernel):
+    out = subprocess.run(["nm", "-n", kernel], capture_output=True, text=True, check=True).stdout
+    symbols = []
+    for line in out.splitlines():
+        parts = line.split()
+        if len(parts) == 3 and parts[1] in "tTwW":
+            symbols.append((int(parts[0], 16), parts[2]))
+    return symbols
+
+
+def symbolize(value, symbols, addresses):
+    i = bisect.bisect_right(addresses, value) - 1
+    if i < 0 or i == len(symbols) - 1:
+        return None # Below the first or past the last function
+    address, name = symbols[i]
+    return "%s+0x%x" % (name, value - address)
+
+
+def find_dump(data, defines):
+    """Returns the offset of the header of the last dump in data, or -1.
+
+    Searches forward, skipping over the records of each dump found, so the
+    magic bytes turning up inside a record (in a pointer argument, say) are
+    never taken for a header. A header only counts if its version, record
+    size and count are ones the kernel writes.
+    """
+    magic = struct.pack("<I", defines["TRACE_MAGIC"])
+    found = -1
+    pos = data.find(magic)
+    while 0 <= pos and pos + HEADER.size <= len(data):
+        _, version, size, count = HEADER.unpack_from(data, pos)
+        if version == defines["TRACE_VERSION"] and size == RECORD.size and count <= defines["TRACE_RING_ENTRIES"]:
+            found = pos
+            pos += HEADER.size + count * size # Past its records
+        else:
+            pos += 1
+        pos = data.find(magic, pos)
+    return found
+
+
+def main(argv):
+    kernel = None
+    if len(argv) >= 2 and argv[0] == "--kernel":
+        kernel = argv[1]
+        argv = argv[2:]
+    if len(argv) != 1:
+        sys.stderr.write("usage: trace_decode.py [--kernel KERNEL] SERIAL_LOG\n")
+        return 2
+
+    defines = read_defines(TRACE_H)
+    names = {}
+    for name, value in defines.items():
+        if name not in ("TRACE_RING_ENTRIES", "TRACE_MAGIC", "TRACE_VERSION", "TRACE_RECORD_SIZE"):
+            names[value] = name[len("TRACE_"):].lower()
+
+    symbols = read_symbols(kernel) if kernel else []
+    addresses = [address for address, _ in symbols]
+
+    with open(argv[0], "rb") as f:
+        data = f.read()
+
+    start = find_dump(data, defines)
+    if start < 0:
+        sys.stderr.write("trace_decode: no trace dump of version %d in %s\n" % (defines["TRACE_VERSION"], argv[0]))
+        return 1
+
+    _, _, size, count = HEADER.unpack_from(data, start)
+
+    offset = start + HEADER.size
+    available = (len(data) - offset) // size
+    if available < count:
+        sys.stderr.write("trace_decode: dump cut short, %d of %d events\n" % (available, count))
+        count = available
+
+    first = last = None
+    for i in range(count):
+        tsc, event, _, a, b = RECORD.unpack_from(data, offset + i * size)
+        if first is None:
+            first = last = tsc
+
+        args = []
+        for value in (a, b):
+            sym = symbolize(value, symbols, addresses) if symbols else None
+            args.append(sym if sym else "0x%08x" % value)
+
+        print("%12d +%-10d %-12s %s %s" % (tsc - first, tsc - last, names.get(event, "event%d" % event), args[0], args[1]))
+        last = tsc
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))